@@ -41,14 +41,37 @@
  * mp3dec.c - platform-independent top level MP3 decoder API
  **************************************************************************************/
 
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"	/* CONFIG_HELIX_MP3_PROFILE; not force-included by ESP-IDF */
+#endif
 #include "string.h"
 //#include "hlxclib/string.h"		/* for memmove, memcpy (can replace with different implementations if desired) */
 #include "mp3common.h"	/* includes mp3dec.h (public API) and internal, platform-independent API */
 
 
 //#define PROFILE
+#ifdef CONFIG_HELIX_MP3_PROFILE
+#define PROFILE
+#endif
+
+static MP3ProfileStats profileStats;
+
 #ifdef PROFILE
-#include "systime.h"
+#ifdef ESP_PLATFORM
+#include "esp_cpu.h"
+#define PROFILE_NOW()	((unsigned long)esp_cpu_get_cycle_count())
+#else
+#include <time.h>
+static unsigned long ProfileNow(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+#define PROFILE_NOW()	ProfileNow()
+#endif
+#define PROFILE_START()		time = PROFILE_NOW()
+#define PROFILE_END(stage)	profileStats.ticks[stage] += (unsigned long)(PROFILE_NOW() - time)
 #endif
 
 /**************************************************************************************
@@ -94,6 +117,93 @@ void MP3FreeDecoder(HMP3Decoder hMP3Decoder)
 	FreeBuffers(mp3DecInfo);
 }
 
+/**************************************************************************************
+ * Function:    MP3GetDecoderArenaSize
+ *
+ * Description: size of the block MP3InitDecoderStatic needs
+ *
+ * Inputs:      none
+ *
+ * Outputs:     none
+ *
+ * Return:      number of bytes (block must also be MP3_ARENA_ALIGN-aligned)
+ **************************************************************************************/
+int MP3GetDecoderArenaSize(void)
+{
+	return GetArenaSize();
+}
+
+/**************************************************************************************
+ * Function:    MP3InitDecoderStatic
+ *
+ * Description: create a decoder instance inside a caller-supplied block, no malloc
+ *
+ * Inputs:      pointer to MP3_ARENA_ALIGN-aligned block
+ *              size of block in bytes (at least MP3GetDecoderArenaSize())
+ *
+ * Outputs:     none
+ *
+ * Return:      handle to mp3 decoder instance, 0 if the block is misaligned or too small
+ *
+ * Notes:       reuse across streams with MP3ResetDecoder; MP3FreeDecoder is a no-op
+ **************************************************************************************/
+HMP3Decoder MP3InitDecoderStatic(void *arena, int arenaSize)
+{
+	return (HMP3Decoder)InitBuffersInArena(arena, arenaSize);
+}
+
+/**************************************************************************************
+ * Function:    MP3ResetDecoder
+ *
+ * Description: clear all decoding state (bit reservoir, overlap, filter history)
+ *
+ * Inputs:      valid MP3 decoder instance pointer (HMP3Decoder)
+ *
+ * Outputs:     none
+ *
+ * Return:      none
+ *
+ * Notes:       call before decoding a new stream or after a seek
+ **************************************************************************************/
+void MP3ResetDecoder(HMP3Decoder hMP3Decoder)
+{
+	MP3DecInfo *mp3DecInfo = (MP3DecInfo *)hMP3Decoder;
+
+	int decodeMode;
+
+	if (!mp3DecInfo)
+		return;
+
+	decodeMode = mp3DecInfo->decodeMode;	/* MP3SetDecodeMode survives a reset */
+	ClearBuffers(mp3DecInfo);
+	mp3DecInfo->decodeMode = decodeMode;
+}
+
+/**************************************************************************************
+ * Function:    MP3SetDecodeMode
+ *
+ * Description: select a low-power output mode (e.g. for speech and podcasts)
+ *
+ * Inputs:      valid MP3 decoder instance pointer (HMP3Decoder)
+ *              MP3_DECODE_xxx flags OR'd together (0 = full stereo, full rate)
+ *
+ * Outputs:     none
+ *
+ * Return:      none
+ *
+ * Notes:       takes effect on the next frame and survives MP3ResetDecoder
+ *              output format changes with the mode - check MP3GetLastFrameInfo()
+ **************************************************************************************/
+void MP3SetDecodeMode(HMP3Decoder hMP3Decoder, int mode)
+{
+	MP3DecInfo *mp3DecInfo = (MP3DecInfo *)hMP3Decoder;
+
+	if (!mp3DecInfo)
+		return;
+
+	mp3DecInfo->decodeMode = mode & (MP3_DECODE_MONO | MP3_DECODE_HALFRATE);
+}
+
 /**************************************************************************************
  * Function:    MP3FindSyncWord
  *
@@ -186,6 +296,8 @@ static int MP3FindFreeSync(unsigned char *buf, unsigned char firstFH[4], int nBy
  * Return:      none
  *
  * Notes:       call this right after calling MP3Decode
+ *              nChans, samprate and outputSamps describe the PCM actually produced,
+ *                which differs from the stream with MP3SetDecodeMode()
  **************************************************************************************/
 void MP3GetLastFrameInfo(HMP3Decoder hMP3Decoder, MP3FrameInfo *mp3FrameInfo)
 {
@@ -201,10 +313,11 @@ void MP3GetLastFrameInfo(HMP3Decoder hMP3Decoder, MP3FrameInfo *mp3FrameInfo)
 		mp3FrameInfo->version = 0;
 	} else {
 		mp3FrameInfo->bitrate = mp3DecInfo->bitrate;
-		mp3FrameInfo->nChans = mp3DecInfo->nChans;
-		mp3FrameInfo->samprate = mp3DecInfo->samprate;
+		mp3FrameInfo->nChans = OutChans(mp3DecInfo);
+		mp3FrameInfo->samprate = mp3DecInfo->samprate >> OutRateShift(mp3DecInfo);
 		mp3FrameInfo->bitsPerSample = 16;
-		mp3FrameInfo->outputSamps = mp3DecInfo->nChans * (int)samplesPerFrameTab[mp3DecInfo->version][mp3DecInfo->layer - 1];
+		mp3FrameInfo->outputSamps = OutChans(mp3DecInfo) * 
+			((int)samplesPerFrameTab[mp3DecInfo->version][mp3DecInfo->layer - 1] >> OutRateShift(mp3DecInfo));
 		mp3FrameInfo->layer = mp3DecInfo->layer;
 		mp3FrameInfo->version = mp3DecInfo->version;
 	}
@@ -258,7 +371,7 @@ static void MP3ClearBadFrame(MP3DecInfo *mp3DecInfo, short *outbuf)
 	if (!mp3DecInfo)
 		return;
 
-	for (i = 0; i < mp3DecInfo->nGrans * mp3DecInfo->nGranSamps * mp3DecInfo->nChans; i++)
+	for (i = 0; i < mp3DecInfo->nGrans * (mp3DecInfo->nGranSamps >> OutRateShift(mp3DecInfo)) * OutChans(mp3DecInfo); i++)
 		outbuf[i] = 0;
 }
 
@@ -276,6 +389,7 @@ static void MP3ClearBadFrame(MP3DecInfo *mp3DecInfo, short *outbuf)
  *
  * Outputs:     PCM data in outbuf, interleaved LRLRLR... if stereo
  *                number of output samples = nGrans * nGranSamps * nChans
+ *                (one channel / half the samples with MP3_DECODE_MONO / _HALFRATE)
  *              updated inbuf pointer, updated bytesLeft
  *
  * Return:      error code, defined in mp3dec.h (0 means no error, < 0 means error)
@@ -286,12 +400,12 @@ static void MP3ClearBadFrame(MP3DecInfo *mp3DecInfo, short *outbuf)
 int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, short *outbuf, int useSize)
 {
 	int offset, bitOffset, mainBits, gr, ch, fhBytes, siBytes, freeFrameBytes;
-	int prevBitOffset, sfBlockBits, huffBlockBits;
+	int prevBitOffset, sfBlockBits, huffBlockBits, nImdct;
 	unsigned char *mainPtr;
 	MP3DecInfo *mp3DecInfo = (MP3DecInfo *)hMP3Decoder;
 	
 	#ifdef PROFILE
-	long time;
+	unsigned long time;
 	#endif
 
 	if (!mp3DecInfo)
@@ -304,7 +418,7 @@ int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, sh
 	*inbuf += fhBytes;
 	
 #ifdef PROFILE
-	time = systime_get();
+	PROFILE_START();
 #endif
 	/* unpack side info */
 	siBytes = UnpackSideInfo(mp3DecInfo, *inbuf);
@@ -315,8 +429,7 @@ int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, sh
 	*inbuf += siBytes;
 	*bytesLeft -= (fhBytes + siBytes);
 #ifdef PROFILE
-	time = systime_get() - time;
-	printf("UnpackSideInfo: %i ms\n", time);
+	PROFILE_END(MP3_PROFILE_SIDEINFO);
 #endif
 	
 	
@@ -363,7 +476,7 @@ int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, sh
 		}
 
 #ifdef PROFILE
-	time = systime_get();
+	PROFILE_START();
 #endif
 		/* fill main data buffer with enough new data for this frame */
 		if (mp3DecInfo->mainDataBytes >= mp3DecInfo->mainDataBegin) {
@@ -385,8 +498,7 @@ int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, sh
 			return ERR_MP3_MAINDATA_UNDERFLOW;
 		}
 #ifdef PROFILE
-	time = systime_get() - time;
-	printf("data buffer filling: %i ms\n", time);
+	PROFILE_END(MP3_PROFILE_MAINDATA);
 #endif
 
 	}
@@ -398,14 +510,13 @@ int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, sh
 		for (ch = 0; ch < mp3DecInfo->nChans; ch++) {
 			
 			#ifdef PROFILE
-				time = systime_get();
+				PROFILE_START();
 			#endif
 			/* unpack scale factors and compute size of scale factor block */
 			prevBitOffset = bitOffset;
 			offset = UnpackScaleFactors(mp3DecInfo, mainPtr, &bitOffset, mainBits, gr, ch);
 			#ifdef PROFILE
-				time = systime_get() - time;
-				printf("UnpackScaleFactors: %i ms\n", time);
+				PROFILE_END(MP3_PROFILE_SCALEFACT);
 			#endif
 
 			sfBlockBits = 8*offset - prevBitOffset + bitOffset;
@@ -419,7 +530,7 @@ int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, sh
 			}
 
 			#ifdef PROFILE
-				time = systime_get();
+				PROFILE_START();
 			#endif
 			/* decode Huffman code words */
 			prevBitOffset = bitOffset;
@@ -429,8 +540,7 @@ int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, sh
 				return ERR_MP3_INVALID_HUFFCODES;
 			}
 			#ifdef PROFILE
-				time = systime_get() - time;
-				printf("Huffman: %i ms\n", time);
+				PROFILE_END(MP3_PROFILE_HUFFMAN);
 			#endif
 
 			mainPtr += offset;
@@ -438,7 +548,7 @@ int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, sh
 		}
 		
 		#ifdef PROFILE
-			time = systime_get();
+			PROFILE_START();
 		#endif
 		/* dequantize coefficients, decode stereo, reorder short blocks */
 		if (Dequantize(mp3DecInfo, gr) < 0) {
@@ -446,39 +556,82 @@ int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, sh
 			return ERR_MP3_INVALID_DEQUANTIZE;			
 		}
 		#ifdef PROFILE
-			time = systime_get() - time;
-			printf("Dequantize: %i ms\n", time);
+			PROFILE_END(MP3_PROFILE_DEQUANT);
 		#endif
 
-		/* alias reduction, inverse MDCT, overlap-add, frequency inversion */
-		for (ch = 0; ch < mp3DecInfo->nChans; ch++)
-		{
+		/* alias reduction, inverse MDCT, overlap-add, frequency inversion
+		 *   (only ch 0 if Dequantize() already folded the granule to mono)
+		 */
 		#ifdef PROFILE
-			time = systime_get();
+			PROFILE_START();
 		#endif
+		nImdct = mp3DecInfo->nChans;
+		if (mp3DecInfo->nChans == 2 && (mp3DecInfo->decodeMode & MP3_DECODE_MONO)) {
+			DownmixOverlap(mp3DecInfo);
+			if (mp3DecInfo->monoMerged)
+				nImdct = 1;
+		}
+		for (ch = 0; ch < nImdct; ch++)
+		{
 			if (IMDCT(mp3DecInfo, gr, ch) < 0) {
 				MP3ClearBadFrame(mp3DecInfo, outbuf);
 				return ERR_MP3_INVALID_IMDCT;			
 			}
+		}
+		if (nImdct == 2 && (mp3DecInfo->decodeMode & MP3_DECODE_MONO))
+			DownmixIMDCT(mp3DecInfo);	/* block types differ: fold in the time domain */
 		#ifdef PROFILE
-			time = systime_get() - time;
-			printf("IMDCT: %i ms\n", time);
+			PROFILE_END(MP3_PROFILE_IMDCT);
 		#endif
-		}
 		
 		#ifdef PROFILE
-			time = systime_get();
+			PROFILE_START();
 		#endif
 		/* subband transform - if stereo, interleaves pcm LRLRLR */
-		if (Subband(mp3DecInfo, outbuf + gr*mp3DecInfo->nGranSamps*mp3DecInfo->nChans) < 0) {
+		if (Subband(mp3DecInfo, outbuf + gr*(mp3DecInfo->nGranSamps >> OutRateShift(mp3DecInfo))*OutChans(mp3DecInfo)) < 0) {
 			MP3ClearBadFrame(mp3DecInfo, outbuf);
 			return ERR_MP3_INVALID_SUBBAND;			
 		}
 		#ifdef PROFILE
-			time = systime_get() - time;
-			printf("Subband: %i ms\n", time);
+			PROFILE_END(MP3_PROFILE_SUBBAND);
 		#endif
 		
 	}
+#ifdef PROFILE
+	profileStats.frames++;
+#endif
 	return ERR_MP3_NONE;
 }
+
+/**************************************************************************************
+ * Function:    MP3GetProfile
+ *
+ * Description: copy the per-stage decode cost accumulated since the last reset
+ *
+ * Inputs:      pointer to MP3ProfileStats struct
+ *
+ * Outputs:     filled-in MP3ProfileStats struct (all zero without CONFIG_HELIX_MP3_PROFILE)
+ *
+ * Return:      none
+ **************************************************************************************/
+void MP3GetProfile(MP3ProfileStats *stats)
+{
+	if (stats)
+		*stats = profileStats;
+}
+
+/**************************************************************************************
+ * Function:    MP3ResetProfile
+ *
+ * Description: clear the per-stage decode cost counters
+ *
+ * Inputs:      none
+ *
+ * Outputs:     none
+ *
+ * Return:      none
+ **************************************************************************************/
+void MP3ResetProfile(void)
+{
+	memset(&profileStats, 0, sizeof(profileStats));
+}
@@ -93,8 +93,20 @@ typedef struct _MP3DecInfo {
 
 	int part23Length[MAX_NGRAN][MAX_NCHAN];
 
+	/* nonzero if all buffers live in a caller-supplied arena (never freed) */
+	int staticArena;
+
+	/* low-power output (MP3_DECODE_xxx flags), kept across MP3ResetDecoder() */
+	int decodeMode;
+	int monoMerged;			/* this granule was folded to ch 0 before the IMDCT */
+	int monoMergedPrev;		/* previous granule was folded (ch 1 overlap is stale) */
+
 } MP3DecInfo;
 
+/* output format after MP3_DECODE_MONO / MP3_DECODE_HALFRATE */
+#define OutChans(d)			(((d)->decodeMode & MP3_DECODE_MONO) ? 1 : (d)->nChans)
+#define OutRateShift(d)		(((d)->decodeMode & MP3_DECODE_HALFRATE) ? 1 : 0)
+
 typedef struct _SFBandTable {
 	short l[23];
 	short s[14];
@@ -103,12 +115,17 @@ typedef struct _SFBandTable {
 /* decoder functions which must be implemented for each platform */
 MP3DecInfo *AllocateBuffers(void);
 void FreeBuffers(MP3DecInfo *mp3DecInfo);
+int GetArenaSize(void);
+MP3DecInfo *InitBuffersInArena(void *arena, int arenaSize);
+void ClearBuffers(MP3DecInfo *mp3DecInfo);
 int CheckPadBit(MP3DecInfo *mp3DecInfo);
 int UnpackFrameHeader(MP3DecInfo *mp3DecInfo, unsigned char *buf);
 int UnpackSideInfo(MP3DecInfo *mp3DecInfo, unsigned char *buf);
 int DecodeHuffman(MP3DecInfo *mp3DecInfo, unsigned char *buf, int *bitOffset, int huffBlockBits, int gr, int ch);
 int Dequantize(MP3DecInfo *mp3DecInfo, int gr);
 int IMDCT(MP3DecInfo *mp3DecInfo, int gr, int ch);
+void DownmixOverlap(MP3DecInfo *mp3DecInfo);
+void DownmixIMDCT(MP3DecInfo *mp3DecInfo);
 int UnpackScaleFactors(MP3DecInfo *mp3DecInfo, unsigned char *buf, int *bitOffset, int bitsAvail, int gr, int ch);
 int Subband(MP3DecInfo *mp3DecInfo, short *pcmBuf);
 
@@ -116,15 +116,58 @@ typedef struct _MP3FrameInfo {
 	int version;
 } MP3FrameInfo;
 
+/* per-stage decode cost, collected when built with CONFIG_HELIX_MP3_PROFILE
+ *   (CPU cycles on ESP targets, nanoseconds elsewhere)
+ */
+enum {
+	MP3_PROFILE_SIDEINFO,
+	MP3_PROFILE_MAINDATA,		/* bit reservoir fill */
+	MP3_PROFILE_SCALEFACT,
+	MP3_PROFILE_HUFFMAN,
+	MP3_PROFILE_DEQUANT,		/* dequantize + stereo processing + short block reorder */
+	MP3_PROFILE_IMDCT,
+	MP3_PROFILE_SUBBAND,		/* polyphase synthesis */
+
+	MP3_PROFILE_NSTAGES
+};
+
+typedef struct _MP3ProfileStats {
+	unsigned long long ticks[MP3_PROFILE_NSTAGES];
+	unsigned long frames;		/* frames decoded without error */
+} MP3ProfileStats;
+
 /* public API */
 HMP3Decoder MP3InitDecoder(void);
 void MP3FreeDecoder(HMP3Decoder hMP3Decoder);
+
+/* allocation-free instance in a caller-supplied block (MP3_ARENA_ALIGN-aligned,
+ *   at least MP3GetDecoderArenaSize() bytes); MP3ResetDecoder() readies it for a
+ *   new stream, MP3FreeDecoder() on it is a no-op
+ */
+#define MP3_ARENA_ALIGN		8
+int MP3GetDecoderArenaSize(void);
+HMP3Decoder MP3InitDecoderStatic(void *arena, int arenaSize);
+void MP3ResetDecoder(HMP3Decoder hMP3Decoder);
+
+/* low-power output modes for MP3SetDecodeMode(), OR'd together
+ *   MP3_DECODE_MONO:     fold stereo to one channel before the IMDCT (mid-side streams
+ *                          never dequantize the side channel)
+ *   MP3_DECODE_HALFRATE: synthesize the lower 16 subbands only, at half the sample rate
+ * MP3GetLastFrameInfo() reports the output format (channels, rate, samples)
+ */
+#define MP3_DECODE_MONO		0x01
+#define MP3_DECODE_HALFRATE	0x02
+void MP3SetDecodeMode(HMP3Decoder hMP3Decoder, int mode);
 int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, short *outbuf, int useSize);
 
 void MP3GetLastFrameInfo(HMP3Decoder hMP3Decoder, MP3FrameInfo *mp3FrameInfo);
 int MP3GetNextFrameInfo(HMP3Decoder hMP3Decoder, MP3FrameInfo *mp3FrameInfo, unsigned char *buf);
 int MP3FindSyncWord(unsigned char *buf, int nBytes);
 
+/* all zero unless built with CONFIG_HELIX_MP3_PROFILE */
+void MP3GetProfile(MP3ProfileStats *stats);
+void MP3ResetProfile(void);
+
 #ifdef __cplusplus
 }
 #endif
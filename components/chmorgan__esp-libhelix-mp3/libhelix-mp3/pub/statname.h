@@ -65,9 +65,14 @@
 #define	UnpackSideInfo		STATNAME(UnpackSideInfo)
 #define	AllocateBuffers		STATNAME(AllocateBuffers)
 #define	FreeBuffers			STATNAME(FreeBuffers)
+#define	GetArenaSize		STATNAME(GetArenaSize)
+#define	InitBuffersInArena	STATNAME(InitBuffersInArena)
+#define	ClearBuffers		STATNAME(ClearBuffers)
 #define	DecodeHuffman		STATNAME(DecodeHuffman)
 #define	Dequantize			STATNAME(Dequantize)
 #define	IMDCT				STATNAME(IMDCT)
+#define	DownmixOverlap		STATNAME(DownmixOverlap)
+#define	DownmixIMDCT		STATNAME(DownmixIMDCT)
 #define	UnpackScaleFactors	STATNAME(UnpackScaleFactors)
 #define	Subband				STATNAME(Subband)
 
@@ -140,6 +140,107 @@ MP3DecInfo *AllocateBuffers(void)
 	return mp3DecInfo;
 }
 
+#define ARENA_ROUND(n)	(((n) + MP3_ARENA_ALIGN - 1) & ~(MP3_ARENA_ALIGN - 1))
+
+/**************************************************************************************
+ * Function:    GetArenaSize
+ *
+ * Description: number of bytes InitBuffersInArena needs for one decoder instance
+ *
+ * Inputs:      none
+ *
+ * Outputs:     none
+ *
+ * Return:      arena size in bytes (each structure rounded up to MP3_ARENA_ALIGN)
+ **************************************************************************************/
+int GetArenaSize(void)
+{
+	return ARENA_ROUND(sizeof(MP3DecInfo)) +
+		ARENA_ROUND(sizeof(FrameHeader)) +
+		ARENA_ROUND(sizeof(SideInfo)) +
+		ARENA_ROUND(sizeof(ScaleFactorInfo)) +
+		ARENA_ROUND(sizeof(HuffmanInfo)) +
+		ARENA_ROUND(sizeof(DequantInfo)) +
+		ARENA_ROUND(sizeof(IMDCTInfo)) +
+		ARENA_ROUND(sizeof(SubbandInfo));
+}
+
+/**************************************************************************************
+ * Function:    InitBuffersInArena
+ *
+ * Description: lay out all the decoder structures in a caller-supplied block
+ *
+ * Inputs:      pointer to block aligned to MP3_ARENA_ALIGN
+ *              size of block in bytes
+ *
+ * Outputs:     none
+ *
+ * Return:      pointer to MP3DecInfo structure at the start of the block, initialized
+ *                as by AllocateBuffers, or 0 if the block is misaligned or too small
+ *
+ * Notes:       no heap use; FreeBuffers leaves an arena instance alone
+ **************************************************************************************/
+MP3DecInfo *InitBuffersInArena(void *arena, int arenaSize)
+{
+	MP3DecInfo *mp3DecInfo;
+	unsigned char *p = (unsigned char *)arena;
+
+	if (!arena || ((unsigned long)arena & (MP3_ARENA_ALIGN - 1)) || arenaSize < GetArenaSize())
+		return 0;
+
+	mp3DecInfo = (MP3DecInfo *)p;					p += ARENA_ROUND(sizeof(MP3DecInfo));
+	mp3DecInfo->FrameHeaderPS =     (void *)p;		p += ARENA_ROUND(sizeof(FrameHeader));
+	mp3DecInfo->SideInfoPS =        (void *)p;		p += ARENA_ROUND(sizeof(SideInfo));
+	mp3DecInfo->ScaleFactorInfoPS = (void *)p;		p += ARENA_ROUND(sizeof(ScaleFactorInfo));
+	mp3DecInfo->HuffmanInfoPS =     (void *)p;		p += ARENA_ROUND(sizeof(HuffmanInfo));
+	mp3DecInfo->DequantInfoPS =     (void *)p;		p += ARENA_ROUND(sizeof(DequantInfo));
+	mp3DecInfo->IMDCTInfoPS =       (void *)p;		p += ARENA_ROUND(sizeof(IMDCTInfo));
+	mp3DecInfo->SubbandInfoPS =     (void *)p;
+
+	ClearBuffers(mp3DecInfo);
+	mp3DecInfo->staticArena = 1;
+	mp3DecInfo->decodeMode = 0;		/* new instance: full stereo, full rate (only MP3ResetDecoder keeps the mode) */
+
+	return mp3DecInfo;
+}
+
+/**************************************************************************************
+ * Function:    ClearBuffers
+ *
+ * Description: return a decoder instance to its freshly-initialized state
+ *
+ * Inputs:      pointer to MP3DecInfo structure with all buffers in place
+ *
+ * Outputs:     all decoder state cleared, buffer pointers and arena flag kept
+ *
+ * Return:      none
+ *
+ * Notes:       used to start a new stream (or after a seek) without free/alloc
+ **************************************************************************************/
+void ClearBuffers(MP3DecInfo *mp3DecInfo)
+{
+	MP3DecInfo saved = *mp3DecInfo;
+
+	ClearBuffer(mp3DecInfo, sizeof(MP3DecInfo));
+	mp3DecInfo->FrameHeaderPS =     saved.FrameHeaderPS;
+	mp3DecInfo->SideInfoPS =        saved.SideInfoPS;
+	mp3DecInfo->ScaleFactorInfoPS = saved.ScaleFactorInfoPS;
+	mp3DecInfo->HuffmanInfoPS =     saved.HuffmanInfoPS;
+	mp3DecInfo->DequantInfoPS =     saved.DequantInfoPS;
+	mp3DecInfo->IMDCTInfoPS =       saved.IMDCTInfoPS;
+	mp3DecInfo->SubbandInfoPS =     saved.SubbandInfoPS;
+	mp3DecInfo->staticArena =       saved.staticArena;
+
+	/* DSP primitives assume a bunch of state variables are 0 on first use */
+	ClearBuffer(mp3DecInfo->FrameHeaderPS,     sizeof(FrameHeader));
+	ClearBuffer(mp3DecInfo->SideInfoPS,        sizeof(SideInfo));
+	ClearBuffer(mp3DecInfo->ScaleFactorInfoPS, sizeof(ScaleFactorInfo));
+	ClearBuffer(mp3DecInfo->HuffmanInfoPS,     sizeof(HuffmanInfo));
+	ClearBuffer(mp3DecInfo->DequantInfoPS,     sizeof(DequantInfo));
+	ClearBuffer(mp3DecInfo->IMDCTInfoPS,       sizeof(IMDCTInfo));
+	ClearBuffer(mp3DecInfo->SubbandInfoPS,     sizeof(SubbandInfo));
+}
+
 #define SAFE_FREE(x)	{if (x)	free(x);	(x) = 0;}	/* helper macro */
 
 /**************************************************************************************
@@ -157,7 +258,7 @@ MP3DecInfo *AllocateBuffers(void)
  **************************************************************************************/
 void FreeBuffers(MP3DecInfo *mp3DecInfo)
 {
-	if (!mp3DecInfo)
+	if (!mp3DecInfo || mp3DecInfo->staticArena)
 		return;
 
 	SAFE_FREE(mp3DecInfo->FrameHeaderPS);
@@ -86,6 +86,7 @@
 #define	HUFF_PAIRTABS			32
 #define BLOCK_SIZE				18
 #define	NBANDS					32
+#define HALFRATE_NSAMP			(18 * NBANDS / 2)	/* lower 16 subbands, for MP3_DECODE_HALFRATE */
 #define MAX_REORDER_SAMPS		((192-126)*3)		/* largest critical band for short blocks (see sfBandTable) */
 #define VBUF_LENGTH				(17 * 2 * NBANDS)	/* for double-sized vbuf FIFO */
 
@@ -99,6 +100,8 @@
 #define	IntensityProcMPEG2	STATNAME(IntensityProcMPEG2)
 #define PolyphaseMono		STATNAME(PolyphaseMono)
 #define PolyphaseStereo		STATNAME(PolyphaseStereo)
+#define PolyphaseMonoHalf	STATNAME(PolyphaseMonoHalf)
+#define PolyphaseStereoHalf	STATNAME(PolyphaseStereoHalf)
 #define FDCT32				STATNAME(FDCT32)
 
 #define	ISFMpeg1			STATNAME(ISFMpeg1)
@@ -291,6 +294,8 @@ extern "C" {
 #endif
 void PolyphaseMono(short *pcm, int *vbuf, const int *coefBase);
 void PolyphaseStereo(short *pcm, int *vbuf, const int *coefBase);
+void PolyphaseMonoHalf(short *pcm, int *vbuf, const int *coefBase);
+void PolyphaseStereoHalf(short *pcm, int *vbuf, const int *coefBase);
 #ifdef __cplusplus
 }
 #endif
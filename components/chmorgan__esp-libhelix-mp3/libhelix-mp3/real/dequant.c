@@ -62,7 +62,11 @@
  *
  * Return:      0 on success, -1 if null input pointers
  *
- * Notes:       In calling output Q(DQ_FRACBITS_OUT), we assume an implicit bias 
+ * Notes:       with MP3_DECODE_MONO, a stereo granule whose channels share a block type
+ *                is folded into channel 0 ((L+R)/2) and mp3DecInfo->monoMerged is set;
+ *                for pure mid-side stereo that is just the mid channel, so the side
+ *                channel is never dequantized
+ *              In calling output Q(DQ_FRACBITS_OUT), we assume an implicit bias 
  *                of 2^15. Some (floating-point) reference implementations factor this 
  *                into the 2^(0.25 * gain) scaling explicitly. But to avoid precision 
  *                loss, we don't do that. Instead take it into account in the final 
@@ -95,6 +99,20 @@ int Dequantize(MP3DecInfo *mp3DecInfo, int gr)
 	cbi = di->cbi;
 	mOut[0] = mOut[1] = 0;
 
+	mp3DecInfo->monoMerged = 0;
+	if (mp3DecInfo->nChans == 2 && (mp3DecInfo->decodeMode & MP3_DECODE_MONO) &&
+		si->sis[gr][0].blockType == si->sis[gr][1].blockType && 
+		si->sis[gr][0].mixedBlock == si->sis[gr][1].mixedBlock) {
+		mp3DecInfo->monoMerged = 1;
+
+		/* L = M + S, R = M - S (1/sqrt(2) done in DequantChannel()) so (L+R)/2 = M */
+		if (fh->modeExt == 2) {
+			hi->gb[0] = DequantChannel(hi->huffDecBuf[0], di->workBuf, &hi->nonZeroBound[0], fh, 
+				&si->sis[gr][0], &sfi->sfis[gr][0], &cbi[0]);
+			return 0;
+		}
+	}
+
 	/* dequantize all the samples in each channel */
 	for (ch = 0; ch < mp3DecInfo->nChans; ch++) {
 		hi->gb[ch] = DequantChannel(hi->huffDecBuf[ch], di->workBuf, &hi->nonZeroBound[ch], fh, 
@@ -153,6 +171,15 @@ int Dequantize(MP3DecInfo *mp3DecInfo, int gr)
 		hi->nonZeroBound[1] = nSamps;
 	}
 
+	/* fold to mono in the frequency domain: one IMDCT and one synthesis instead of two */
+	if (mp3DecInfo->monoMerged) {
+		nSamps = MAX(hi->nonZeroBound[0], hi->nonZeroBound[1]);
+		for (i = 0; i < nSamps; i++)
+			hi->huffDecBuf[0][i] = (hi->huffDecBuf[0][i] >> 1) + (hi->huffDecBuf[1][i] >> 1);
+		hi->gb[0] = MIN(hi->gb[0], hi->gb[1]);
+		hi->nonZeroBound[0] = nSamps;
+	}
+
 	/* output format Q(DQ_FRACBITS_OUT) */
 	return 0;
 }
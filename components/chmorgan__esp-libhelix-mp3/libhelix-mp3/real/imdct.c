@@ -721,7 +721,7 @@ static int HybridTransform(int *xCurr, int *xPrev, int y[BLOCK_SIZE][NBANDS], Si
  // a bit faster in RAM
 int IMDCT(MP3DecInfo *mp3DecInfo, int gr, int ch)
 {
-	int nBfly, blockCutoff;
+	int i, nBfly, blockCutoff;
 	FrameHeader *fh;
 	SideInfo *si;
 	HuffmanInfo *hi;
@@ -739,6 +739,13 @@ int IMDCT(MP3DecInfo *mp3DecInfo, int gr, int ch)
 	hi = (HuffmanInfo*)(mp3DecInfo->HuffmanInfoPS);
 	mi = (IMDCTInfo *)(mp3DecInfo->IMDCTInfoPS);
 
+	/* half-rate output only synthesizes the lower half of the subbands */
+	if ((mp3DecInfo->decodeMode & MP3_DECODE_HALFRATE) && hi->nonZeroBound[ch] > HALFRATE_NSAMP) {
+		for (i = HALFRATE_NSAMP; i < hi->nonZeroBound[ch]; i++)
+			hi->huffDecBuf[ch][i] = 0;
+		hi->nonZeroBound[ch] = HALFRATE_NSAMP;
+	}
+
 	/* anti-aliasing done on whole long blocks only
 	 * for mixed blocks, nBfly always 1, except 3 for 8 kHz MPEG 2.5 (see sfBandTab) 
      *   nLongBlocks = number of blocks with (possibly) non-zero power 
@@ -782,3 +789,75 @@ int IMDCT(MP3DecInfo *mp3DecInfo, int gr, int ch)
 	/* output has gained 2 int bits */
 	return 0;
 }
+
+/**************************************************************************************
+ * Function:    DownmixOverlap
+ *
+ * Description: keep the overlap-add state consistent when MP3_DECODE_MONO switches
+ *                between folding before the IMDCT (one channel) and after it (two)
+ *
+ * Inputs:      MP3DecInfo structure after Dequantize() for this granule
+ *                (mp3DecInfo->monoMerged set for this granule)
+ *
+ * Outputs:     overlap buffer and block state of ch 0 and/or ch 1 updated
+ *
+ * Return:      none
+ *
+ * Notes:       entering fold: ch 0 overlap becomes the average of both channels
+ *              leaving fold: ch 1 takes a copy of the (already mono) ch 0 overlap,
+ *                so the time-domain average in DownmixIMDCT() adds it back once
+ *              the window of the averaged tail follows ch 0 for that one granule
+ **************************************************************************************/
+void DownmixOverlap(MP3DecInfo *mp3DecInfo)
+{
+	int i, n;
+	IMDCTInfo *mi;
+
+	if (!mp3DecInfo || !mp3DecInfo->IMDCTInfoPS)
+		return;
+	mi = (IMDCTInfo *)(mp3DecInfo->IMDCTInfoPS);
+
+	if (mp3DecInfo->monoMerged && !mp3DecInfo->monoMergedPrev) {
+		n = 9 * MAX(mi->numPrevIMDCT[0], mi->numPrevIMDCT[1]);
+		for (i = 0; i < n; i++)
+			mi->overBuf[0][i] = (mi->overBuf[0][i] >> 1) + (mi->overBuf[1][i] >> 1);
+		mi->numPrevIMDCT[0] = n / 9;
+	} else if (!mp3DecInfo->monoMerged && mp3DecInfo->monoMergedPrev) {
+		for (i = 0; i < MAX_NSAMP / 2; i++)
+			mi->overBuf[1][i] = mi->overBuf[0][i];
+		mi->numPrevIMDCT[1] = mi->numPrevIMDCT[0];
+		mi->prevType[1] = mi->prevType[0];
+		mi->prevWinSwitch[1] = mi->prevWinSwitch[0];
+	}
+	mp3DecInfo->monoMergedPrev = mp3DecInfo->monoMerged;
+}
+
+/**************************************************************************************
+ * Function:    DownmixIMDCT
+ *
+ * Description: fold the IMDCT output of both channels into ch 0 ((L+R)/2)
+ *
+ * Inputs:      MP3DecInfo structure after IMDCT() for both channels
+ *
+ * Outputs:     averaged samples in outBuf[0], updated guard bits for ch 0
+ *
+ * Return:      none
+ *
+ * Notes:       only used for granules whose channels have different block types
+ *                (otherwise Dequantize() folds in the frequency domain)
+ **************************************************************************************/
+void DownmixIMDCT(MP3DecInfo *mp3DecInfo)
+{
+	int i, *x0, *x1;
+	IMDCTInfo *mi;
+
+	if (!mp3DecInfo || !mp3DecInfo->IMDCTInfoPS)
+		return;
+	mi = (IMDCTInfo *)(mp3DecInfo->IMDCTInfoPS);
+
+	x0 = mi->outBuf[0][0];
+	x1 = mi->outBuf[1][0];
+	for (i = 0; i < BLOCK_SIZE * NBANDS; i++)
+		x0[i] = (x0[i] >> 1) + (x1[i] >> 1);
+	mi->gb[0] = MIN(mi->gb[0], mi->gb[1]);
+}
@@ -176,6 +176,91 @@ void PolyphaseMono(short *pcm, int *vbuf, const int *coefBase)
 	}
 }
 
+/**************************************************************************************
+ * Function:    PolyphaseMonoHalf
+ *
+ * Description: filter one subband and produce 16 output PCM samples for one channel
+ *                (every other sample of PolyphaseMono, for MP3_DECODE_HALFRATE)
+ *
+ * Inputs:      pointer to PCM output buffer
+ *              pointer to start of vbuf (preserved from last call)
+ *              start of filter coefficient table (in proper, shuffled order)
+ *
+ * Outputs:     16 samples of one channel of decoded PCM data, (i.e. Q16.0)
+ *
+ * Return:      none
+ *
+ * Notes:       no anti-alias filter - only valid with the upper 16 subbands zeroed,
+ *                which IMDCT() does in half-rate mode
+ *              about half the multiply-accumulates of PolyphaseMono
+ **************************************************************************************/
+void PolyphaseMonoHalf(short *pcm, int *vbuf, const int *coefBase)
+{	
+	int i;
+	const int *coef;
+	int *vb1;
+	int vLo, vHi, c1, c2;
+	Word64 sum1L, sum2L, rndVal;
+
+	rndVal = (Word64)( 1 << (DEF_NFRACBITS - 1 + (32 - CSHIFT)) );
+
+	/* special case, output sample 0 */
+	coef = coefBase;
+	vb1 = vbuf;
+	sum1L = rndVal;
+
+	MC0M(0)
+	MC0M(1)
+	MC0M(2)
+	MC0M(3)
+	MC0M(4)
+	MC0M(5)
+	MC0M(6)
+	MC0M(7)
+
+	*(pcm + 0) = ClipToShort((int)SAR64(sum1L, (32-CSHIFT)), DEF_NFRACBITS);
+
+	/* special case, output sample 8 (full-rate sample 16) */
+	coef = coefBase + 256;
+	vb1 = vbuf + 64*16;
+	sum1L = rndVal;
+
+	MC1M(0)
+	MC1M(1)
+	MC1M(2)
+	MC1M(3)
+	MC1M(4)
+	MC1M(5)
+	MC1M(6)
+	MC1M(7)
+
+	*(pcm + 8) = ClipToShort((int)SAR64(sum1L, (32-CSHIFT)), DEF_NFRACBITS);
+
+	/* even full-rate samples only: sum1L = samples 2, 4, ... 14   sum2L = samples 30, 28, ... 18 */
+	coef = coefBase + 32;
+	vb1 = vbuf + 128;
+	pcm++;
+
+	for (i = 7; i > 0; i--) {
+		sum1L = sum2L = rndVal;
+
+		MC2M(0)
+		MC2M(1)
+		MC2M(2)
+		MC2M(3)
+		MC2M(4)
+		MC2M(5)
+		MC2M(6)
+		MC2M(7)
+
+		coef += 16;		/* skip the odd sample pair */
+		vb1 += 128;
+		*(pcm)       = ClipToShort((int)SAR64(sum1L, (32-CSHIFT)), DEF_NFRACBITS);
+		*(pcm + 2*i) = ClipToShort((int)SAR64(sum2L, (32-CSHIFT)), DEF_NFRACBITS);
+		pcm++;
+	}
+}
+
 #define MC0S(x)	{ \
 	c1 = *coef;		coef++;		c2 = *coef;		coef++; \
 	vLo = *(vb1+(x));		vHi = *(vb1+(23-(x))); \
@@ -293,3 +378,92 @@ void PolyphaseStereo(short *pcm, int *vbuf, const int *coefBase)
 		pcm += 2;
 	}
 }
+
+/**************************************************************************************
+ * Function:    PolyphaseStereoHalf
+ *
+ * Description: filter one subband and produce 16 output PCM samples for each channel
+ *                (every other sample of PolyphaseStereo, for MP3_DECODE_HALFRATE)
+ *
+ * Inputs:      pointer to PCM output buffer
+ *              pointer to start of vbuf (preserved from last call)
+ *              start of filter coefficient table (in proper, shuffled order)
+ *
+ * Outputs:     16 samples of two channels of decoded PCM data, (i.e. Q16.0)
+ *
+ * Return:      none
+ *
+ * Notes:       interleaves PCM samples LRLRLR...
+ *              see PolyphaseMonoHalf
+ **************************************************************************************/
+void PolyphaseStereoHalf(short *pcm, int *vbuf, const int *coefBase)
+{
+	int i;
+	const int *coef;
+	int *vb1;
+	int vLo, vHi, c1, c2;
+	Word64 sum1L, sum2L, sum1R, sum2R, rndVal;
+
+	rndVal = (Word64)( 1 << (DEF_NFRACBITS - 1 + (32 - CSHIFT)) );
+
+	/* special case, output sample 0 */
+	coef = coefBase;
+	vb1 = vbuf;
+	sum1L = sum1R = rndVal;
+
+	MC0S(0)
+	MC0S(1)
+	MC0S(2)
+	MC0S(3)
+	MC0S(4)
+	MC0S(5)
+	MC0S(6)
+	MC0S(7)
+
+	*(pcm + 0) = ClipToShort((int)SAR64(sum1L, (32-CSHIFT)), DEF_NFRACBITS);
+	*(pcm + 1) = ClipToShort((int)SAR64(sum1R, (32-CSHIFT)), DEF_NFRACBITS);
+
+	/* special case, output sample 8 (full-rate sample 16) */
+	coef = coefBase + 256;
+	vb1 = vbuf + 64*16;
+	sum1L = sum1R = rndVal;
+
+	MC1S(0)
+	MC1S(1)
+	MC1S(2)
+	MC1S(3)
+	MC1S(4)
+	MC1S(5)
+	MC1S(6)
+	MC1S(7)
+
+	*(pcm + 2*8 + 0) = ClipToShort((int)SAR64(sum1L, (32-CSHIFT)), DEF_NFRACBITS);
+	*(pcm + 2*8 + 1) = ClipToShort((int)SAR64(sum1R, (32-CSHIFT)), DEF_NFRACBITS);
+
+	/* even full-rate samples only: sum1L = samples 2, 4, ... 14   sum2L = samples 30, 28, ... 18 */
+	coef = coefBase + 32;
+	vb1 = vbuf + 128;
+	pcm += 2;
+
+	for (i = 7; i > 0; i--) {
+		sum1L = sum2L = rndVal;
+		sum1R = sum2R = rndVal;
+
+		MC2S(0)
+		MC2S(1)
+		MC2S(2)
+		MC2S(3)
+		MC2S(4)
+		MC2S(5)
+		MC2S(6)
+		MC2S(7)
+
+		coef += 16;		/* skip the odd sample pair */
+		vb1 += 128;
+		*(pcm + 0)         = ClipToShort((int)SAR64(sum1L, (32-CSHIFT)), DEF_NFRACBITS);
+		*(pcm + 1)         = ClipToShort((int)SAR64(sum1R, (32-CSHIFT)), DEF_NFRACBITS);
+		*(pcm + 2*2*i + 0) = ClipToShort((int)SAR64(sum2L, (32-CSHIFT)), DEF_NFRACBITS);
+		*(pcm + 2*2*i + 1) = ClipToShort((int)SAR64(sum2R, (32-CSHIFT)), DEF_NFRACBITS);
+		pcm += 2;
+	}
+}
@@ -54,6 +54,7 @@
  *              vbuf[ch] and vindex[ch] must be preserved between calls
  *
  * Outputs:     decoded PCM data, interleaved LRLRLR... if stereo
+ *                (OutChans() channels, NBANDS/2 samples per block at half rate)
  *
  * Return:      0 on success,  -1 if null input pointers
  **************************************************************************************/
@@ -72,7 +73,20 @@ int Subband(MP3DecInfo *mp3DecInfo, short *pcmBuf)
 	mi = (IMDCTInfo *)(mp3DecInfo->IMDCTInfoPS);
 	sbi = (SubbandInfo*)(mp3DecInfo->SubbandInfoPS);
 
-	if (mp3DecInfo->nChans == 2) {
+	if (mp3DecInfo->decodeMode & MP3_DECODE_HALFRATE) {
+		/* half rate - every other output sample (upper subbands already zeroed in IMDCT) */
+		for (b = 0; b < BLOCK_SIZE; b++) {
+			FDCT32(mi->outBuf[0][b], sbi->vbuf + 0*32, sbi->vindex, (b & 0x01), mi->gb[0]);
+			if (OutChans(mp3DecInfo) == 2) {
+				FDCT32(mi->outBuf[1][b], sbi->vbuf + 1*32, sbi->vindex, (b & 0x01), mi->gb[1]);
+				PolyphaseStereoHalf(pcmBuf, sbi->vbuf + sbi->vindex + VBUF_LENGTH * (b & 0x01), polyCoef);
+			} else {
+				PolyphaseMonoHalf(pcmBuf, sbi->vbuf + sbi->vindex + VBUF_LENGTH * (b & 0x01), polyCoef);
+			}
+			sbi->vindex = (sbi->vindex - (b & 0x01)) & 7;
+			pcmBuf += OutChans(mp3DecInfo) * (NBANDS / 2);
+		}
+	} else if (OutChans(mp3DecInfo) == 2) {
 		/* stereo */
 		for (b = 0; b < BLOCK_SIZE; b++) {
 			FDCT32(mi->outBuf[0][b], sbi->vbuf + 0*32, sbi->vindex, (b & 0x01), mi->gb[0]);
@@ -82,7 +96,7 @@ int Subband(MP3DecInfo *mp3DecInfo, short *pcmBuf)
 			pcmBuf += (2 * NBANDS);
 		}
 	} else {
-		/* mono */
+		/* mono (or stereo folded to ch 0 by MP3_DECODE_MONO) */
 		for (b = 0; b < BLOCK_SIZE; b++) {
 			FDCT32(mi->outBuf[0][b], sbi->vbuf + 0*32, sbi->vindex, (b & 0x01), mi->gb[0]);
 			PolyphaseMono(pcmBuf, sbi->vbuf + sbi->vindex + VBUF_LENGTH * (b & 0x01), polyCoef);
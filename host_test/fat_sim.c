@@ -0,0 +1,498 @@
+#include "fat_sim.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SS FAT_SIM_SECTOR_SIZE
+#define FAT32_RESERVED 32
+#define FAT16_ROOT_SECTORS 32 // 512 entries
+#define FSINFO_SECTOR 1
+
+static uint32_t ld16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t ld32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void st16(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void st32(uint8_t *p, uint32_t v)
+{
+    st16(p, v);
+    st16(p + 2, v >> 16);
+}
+
+// === Card ===
+static void card_read(FatSim *fs, uint32_t sector, uint8_t *buf)
+{
+    memcpy(buf, fs->image + (size_t)sector * SS, SS);
+}
+
+static void card_write(FatSim *fs, uint32_t sector, const uint8_t *buf)
+{
+    uint32_t n = fs->writes++;
+    if (n == fs->log_cap)
+    {
+        fs->log_cap = fs->log_cap ? fs->log_cap * 2 : 1024;
+        fs->log = realloc(fs->log, fs->log_cap * sizeof(uint32_t));
+    }
+    fs->log[n] = sector;
+    if (n >= fs->cut_after || n == fs->drop_write)
+        return;
+    memcpy(fs->image + (size_t)sector * SS, buf, SS);
+}
+
+// === FATFS window ===
+static void sync_window(FatSim *fs)
+{
+    if (!fs->wflag)
+        return;
+    card_write(fs, fs->winsect, fs->win);
+    fs->wflag = false;
+    if (fs->winsect - fs->vol.fat_start < fs->fat_sectors)
+        card_write(fs, fs->winsect + fs->fat_sectors, fs->win); // Second FAT
+}
+
+static void move_window(FatSim *fs, uint32_t sector)
+{
+    if (sector == fs->winsect)
+        return;
+    sync_window(fs);
+    card_read(fs, sector, fs->win);
+    fs->winsect = sector;
+}
+
+static void fsinfo_build(uint8_t *p, uint32_t free_clst, uint32_t last_clst)
+{
+    memset(p, 0, SS);
+    st32(p, 0x41615252);
+    st32(p + 484, 0x61417272);
+    st32(p + 488, free_clst);
+    st32(p + 492, last_clst);
+    st16(p + 510, 0xAA55);
+}
+
+static void sync_fs(FatSim *fs)
+{
+    sync_window(fs);
+    if (fs->vol.fat_bits == 32 && fs->fsi_flag)
+    {
+        fsinfo_build(fs->win, fs->free_clst, fs->last_clst);
+        fs->winsect = FSINFO_SECTOR;
+        card_write(fs, fs->winsect, fs->win);
+        fs->fsi_flag = false;
+    }
+}
+
+static uint32_t get_fat(FatSim *fs, uint32_t clst)
+{
+    uint32_t bytes = fs->vol.fat_bits / 8;
+    move_window(fs, fs->vol.fat_start + clst * bytes / SS);
+    const uint8_t *p = fs->win + clst * bytes % SS;
+    return fs->vol.fat_bits == 32 ? ld32(p) & 0x0FFFFFFF : ld16(p);
+}
+
+static void put_fat(FatSim *fs, uint32_t clst, uint32_t value)
+{
+    uint32_t bytes = fs->vol.fat_bits / 8;
+    move_window(fs, fs->vol.fat_start + clst * bytes / SS);
+    uint8_t *p = fs->win + clst * bytes % SS;
+    if (fs->vol.fat_bits == 32)
+        st32(p, (value & 0x0FFFFFFF) | (ld32(p) & 0xF0000000));
+    else
+        st16(p, value);
+    fs->wflag = true;
+}
+
+// Stretch a chain by one cluster (clst 0: start a new one); 0 when full
+static uint32_t create_chain(FatSim *fs, uint32_t clst)
+{
+    uint32_t n_fatent = fs->vol.n_fatent;
+    uint32_t scl;
+    uint32_t ncl = 0;
+    if (clst == 0)
+    {
+        scl = fs->last_clst;
+        if (scl == 0 || scl >= n_fatent)
+            scl = 1;
+    }
+    else
+    {
+        uint32_t cs = get_fat(fs, clst);
+        if (cs >= 2 && cs < n_fatent)
+            return cs;
+        scl = clst;
+    }
+    if (fs->free_clst == 0)
+        return 0;
+
+    if (scl == clst)
+    {
+        // Try the cluster right after first
+        ncl = scl + 1 >= n_fatent ? 2 : scl + 1;
+        if (get_fat(fs, ncl) != 0)
+        {
+            if (fs->last_clst >= 2 && fs->last_clst < n_fatent)
+                scl = fs->last_clst;
+            ncl = 0;
+        }
+    }
+    if (ncl == 0)
+    {
+        ncl = scl;
+        for (;;)
+        {
+            ncl++;
+            if (ncl >= n_fatent)
+            {
+                ncl = 2;
+                if (ncl > scl)
+                    return 0;
+            }
+            if (get_fat(fs, ncl) == 0)
+                break;
+            if (ncl == scl)
+                return 0;
+        }
+    }
+
+    put_fat(fs, ncl, 0xFFFFFFFF);
+    if (clst != 0)
+        put_fat(fs, clst, ncl);
+    fs->last_clst = ncl;
+    if (fs->free_clst <= n_fatent - 2)
+        fs->free_clst--;
+    fs->fsi_flag = true;
+    return ncl;
+}
+
+static uint32_t clust2sect(const FatSim *fs, uint32_t clst)
+{
+    return fs->vol.data_start + (clst - 2) * fs->vol.cluster_sectors;
+}
+
+// i-th sector of the root directory, 0 past its end
+static uint32_t root_sector(const FatSim *fs, uint32_t i)
+{
+    if (fs->vol.fat_bits == 32)
+        return i < fs->vol.cluster_sectors ? clust2sect(fs, fs->root_cluster) + i : 0;
+    return i < fs->root_sectors ? fs->root_start + i : 0;
+}
+
+static void sfn(const char *name, uint8_t out[11])
+{
+    memset(out, ' ', 11);
+    const char *dot = strchr(name, '.');
+    size_t base = dot ? (size_t)(dot - name) : strlen(name);
+    memcpy(out, name, base > 8 ? 8 : base);
+    if (dot)
+        memcpy(out + 8, dot + 1, strlen(dot + 1) > 3 ? 3 : strlen(dot + 1));
+}
+
+// === Volume ===
+void fat_sim_format(FatSim *fs, int fat_bits, uint32_t sectors, uint32_t cluster_sectors)
+{
+    memset(fs, 0, sizeof(*fs));
+    fs->image = calloc(sectors, SS);
+    fs->sectors = sectors;
+    fs->vol.sector_size = SS;
+    fs->vol.cluster_sectors = cluster_sectors;
+    fs->vol.fat_bits = fat_bits;
+    fs->vol.fat_start = fat_bits == 32 ? FAT32_RESERVED : 1;
+    fs->root_sectors = fat_bits == 32 ? 0 : FAT16_ROOT_SECTORS;
+
+    // FAT size for the clusters left after the FATs themselves
+    uint32_t clusters = (sectors - fs->vol.fat_start - fs->root_sectors) / cluster_sectors;
+    fs->fat_sectors = ((clusters + 2) * (fat_bits / 8) + SS - 1) / SS;
+    fs->root_start = fs->vol.fat_start + 2 * fs->fat_sectors;
+    fs->vol.data_start = fs->root_start + fs->root_sectors;
+    clusters = (sectors - fs->vol.data_start) / cluster_sectors;
+    fs->vol.n_fatent = clusters + 2;
+
+    uint8_t *boot = fs->image;
+    st16(boot + 11, SS);
+    boot[13] = (uint8_t)cluster_sectors;
+    st16(boot + 14, fs->vol.fat_start);
+    boot[16] = 2;
+    st16(boot + 510, 0xAA55);
+
+    for (int copy = 0; copy < 2; copy++)
+    {
+        uint8_t *fat = fs->image + (size_t)(fs->vol.fat_start + copy * fs->fat_sectors) * SS;
+        if (fat_bits == 32)
+        {
+            st32(fat, 0x0FFFFFF8);
+            st32(fat + 4, 0x0FFFFFFF);
+            st32(fat + 8, 0x0FFFFFFF); // Root directory
+        }
+        else
+        {
+            st16(fat, 0xFFF8);
+            st16(fat + 2, 0xFFFF);
+        }
+    }
+    if (fat_bits == 32)
+    {
+        fs->root_cluster = 2;
+        fsinfo_build(fs->image + FSINFO_SECTOR * SS, clusters - 1, 2);
+    }
+    fat_sim_mount(fs);
+}
+
+void fat_sim_free(FatSim *fs)
+{
+    free(fs->image);
+    free(fs->log);
+    fs->image = NULL;
+    fs->log = NULL;
+}
+
+void fat_sim_mount(FatSim *fs)
+{
+    fs->winsect = 0;
+    fs->wflag = false;
+    fs->fsi_flag = false;
+    fs->writes = 0;
+    fs->cut_after = FAT_SIM_NO_WRITE;
+    fs->drop_write = FAT_SIM_NO_WRITE;
+    fs->last_clst = 0xFFFFFFFF;
+    fs->free_clst = 0xFFFFFFFF;
+    if (fs->vol.fat_bits == 32)
+    {
+        const uint8_t *fsi = fs->image + FSINFO_SECTOR * SS;
+        fs->free_clst = ld32(fsi + 488);
+        fs->last_clst = ld32(fsi + 492);
+    }
+}
+
+void fat_sim_restore(FatSim *fs, const uint8_t *image)
+{
+    for (uint32_t i = 0; i < fs->writes; i++)
+        memcpy(fs->image + (size_t)fs->log[i] * SS, image + (size_t)fs->log[i] * SS, SS);
+}
+
+// === Files ===
+bool fat_sim_create(FatSim *fs, FatSimFile *fp, const char *name)
+{
+    uint8_t n[11];
+    sfn(name, n);
+    for (uint32_t i = 0, s; (s = root_sector(fs, i)) != 0; i++)
+    {
+        move_window(fs, s);
+        for (uint32_t off = 0; off < SS; off += 32)
+        {
+            uint8_t *dir = fs->win + off;
+            if (dir[0] != 0x00 && dir[0] != 0xE5)
+                continue;
+            memset(dir, 0, 32);
+            memcpy(dir, n, 11);
+            dir[11] = 0x20;                 // AM_ARC
+            st32(dir + 14, 0x5A210000);     // Created
+            st32(dir + 22, 0x5A210000);     // Modified
+            fs->wflag = true;
+
+            memset(fp, 0, sizeof(*fp));
+            fp->fs = fs;
+            fp->dir_sect = s;
+            fp->dir_offset = off;
+            fp->modified = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool fat_sim_write(FatSimFile *fp, const uint8_t *data, uint32_t len)
+{
+    FatSim *fs = fp->fs;
+    uint32_t csize = fs->vol.cluster_sectors;
+    while (len > 0)
+    {
+        uint32_t n;
+        if (fp->fptr % SS == 0)
+        {
+            uint32_t csect = fp->fptr / SS & (csize - 1);
+            if (csect == 0)
+            {
+                uint32_t clst = fp->fptr == 0 ? fp->sclust : 0;
+                if (clst == 0)
+                    clst = create_chain(fs, fp->fptr == 0 ? 0 : fp->clust);
+                if (clst == 0)
+                    return false;
+                fp->clust = clst;
+                if (fp->sclust == 0)
+                    fp->sclust = clst;
+            }
+            if (fp->dirty)
+            {
+                card_write(fs, fp->sect, fp->buf);
+                fp->dirty = false;
+            }
+            uint32_t sect = clust2sect(fs, fp->clust) + csect;
+            uint32_t cc = len / SS;
+            if (cc > 0)
+            {
+                // Whole sectors go straight to the card, up to the end of the cluster
+                if (csect + cc > csize)
+                    cc = csize - csect;
+                for (uint32_t i = 0; i < cc; i++)
+                    card_write(fs, sect + i, data + i * SS);
+                if (fp->sect - sect < cc)
+                {
+                    memcpy(fp->buf, data + (fp->sect - sect) * SS, SS);
+                    fp->dirty = false;
+                }
+                n = cc * SS;
+                goto next;
+            }
+            if (fp->sect != sect && fp->fptr < fp->objsize)
+                card_read(fs, sect, fp->buf);
+            fp->sect = sect;
+        }
+        n = SS - fp->fptr % SS;
+        if (n > len)
+            n = len;
+        memcpy(fp->buf + fp->fptr % SS, data, n);
+        fp->dirty = true;
+    next:
+        data += n;
+        len -= n;
+        fp->fptr += n;
+        if (fp->fptr > fp->objsize)
+            fp->objsize = fp->fptr;
+    }
+    fp->modified = true;
+    return true;
+}
+
+void fat_sim_sync(FatSimFile *fp)
+{
+    FatSim *fs = fp->fs;
+    if (!fp->modified)
+        return;
+    if (fp->dirty)
+    {
+        card_write(fs, fp->sect, fp->buf);
+        fp->dirty = false;
+    }
+    move_window(fs, fp->dir_sect);
+    uint8_t *dir = fs->win + fp->dir_offset;
+    dir[11] |= 0x20;
+    st16(dir + 26, fp->sclust);
+    if (fs->vol.fat_bits == 32)
+        st16(dir + 20, fp->sclust >> 16);
+    st32(dir + 28, fp->objsize);
+    st32(dir + 22, 0x5A218000);
+    st16(dir + 18, 0);
+    fs->wflag = true;
+    sync_fs(fs);
+    fp->modified = false;
+}
+
+bool fat_sim_unlink(FatSim *fs, const char *name)
+{
+    uint8_t n[11];
+    sfn(name, n);
+    for (uint32_t i = 0, s; (s = root_sector(fs, i)) != 0; i++)
+    {
+        move_window(fs, s);
+        for (uint32_t off = 0; off < SS; off += 32)
+        {
+            uint8_t *dir = fs->win + off;
+            if (dir[0] == 0x00)
+                return false;
+            if (dir[0] == 0xE5 || memcmp(dir, n, 11) != 0)
+                continue;
+            uint32_t clst = ld16(dir + 26) | (fs->vol.fat_bits == 32 ? ld16(dir + 20) << 16 : 0);
+            dir[0] = 0xE5;
+            fs->wflag = true;
+            while (clst >= 2 && clst < fs->vol.n_fatent)
+            {
+                uint32_t next = get_fat(fs, clst);
+                put_fat(fs, clst, 0);
+                if (fs->free_clst < fs->vol.n_fatent - 2)
+                    fs->free_clst++;
+                fs->fsi_flag = true;
+                clst = next;
+            }
+            sync_fs(fs);
+            return true;
+        }
+    }
+    return false;
+}
+
+// === Mount view ===
+uint32_t fat_sim_entry(const FatSim *fs, uint32_t clst)
+{
+    uint32_t bytes = fs->vol.fat_bits / 8;
+    const uint8_t *p = fs->image + (size_t)fs->vol.fat_start * SS + (size_t)clst * bytes;
+    return fs->vol.fat_bits == 32 ? ld32(p) & 0x0FFFFFFF : ld16(p);
+}
+
+bool fat_sim_find(const FatSim *fs, const char *name, uint32_t *dir_sect, uint32_t *dir_offset,
+                  uint32_t *first_cluster, uint32_t *size)
+{
+    uint8_t n[11];
+    sfn(name, n);
+    for (uint32_t i = 0, s; (s = root_sector(fs, i)) != 0; i++)
+    {
+        for (uint32_t off = 0; off < SS; off += 32)
+        {
+            const uint8_t *dir = fs->image + (size_t)s * SS + off;
+            if (dir[0] == 0x00)
+                return false;
+            if (dir[0] == 0xE5 || memcmp(dir, n, 11) != 0)
+                continue;
+            *dir_sect = s;
+            *dir_offset = off;
+            *first_cluster = ld16(dir + 26) | (fs->vol.fat_bits == 32 ? ld16(dir + 20) << 16 : 0);
+            *size = ld32(dir + 28);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool fat_sim_read(const FatSim *fs, uint32_t first_cluster, uint32_t size, uint8_t *out, uint8_t *owner,
+                  uint8_t owner_id)
+{
+    if (size == 0)
+        return first_cluster == 0;
+    uint32_t cluster_bytes = SS * fs->vol.cluster_sectors;
+    uint32_t need = (size + cluster_bytes - 1) / cluster_bytes;
+    uint32_t eoc = fs->vol.fat_bits == 32 ? 0x0FFFFFF8 : 0xFFF8;
+    uint32_t clst = first_cluster;
+    for (uint32_t i = 0; i < need; i++)
+    {
+        if (clst < 2 || clst >= fs->vol.n_fatent)
+            return false;
+        if (owner)
+        {
+            if (owner[clst] != 0 && owner[clst] != owner_id)
+                return false; // Cross-linked with another file
+            owner[clst] = owner_id;
+        }
+        uint32_t n = size - i * cluster_bytes < cluster_bytes ? size - i * cluster_bytes : cluster_bytes;
+        memcpy(out + (size_t)i * cluster_bytes, fs->image + (size_t)clust2sect(fs, clst) * SS, n);
+        clst = fat_sim_entry(fs, clst);
+    }
+    return clst >= eoc;
+}
+
+bool fat_sim_read_sector(void *ctx, uint32_t sector, uint8_t *buf)
+{
+    FatSim *fs = ctx;
+    if (sector >= fs->sectors)
+        return false;
+    memcpy(buf, fs->image + (size_t)sector * SS, SS);
+    return true;
+}
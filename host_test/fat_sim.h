@@ -0,0 +1,86 @@
+// A FAT16/FAT32 image in memory, written in the order FATFS (R0.15, FF_FS_TINY
+// 0, no fast seek on writes) puts sectors on the card: one sector window for
+// the FAT and directories, flushed with its FAT mirror when it moves; file data
+// straight to the card in whole sectors, the partial sector through the file's
+// own buffer; the directory entry and FSInfo only in f_sync. The card can lose
+// power after any sector write, or drop a single write. 8.3 names in the root
+// directory only: enough for the upload path's unlink, fopen "wb", write,
+// fsync and fclose.
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fat_verify.h"
+
+#define FAT_SIM_SECTOR_SIZE 512
+#define FAT_SIM_NO_WRITE UINT32_MAX
+
+typedef struct
+{
+    uint8_t *image;
+    uint32_t sectors;
+    FatVolume vol;
+    uint32_t fat_sectors;   // Per FAT copy; there are two
+    uint32_t root_start;    // FAT16: fixed root directory area
+    uint32_t root_sectors;
+    uint32_t root_cluster;  // FAT32: root directory cluster (one cluster)
+
+    // Card faults
+    uint32_t writes;        // Sector writes issued so far
+    uint32_t cut_after;     // Power lost after this many writes (FAT_SIM_NO_WRITE: never)
+    uint32_t drop_write;    // This single write is acknowledged but lost
+    uint32_t *log;          // Sector of every write issued since the mount
+    uint32_t log_cap;
+
+    // FATFS volume state
+    uint8_t win[FAT_SIM_SECTOR_SIZE];
+    uint32_t winsect;       // 0 = nothing in the window
+    bool wflag;
+    bool fsi_flag;
+    uint32_t last_clst;
+    uint32_t free_clst;
+} FatSim;
+
+typedef struct
+{
+    FatSim *fs;
+    uint32_t sclust;
+    uint32_t clust;
+    uint32_t fptr;
+    uint32_t objsize;
+    uint32_t sect;          // Sector in buf
+    bool dirty;
+    bool modified;
+    uint32_t dir_sect;
+    uint32_t dir_offset;
+    uint8_t buf[FAT_SIM_SECTOR_SIZE];
+} FatSimFile;
+
+// mkfs straight into the image (not through the card), then a mount
+void fat_sim_format(FatSim *fs, int fat_bits, uint32_t sectors, uint32_t cluster_sectors);
+void fat_sim_free(FatSim *fs);
+
+// Remount: forget the window and the allocation hints, keep the image
+void fat_sim_mount(FatSim *fs);
+
+// Put back every sector written since the mount from a copy of the image
+void fat_sim_restore(FatSim *fs, const uint8_t *image);
+
+// f_open(FA_WRITE | FA_CREATE_ALWAYS) of a name that does not exist
+bool fat_sim_create(FatSim *fs, FatSimFile *fp, const char *name);
+bool fat_sim_write(FatSimFile *fp, const uint8_t *data, uint32_t len);
+void fat_sim_sync(FatSimFile *fp);
+bool fat_sim_unlink(FatSim *fs, const char *name);
+
+// The image as a mount would find it: the entry of name, and its bytes read
+// along the FAT chain. fat_sim_read fails on a chain that is short, runs
+// through a free or bad cluster, or does not end right after the last cluster.
+bool fat_sim_find(const FatSim *fs, const char *name, uint32_t *dir_sect, uint32_t *dir_offset,
+                  uint32_t *first_cluster, uint32_t *size);
+bool fat_sim_read(const FatSim *fs, uint32_t first_cluster, uint32_t size, uint8_t *out, uint8_t *owner,
+                  uint8_t owner_id);
+uint32_t fat_sim_entry(const FatSim *fs, uint32_t clst);
+
+// FatSectorRead over the image
+bool fat_sim_read_sector(void *ctx, uint32_t sector, uint8_t *buf);
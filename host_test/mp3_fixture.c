@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mp3_fixture.h"
+
+static const uint16_t bitrates_kbps[2][15] = {
+    {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+};
+
+static const uint16_t sample_rates[3][3] = {
+    {44100, 48000, 32000},
+    {22050, 24000, 16000},
+    {11025, 12000, 8000},
+};
+
+uint32_t fixture_rand(uint32_t *rng)
+{
+    // xorshift32
+    uint32_t x = *rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *rng = x;
+}
+
+void fixture_append(FixtureStream *s, const void *p, size_t n)
+{
+    if (s->len + n > s->cap)
+    {
+        s->cap = (s->len + n) * 2 + 4096;
+        s->data = realloc(s->data, s->cap);
+        if (!s->data)
+        {
+            fprintf(stderr, "fixture: out of memory\n");
+            exit(2);
+        }
+    }
+    if (p)
+        memcpy(s->data + s->len, p, n);
+    else
+        memset(s->data + s->len, 0, n);
+    s->len += n;
+}
+
+void fixture_append_random(FixtureStream *s, size_t n, uint32_t *rng)
+{
+    size_t at = s->len;
+    fixture_append(s, NULL, n);
+    for (size_t i = 0; i < n; i++)
+        s->data[at + i] = (uint8_t)fixture_rand(rng);
+}
+
+void fixture_free(FixtureStream *s)
+{
+    free(s->data);
+    memset(s, 0, sizeof(*s));
+}
+
+int fixture_sample_rate(const FixtureFormat *f)
+{
+    return sample_rates[f->version][f->samprate_idx];
+}
+
+int fixture_samples_per_frame(const FixtureFormat *f)
+{
+    return f->version ? 576 : 1152;
+}
+
+size_t fixture_frame_bytes(const FixtureFormat *f, int bitrate_idx, int padding)
+{
+    int kbps = bitrates_kbps[f->version ? 1 : 0][bitrate_idx];
+    return (f->version ? 72 : 144) * kbps * 1000 / fixture_sample_rate(f) + padding;
+}
+
+typedef struct
+{
+    uint8_t *p;
+    size_t bit;
+} BitWriter;
+
+static void put_bits(BitWriter *w, uint32_t v, int n)
+{
+    while (n-- > 0)
+    {
+        if ((v >> n) & 1)
+            w->p[w->bit >> 3] |= 0x80 >> (w->bit & 7);
+        w->bit++;
+    }
+}
+
+size_t fixture_frame(FixtureStream *s, const FixtureFormat *f, int bitrate_idx, int padding, bool noise,
+                     uint32_t *rng)
+{
+    static const int version_bits[3] = {3, 2, 0};
+    size_t at = s->len;
+    size_t bytes = fixture_frame_bytes(f, bitrate_idx, padding);
+    fixture_append(s, NULL, bytes);
+    uint8_t *p = s->data + at;
+
+    p[0] = 0xFF;
+    p[1] = 0xE0 | version_bits[f->version] << 3 | 1 << 1 | 1; // Layer III, no CRC
+    p[2] = bitrate_idx << 4 | f->samprate_idx << 2 | padding << 1;
+    p[3] = (f->channels == 1 ? 3 : 0) << 6 | 1 << 2; // Stereo or mono, original
+
+    bool lsf = f->version != 0;
+    int granules = lsf ? 1 : 2;
+    size_t side_bytes = lsf ? (f->channels == 1 ? 9 : 17) : (f->channels == 1 ? 17 : 32);
+    size_t main_bits = (bytes - 4 - side_bytes) * 8;
+
+    // Count1 noise only (big_values 0, table B): any bit string is valid Huffman
+    // data, so every frame decodes. Capped well below 576 coefficients.
+    int part23 = noise ? (int)(main_bits / (granules * f->channels)) : 0;
+    if (part23 > 480)
+        part23 = 480;
+    int gain = noise ? 150 + fixture_rand(rng) % 30 : 0;
+
+    BitWriter w = {p + 4, 0};
+    put_bits(&w, 0, lsf ? 8 : 9);                             // main_data_begin
+    put_bits(&w, 0, lsf ? f->channels : (f->channels == 1 ? 5 : 3)); // private bits
+    if (!lsf)
+        put_bits(&w, 0, 4 * f->channels); // scfsi
+    for (int gr = 0; gr < granules; gr++)
+    {
+        for (int ch = 0; ch < f->channels; ch++)
+        {
+            put_bits(&w, part23, 12);
+            put_bits(&w, 0, 9);           // big_values
+            put_bits(&w, gain, 8);        // global_gain
+            put_bits(&w, 0, lsf ? 9 : 4); // scalefac_compress: no scalefactor bits
+            put_bits(&w, 0, 1);           // window_switching_flag
+            put_bits(&w, 0, 15);          // table_select[3]
+            put_bits(&w, 0, 7);           // region0_count, region1_count
+            if (!lsf)
+                put_bits(&w, 0, 1); // preflag
+            put_bits(&w, 0, 1);     // scalefac_scale
+            put_bits(&w, 1, 1);     // count1table_select: table B
+        }
+    }
+
+    uint8_t *main_data = p + 4 + side_bytes;
+    size_t main_used = (size_t)part23 * granules * f->channels;
+    for (size_t i = 0; i < (main_used + 7) / 8; i++)
+        main_data[i] = (uint8_t)fixture_rand(rng);
+    return at;
+}
+
+void fixture_frames(FixtureStream *s, const FixtureFormat *f, int bitrate_idx, int n, bool noise, uint32_t *rng)
+{
+    int rate = fixture_sample_rate(f);
+    int rest = 0;
+    for (int i = 0; i < n; i++)
+    {
+        int idx = bitrate_idx ? bitrate_idx : 1 + (int)(fixture_rand(rng) % 14);
+        int padding;
+        if (bitrate_idx)
+        {
+            // Pad whenever the fractional frame length adds up to a byte
+            int kbps = bitrates_kbps[f->version ? 1 : 0][idx];
+            rest += (f->version ? 72 : 144) * kbps * 1000 % rate;
+            padding = rest >= rate;
+            if (padding)
+                rest -= rate;
+        }
+        else
+        {
+            padding = fixture_rand(rng) & 1;
+        }
+        fixture_frame(s, f, idx, padding, noise, rng);
+    }
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+size_t fixture_xing(FixtureStream *s, const FixtureFormat *f, int bitrate_idx, const char *tag, uint32_t frames,
+                    uint32_t bytes)
+{
+    size_t at = fixture_frame(s, f, bitrate_idx, 0, false, NULL);
+    uint8_t *p = s->data + at + 4 + (f->version ? (f->channels == 1 ? 9 : 17) : (f->channels == 1 ? 17 : 32));
+    memcpy(p, tag, 4);
+    put_be32(p + 4, 0x3); // Frames and bytes fields present
+    put_be32(p + 8, frames);
+    put_be32(p + 12, bytes);
+    return at;
+}
+
+size_t fixture_lame(FixtureStream *s, const FixtureFormat *f, int bitrate_idx, uint32_t frames, uint16_t delay,
+                    uint16_t padding)
+{
+    size_t at = fixture_xing(s, f, bitrate_idx, "Info", frames, 0);
+    uint8_t *q = s->data + at + 4 + (f->version ? (f->channels == 1 ? 9 : 17) : (f->channels == 1 ? 17 : 32)) + 16;
+    memcpy(q, "LAME3.100", 9);
+    q[21] = delay >> 4;
+    q[22] = (uint8_t)((delay & 0x0F) << 4 | padding >> 8);
+    q[23] = padding & 0xFF;
+    return at;
+}
+
+static void put_syncsafe(uint8_t *p, uint32_t v)
+{
+    p[0] = (v >> 21) & 0x7F;
+    p[1] = (v >> 14) & 0x7F;
+    p[2] = (v >> 7) & 0x7F;
+    p[3] = v & 0x7F;
+}
+
+void fixture_id3v2(FixtureStream *s, uint32_t body_bytes, bool footer, uint32_t *rng)
+{
+    uint8_t hdr[10] = {'I', 'D', '3', 4, 0, footer ? 0x10 : 0};
+    put_syncsafe(hdr + 6, body_bytes);
+    fixture_append(s, hdr, sizeof(hdr));
+
+    size_t at = s->len;
+    fixture_append_random(s, body_bytes, rng);
+    for (size_t i = 0; i + 4 <= body_bytes; i += 97)
+    {
+        // Header-shaped bytes, as found in embedded cover art
+        s->data[at + i] = 0xFF;
+        s->data[at + i + 1] = 0xFB;
+    }
+    if (footer)
+    {
+        hdr[0] = '3';
+        hdr[1] = 'D';
+        hdr[2] = 'I';
+        fixture_append(s, hdr, sizeof(hdr));
+    }
+}
+
+void fixture_id3v1(FixtureStream *s)
+{
+    uint8_t tag[128] = {'T', 'A', 'G'};
+    memcpy(tag + 3, "Fixture title", 13);
+    tag[127] = 12; // Genre
+    fixture_append(s, tag, sizeof(tag));
+}
+
+static void apev2_header(uint8_t *p, uint32_t tag_size, uint32_t flags)
+{
+    memcpy(p, "APETAGEX", 8);
+    uint32_t fields[4] = {2000, tag_size, 1, flags};
+    for (int i = 0; i < 4; i++)
+        for (int b = 0; b < 4; b++)
+            p[8 + i * 4 + b] = (uint8_t)(fields[i] >> (8 * b)); // Little-endian
+    memset(p + 24, 0, 8);
+}
+
+void fixture_apev2(FixtureStream *s, uint32_t item_bytes, const FixtureFormat *f)
+{
+    uint8_t block[32];
+    uint32_t item_total = 8 + 6 + item_bytes; // Size, flags, "Cover\0", value
+    uint32_t tag_size = item_total + 32;      // Items + footer
+
+    apev2_header(block, tag_size, 0xA0000000u); // Has header, this is the header
+    fixture_append(s, block, sizeof(block));
+
+    uint8_t item[8] = {0};
+    for (int b = 0; b < 4; b++)
+        item[b] = (uint8_t)(item_bytes >> (8 * b));
+    item[4] = 2; // Binary
+    fixture_append(s, item, sizeof(item));
+    fixture_append(s, "Cover", 6);
+    size_t at = s->len;
+    fixture_append(s, NULL, item_bytes);
+
+    // Two headers of the stream's own format, one frame apart
+    FixtureStream frame = {0};
+    fixture_frame(&frame, f, 9, 0, false, NULL);
+    if (item_bytes >= frame.len + 4)
+    {
+        memcpy(s->data + at, frame.data, 4);
+        memcpy(s->data + at + frame.len, frame.data, 4);
+    }
+    fixture_free(&frame);
+
+    apev2_header(block, tag_size, 0x80000000u); // Has header, this is the footer
+    fixture_append(s, block, sizeof(block));
+}
@@ -0,0 +1,59 @@
+// Synthetic MP3 streams for the host tests: no encoder and no sample files
+// needed. Frames are real Layer III frames that helix decodes (main_data_begin
+// 0, so each frame stands alone), either silent or filled with count1 noise.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} FixtureStream;
+
+typedef struct
+{
+    int version;      // 0 = MPEG1, 1 = MPEG2, 2 = MPEG2.5
+    int samprate_idx; // 0..2
+    int channels;     // 1 or 2
+} FixtureFormat;
+
+uint32_t fixture_rand(uint32_t *rng);
+
+void fixture_append(FixtureStream *s, const void *p, size_t n);
+void fixture_append_random(FixtureStream *s, size_t n, uint32_t *rng);
+void fixture_free(FixtureStream *s);
+
+int fixture_sample_rate(const FixtureFormat *f);
+int fixture_samples_per_frame(const FixtureFormat *f);
+size_t fixture_frame_bytes(const FixtureFormat *f, int bitrate_idx, int padding);
+
+// Append one frame; returns its stream offset. noise: random count1 data with a
+// random global gain, otherwise digital silence.
+size_t fixture_frame(FixtureStream *s, const FixtureFormat *f, int bitrate_idx, int padding, bool noise,
+                     uint32_t *rng);
+
+// Append n frames at a constant bitrate with the encoder's padding pattern, or
+// at random bitrates (bitrate_idx 0) with random padding
+void fixture_frames(FixtureStream *s, const FixtureFormat *f, int bitrate_idx, int n, bool noise, uint32_t *rng);
+
+// Append a silent frame carrying a Xing ("Xing" or "Info") header with the
+// frame and byte counts; returns its stream offset
+size_t fixture_xing(FixtureStream *s, const FixtureFormat *f, int bitrate_idx, const char *tag, uint32_t frames,
+                    uint32_t bytes);
+
+// Append an "Info" frame like fixture_xing() followed by a LAME tag with the
+// encoder delay and padding (the gapless trim); returns its stream offset
+size_t fixture_lame(FixtureStream *s, const FixtureFormat *f, int bitrate_idx, uint32_t frames, uint16_t delay,
+                    uint16_t padding);
+
+// Append an ID3v2.4 tag with body_bytes of random payload (including 0xFF 0xFx
+// pairs that look like sync words)
+void fixture_id3v2(FixtureStream *s, uint32_t body_bytes, bool footer, uint32_t *rng);
+void fixture_id3v1(FixtureStream *s);
+// APEv2 tag (header, one item of item_bytes, footer); the item value holds a
+// pair of f's frame headers one frame apart, a false sync that confirms
+void fixture_apev2(FixtureStream *s, uint32_t item_bytes, const FixtureFormat *f);
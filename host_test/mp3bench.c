@@ -0,0 +1,116 @@
+// Host build of the firmware decode benchmark (CONFIG_MP3_PLAYER_DECODE_BENCHMARK):
+// the same mp3_bench.c over files on the host, printing the same JSON lines, so
+// a decoder change can be measured before it is flashed.
+//
+//   make -C host_test mp3bench
+//   host_test/build/mp3bench [-n frames] [-m cpu_mhz] file.mp3|dir ...
+//
+// Helix profiles in nanoseconds on the host; -m converts them to cycles of a
+// CPU at that clock (default 1000, so cycles_per_frame reads as ns). Compare
+// host numbers with host numbers: cycle counts of the ESP32-C3 only come
+// from the device. The SD read/seek, heap and playlist benchmarks need the
+// card and FATFS and stay on the device.
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mp3_bench.h"
+#include "mp3dec.h"
+
+#define BENCH_BUF_SIZE (16 * 1024) // MP3_BUF_SIZE_PLAYING
+
+static int64_t host_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t host_random(void)
+{
+    static uint32_t x = 0x9E3779B9u; // Fixed seed: runs corrupt the same bursts
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+static void bench_path(const Mp3BenchContext *ctx, const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        printf("{\"file\":\"%s\",\"error\":\"open\"}\n", path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode))
+    {
+        const char *name = strrchr(path, '/');
+        mp3_bench_file(ctx, path, name ? name + 1 : path);
+        return;
+    }
+
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    char file[4096];
+    while (dir && (entry = readdir(dir)) != NULL)
+    {
+        const char *ext = strrchr(entry->d_name, '.');
+        if (!ext || strcasecmp(ext, ".mp3") != 0)
+            continue;
+        snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        mp3_bench_file(ctx, file, entry->d_name);
+    }
+    if (dir)
+        closedir(dir);
+}
+
+int main(int argc, char **argv)
+{
+    int frames = 1000; // CONFIG_MP3_PLAYER_BENCHMARK_FRAMES default
+    int cpu_mhz = 1000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:m:")) != -1)
+    {
+        if (opt == 'n')
+            frames = atoi(optarg);
+        else if (opt == 'm')
+            cpu_mhz = atoi(optarg);
+        else
+            break;
+    }
+    if (optind >= argc || frames < 1 || cpu_mhz < 1)
+    {
+        fprintf(stderr, "usage: %s [-n frames] [-m cpu_mhz] file.mp3|dir ...\n", argv[0]);
+        return 2;
+    }
+
+    static short pcm[MAX_NCHAN * MAX_NGRAN * MAX_NSAMP];
+    static uint8_t buf[BENCH_BUF_SIZE], map[BENCH_BUF_SIZE];
+    Mp3BenchContext ctx = {
+        .arena = aligned_alloc(16, (MP3GetDecoderArenaSize() + 15) & ~15),
+        .buf = buf,
+        .map = map,
+        .buf_size = BENCH_BUF_SIZE,
+        .pcm = pcm,
+        .frames = frames,
+        .cpu_mhz = cpu_mhz,
+        .cycles_per_tick = cpu_mhz / 1000.0,
+        .now_ns = host_now_ns,
+        .random = host_random,
+    };
+
+    for (int i = optind; i < argc; i++)
+    {
+        printf("{\"benchmark\":\"helix_decode\",\"dir\":\"%s\",\"frames_per_file\":%d}\n", argv[i], frames);
+        bench_path(&ctx, argv[i]);
+    }
+    printf("{\"benchmark\":\"done\"}\n");
+    free(ctx.arena);
+    return 0;
+}
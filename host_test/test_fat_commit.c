@@ -0,0 +1,274 @@
+// Power cuts during an upload commit, on a FAT image written in FATFS's sector
+// order (fat_sim.c). The upload path replaces a track the way upload_handler()
+// does: unlink, fopen "wb", 8 KB writes from the writer task, fsync, fclose,
+// with no remount after it. For a cut after every sector write (or a random
+// sample of them on long runs):
+//
+//  - a mount finds the old track, no track, an empty one or the whole new one:
+//    never a size without its data or a chain into another file's clusters;
+//  - the other file on the card is untouched;
+//  - fat_verify_file(), the upload handler's read-back, passes exactly when
+//    the mount finds the whole new track.
+//
+// Then each write is dropped alone (a card that acknowledges a write it never
+// made): the read-back must fail whenever the entry, the chain or the last
+// sector did not make it. A lost sector in the middle of the data is outside
+// what it reads and is only counted.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fat_sim.h"
+#include "fat_verify.h"
+
+#define UPLOAD_HALF_SIZE 8192 // As in main.c: the writer task's unit
+#define MAX_CUTS 3000         // Cut points tried per case beyond the last 64 writes
+
+typedef struct
+{
+    const char *name;
+    int fat_bits;
+    uint32_t sectors;
+    uint32_t cluster_sectors;
+    uint32_t size;     // New track
+    uint32_t old_size; // Track it replaces
+} Case;
+
+typedef enum
+{
+    STATE_OLD,
+    STATE_ABSENT,
+    STATE_EMPTY,
+    STATE_NEW,
+    STATE_TORN,
+    STATE_COUNT
+} TrackState;
+
+static const char *const state_names[STATE_COUNT] = {"old", "absent", "empty", "new", "torn"};
+
+typedef struct
+{
+    uint32_t dir_sect;
+    uint32_t dir_offset;
+    uint32_t first_cluster;
+} Commit;
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                                                               \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            failures++;                                                                                                \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+            printf(__VA_ARGS__);                                                                                       \
+            printf("\n");                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+static uint32_t rand32(uint32_t *rng)
+{
+    *rng ^= *rng << 13;
+    *rng ^= *rng >> 17;
+    *rng ^= *rng << 5;
+    return *rng;
+}
+
+static uint8_t *random_bytes(uint32_t n, uint32_t *rng)
+{
+    uint8_t *p = malloc(n + 1);
+    for (uint32_t i = 0; i < n; i++)
+        p[i] = (uint8_t)rand32(rng);
+    return p;
+}
+
+static void write_file(FatSim *fs, const char *name, const uint8_t *data, uint32_t size, FatSimFile *fp)
+{
+    fat_sim_create(fs, fp, name);
+    fat_sim_write(fp, data, size);
+    fat_sim_sync(fp);
+}
+
+// upload_handler(): unlink, fopen "wb", the writer's halves, fsync, fclose
+static void upload(FatSim *fs, const uint8_t *data, uint32_t size, Commit *commit)
+{
+    FatSimFile fp;
+    fat_sim_unlink(fs, "SONG.MP3");
+    fat_sim_create(fs, &fp, "SONG.MP3");
+    for (uint32_t pos = 0; pos < size; pos += UPLOAD_HALF_SIZE)
+        fat_sim_write(&fp, data + pos, size - pos < UPLOAD_HALF_SIZE ? size - pos : UPLOAD_HALF_SIZE);
+    fat_sim_sync(&fp); // fsync()
+    fat_sim_sync(&fp); // fclose(): nothing left to write
+    commit->dir_sect = fp.dir_sect;
+    commit->dir_offset = fp.dir_offset;
+    commit->first_cluster = fp.sclust;
+}
+
+// The upload handler's read-back, with the tail it still has in its buffer
+static FatVerifyResult verify(FatSim *fs, const Commit *c, const uint8_t *data, uint32_t size)
+{
+    uint8_t sector[FAT_SIM_SECTOR_SIZE];
+    uint32_t tail_len = size % UPLOAD_HALF_SIZE ? size % UPLOAD_HALF_SIZE : (size ? UPLOAD_HALF_SIZE : 0);
+    return fat_verify_file(&fs->vol, fat_sim_read_sector, fs, c->dir_sect, c->dir_offset, c->first_cluster, size,
+                           data + size - tail_len, tail_len, sector);
+}
+
+// What a mount finds for SONG.MP3; the keep file must be intact either way.
+// lost: allocated clusters no file owns (a leak, not damage).
+static TrackState mount_state(const FatSim *fs, const Case *c, const uint8_t *keep, uint32_t keep_size,
+                              const uint8_t *old, const uint8_t *data, uint8_t *scratch, uint32_t *lost,
+                              bool *last_sector_ok)
+{
+    uint8_t *owner = calloc(fs->vol.n_fatent, 1);
+    uint32_t sect, off, first, size;
+    TrackState state = STATE_TORN;
+    *last_sector_ok = false;
+
+    bool keep_ok = fat_sim_find(fs, "KEEP.MP3", &sect, &off, &first, &size) && size == keep_size &&
+                   fat_sim_read(fs, first, size, scratch, owner, 1) && memcmp(scratch, keep, size) == 0;
+    CHECK(keep_ok, "%s: the other file on the card is damaged", c->name);
+
+    if (!fat_sim_find(fs, "SONG.MP3", &sect, &off, &first, &size))
+    {
+        state = STATE_ABSENT;
+    }
+    else if (size == 0 && first == 0)
+    {
+        state = STATE_EMPTY;
+    }
+    else if (fat_sim_read(fs, first, size, scratch, owner, 2))
+    {
+        if (size == c->old_size && memcmp(scratch, old, size) == 0)
+            state = STATE_OLD;
+        else if (size == c->size && memcmp(scratch, data, size) == 0)
+            state = STATE_NEW;
+        *last_sector_ok = size == c->size && memcmp(scratch + (size - 1) / FAT_SIM_SECTOR_SIZE * FAT_SIM_SECTOR_SIZE,
+                                                    data + (size - 1) / FAT_SIM_SECTOR_SIZE * FAT_SIM_SECTOR_SIZE,
+                                                    (size - 1) % FAT_SIM_SECTOR_SIZE + 1) == 0;
+    }
+    if (c->size == 0 && state == STATE_EMPTY)
+        state = STATE_NEW;
+
+    *lost = 0;
+    for (uint32_t clst = 2; clst < fs->vol.n_fatent; clst++)
+    {
+        if (fat_sim_entry(fs, clst) != 0 && owner[clst] == 0 && clst != fs->root_cluster)
+            (*lost)++;
+    }
+    free(owner);
+    return state;
+}
+
+static void run_case(const Case *c, uint32_t *rng)
+{
+    uint32_t keep_size = 50000 + rand32(rng) % 20000;
+    uint8_t *keep = random_bytes(keep_size, rng);
+    uint8_t *old = random_bytes(c->old_size, rng);
+    uint8_t *data = random_bytes(c->size, rng);
+    uint8_t *scratch = malloc(c->size + c->old_size + keep_size + 1);
+
+    // The card before the upload: another track and the one being replaced
+    FatSim fs;
+    FatSimFile fp;
+    fat_sim_format(&fs, c->fat_bits, c->sectors, c->cluster_sectors);
+    write_file(&fs, "KEEP.MP3", keep, keep_size, &fp);
+    write_file(&fs, "SONG.MP3", old, c->old_size, &fp);
+    uint8_t *before = malloc((size_t)fs.sectors * FAT_SIM_SECTOR_SIZE);
+    memcpy(before, fs.image, (size_t)fs.sectors * FAT_SIM_SECTOR_SIZE);
+
+    // Uninterrupted: the commit the upload handler checks
+    Commit commit;
+    fat_sim_mount(&fs);
+    upload(&fs, data, c->size, &commit);
+    uint32_t writes = fs.writes;
+    FatVerifyResult r = verify(&fs, &commit, data, c->size);
+    CHECK(r == FAT_VERIFY_OK, "%s: read-back of a clean upload: %s", c->name, fat_verify_result_name(r));
+    fat_sim_restore(&fs, before);
+
+    // Power cut after k writes
+    int states[STATE_COUNT] = {0};
+    uint32_t max_lost = 0;
+    uint32_t cuts = 0;
+    for (uint32_t k = 0; k <= writes; k++)
+    {
+        if (writes > MAX_CUTS && k + 64 < writes && rand32(rng) % writes >= MAX_CUTS)
+            continue;
+        fat_sim_restore(&fs, before);
+        fat_sim_mount(&fs);
+        fs.cut_after = k;
+        Commit cut;
+        upload(&fs, data, c->size, &cut);
+
+        uint32_t lost;
+        bool last_ok;
+        TrackState st = mount_state(&fs, c, keep, keep_size, old, data, scratch, &lost, &last_ok);
+        states[st]++;
+        cuts++;
+        max_lost = lost > max_lost ? lost : max_lost;
+        CHECK(st != STATE_TORN, "%s: cut after write %u of %u leaves a torn track", c->name, k, writes);
+        CHECK(k < writes || st == STATE_NEW, "%s: upload complete but a mount finds the %s track", c->name,
+              state_names[st]);
+        r = verify(&fs, &commit, data, c->size);
+        CHECK((r == FAT_VERIFY_OK) == (st == STATE_NEW), "%s: cut after write %u: read-back %s, mount finds the %s track",
+              c->name, k, fat_verify_result_name(r), state_names[st]);
+    }
+
+    // One write lost, everything else on the card
+    int caught = 0, missed_interior = 0;
+    for (uint32_t j = 0; j < writes; j++)
+    {
+        fat_sim_restore(&fs, before);
+        fat_sim_mount(&fs);
+        fs.drop_write = j;
+        Commit drop;
+        upload(&fs, data, c->size, &drop);
+
+        uint32_t lost;
+        bool last_ok;
+        uint32_t sect, off, first, size;
+        TrackState st = mount_state(&fs, c, keep, keep_size, old, data, scratch, &lost, &last_ok);
+        bool committed = fat_sim_find(&fs, "SONG.MP3", &sect, &off, &first, &size) && size == c->size &&
+                         first == commit.first_cluster && fat_sim_read(&fs, first, size, scratch, NULL, 0) &&
+                         (size == 0 || last_ok);
+        r = verify(&fs, &commit, data, c->size);
+        CHECK((r == FAT_VERIFY_OK) == committed, "%s: write %u dropped: read-back %s, entry/chain/last sector %s",
+              c->name, j, fat_verify_result_name(r), committed ? "intact" : "lost");
+        if (r != FAT_VERIFY_OK)
+            caught++;
+        else if (st != STATE_NEW)
+            missed_interior++;
+    }
+
+    printf("%-14s FAT%d %5u-byte clusters %8u bytes: %5u writes, %5u cuts (old %d, absent %d, empty %d, new %d), "
+           "max %u lost clusters; %d of %u dropped writes caught, %d interior data\n",
+           c->name, c->fat_bits, c->cluster_sectors * FAT_SIM_SECTOR_SIZE, c->size, writes, cuts,
+           states[STATE_OLD], states[STATE_ABSENT], states[STATE_EMPTY], states[STATE_NEW], max_lost, caught, writes,
+           missed_interior);
+
+    fat_sim_free(&fs);
+    free(before);
+    free(scratch);
+    free(data);
+    free(old);
+    free(keep);
+}
+
+int main(void)
+{
+    uint32_t rng = 0x2545F491;
+    const Case cases[] = {
+        // 512-byte clusters: the chain crosses FAT16 sectors, the window moves mid-upload
+        {"fat16-small-cl", 16, 16384, 1, 200077, 30001},
+        {"fat16-halves", 16, 16384, 4, 16384, 9000},
+        {"fat32-4k", 32, 16384, 8, 1300005, 70000},
+        {"fat32-tiny", 32, 16384, 1, 100, 5000},
+        {"fat32-32k", 32, 65536, 64, 700001, 300000},
+        {"fat32-empty", 32, 16384, 8, 0, 12345},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        run_case(&cases[i], &rng);
+
+    printf("fat commit: %d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,341 @@
+// Volume gain: the Q15 table against the dB curve it encodes, the
+// multiply-shift-saturate against a float path, a benchmark of it against the
+// old divide-by-100 volume, and the ramps behind volume changes and fades.
+//
+// Every int16 sample is run through gain_apply_const() at every volume step.
+// The result must equal the float product rounded half up and clamped
+// exactly, and stay within 1 LSB of the sample times the ideal (unrounded) dB
+// gain: 0.5 from rounding the output, 0.5 from rounding the table entry.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/param.h>
+#include <time.h>
+
+#include "gain.h"
+
+#define ALL_SAMPLES 65536
+#define BENCH_SAMPLES (1152 * 2 * 64) // 64 stereo frames
+#define BENCH_ROUNDS 40
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                                                               \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            failures++;                                                                                                \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+            printf(__VA_ARGS__);                                                                                       \
+            printf("\n");                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static double ideal_gain(int vol)
+{
+    return pow(10.0, -GAIN_DB_PER_STEP * (GAIN_VOLUME_STEPS - vol) / 20.0);
+}
+
+static void test_table(void)
+{
+    CHECK(gain_volume_q15(0) == 0, "step 0 is %d, not mute", gain_volume_q15(0));
+    for (int n = 1; n <= GAIN_VOLUME_STEPS; n++)
+    {
+        int32_t want = (int32_t)lround(GAIN_UNITY_Q15 * ideal_gain(n));
+        CHECK(gain_volume_q15(n) == want, "step %d: %d, curve gives %d", n, gain_volume_q15(n), want);
+        CHECK(gain_volume_q15(n) > gain_volume_q15(n - 1), "step %d not above step %d", n, n - 1);
+    }
+    CHECK(gain_volume_q15(-7) == 0, "negative volume not clamped to mute");
+    CHECK(gain_volume_q15(GAIN_VOLUME_STEPS + 20) == GAIN_UNITY_Q15, "volume above 100 not clamped to unity");
+}
+
+static void check_samples(const int16_t *in, const int16_t *out, size_t count, int vol, int32_t gain,
+                          double *max_err)
+{
+    double g = vol == 0 ? 0.0 : ideal_gain(vol);
+    for (size_t i = 0; i < count; i++)
+    {
+        double exact = floor(in[i] * (gain / 32768.0) + 0.5);
+        if (exact > 32767)
+            exact = 32767;
+        if (exact < -32768)
+            exact = -32768;
+        if (out[i] != (int16_t)exact)
+        {
+            CHECK(0, "step %d gain %d: %d -> %d, float path gives %.0f", vol, gain, in[i], out[i], exact);
+            return;
+        }
+        double err = fabs(out[i] - in[i] * g);
+        if (err > *max_err)
+            *max_err = err;
+    }
+}
+
+static void test_multiply(void)
+{
+    static int16_t in[ALL_SAMPLES], out[ALL_SAMPLES + 8];
+    for (int i = 0; i < ALL_SAMPLES; i++)
+        in[i] = (int16_t)(i - 32768);
+
+    double max_err = 0;
+    for (int vol = 0; vol <= GAIN_VOLUME_STEPS; vol++)
+    {
+        int32_t gain = gain_volume_q15(vol);
+        memcpy(out, in, sizeof(in));
+        gain_apply_const(out, ALL_SAMPLES, gain);
+        check_samples(in, out, ALL_SAMPLES, vol, gain, &max_err);
+
+        // Every tail length of the 4-sample unroll; the guard past count stays untouched
+        for (size_t count = 1; count <= 7; count++)
+        {
+            memcpy(out, in + 600 * vol, (count + 1) * sizeof(int16_t));
+            gain_apply_const(out, count, gain);
+            check_samples(in + 600 * vol, out, count, vol, gain, &max_err);
+            CHECK(out[count] == in[600 * vol + count], "step %d: sample %zu past the end written", vol, count);
+        }
+    }
+    CHECK(max_err <= 1.0, "%.3f LSB from the ideal dB gain", max_err);
+    printf("multiply: %d steps x %d samples, max %.3f LSB from the ideal dB gain\n", GAIN_VOLUME_STEPS + 1,
+           ALL_SAMPLES, max_err);
+
+    // Saturation: gains above unity are not used by the table but must still clamp
+    int16_t loud[2] = {30000, -30000};
+    gain_apply_const(loud, 2, 2 * GAIN_UNITY_Q15);
+    CHECK(loud[0] == 32767 && loud[1] == -32768, "gain 2.0 gave %d %d, not clamped", loud[0], loud[1]);
+}
+
+// === Ramps ===
+// Full-scale input split into random chunks the way the feeder splits batches
+// at the ring wrap. The Q23 accumulator is checked after every call: it moves
+// monotonically towards the target without overshoot, reaches it exactly
+// within ramp_frames, and the output never steps between two frames of one
+// channel by more than the ramp's fixed step allows.
+#define RAMP_FULL_SCALE 32767
+
+typedef struct
+{
+    int32_t from, to;  // Q23 ends of the ramp being checked
+    int32_t bound;     // Largest allowed Q23 gain change per sample
+    long frames;       // Frames processed since the ramp started
+    long done_at;      // Frame count when the target was reached, -1 before
+    int32_t max_step;  // Largest output change between frames of one channel
+    int16_t last[2];
+} RampCheck;
+
+static uint32_t ramp_rng = 0x13579BDFu;
+
+static uint32_t ramp_rand(void)
+{
+    ramp_rng ^= ramp_rng << 13;
+    ramp_rng ^= ramp_rng >> 17;
+    ramp_rng ^= ramp_rng << 5;
+    return ramp_rng;
+}
+
+static void ramp_start(RampCheck *c, const GainRamp *r, int32_t target_q15, int channels)
+{
+    int32_t span = r->ramp_frames * channels;
+    int32_t diff = (target_q15 << GAIN_FRAC_BITS) - r->current;
+    c->from = r->current;
+    c->to = target_q15 << GAIN_FRAC_BITS;
+    c->bound = (abs(diff) + span - 1) / span;
+    c->frames = 0;
+    c->done_at = c->from == c->to ? 0 : -1;
+    c->max_step = 0;
+    for (int ch = 0; ch < channels; ch++)
+        c->last[ch] = gain_mul_q15(RAMP_FULL_SCALE, c->from >> GAIN_FRAC_BITS);
+}
+
+// Run frames of full-scale input through the ramp in random chunks
+static void ramp_run(GainRamp *r, RampCheck *c, int32_t target_q15, int channels, long frames, const char *what)
+{
+    static int16_t buf[4096 * 2];
+    while (frames > 0)
+    {
+        long n = 1 + ramp_rand() % (ramp_rand() & 1 ? 7 : 1500);
+        if (n > frames)
+            n = frames;
+        for (long i = 0; i < n * channels; i++)
+            buf[i] = RAMP_FULL_SCALE;
+        int32_t before = r->current;
+        gain_ramp_process(r, buf, (size_t)(n * channels), channels, target_q15);
+
+        int32_t lo = MIN(c->from, c->to), hi = MAX(c->from, c->to);
+        bool toward = c->to >= c->from ? r->current >= before : r->current <= before;
+        CHECK(r->current >= lo && r->current <= hi && toward, "%s: accumulator %d left %d..%d or turned back from %d",
+              what, r->current, c->from, c->to, before);
+        CHECK(abs(r->current - before) <= c->bound * n * channels, "%s: accumulator moved %d in %ld frames, step %d",
+              what, abs(r->current - before), n, c->bound);
+        CHECK(r->current == c->to || abs(r->step) == c->bound, "%s: step %d mid-ramp, set to %d at the start", what,
+              r->step, c->bound);
+
+        for (long i = 0; i < n; i++)
+            for (int ch = 0; ch < channels; ch++)
+            {
+                int16_t v = buf[i * channels + ch];
+                c->max_step = MAX(c->max_step, abs(v - c->last[ch]));
+                c->last[ch] = v;
+            }
+        // The fixed step lands on the target this many samples into the chunk
+        if (c->done_at < 0 && r->current == c->to)
+        {
+            long samples = (abs(c->to - before) + c->bound - 1) / c->bound;
+            c->done_at = c->frames + (samples + channels - 1) / channels;
+        }
+        c->frames += n;
+        frames -= n;
+    }
+}
+
+// One complete ramp from the current gain to target_q15
+static void ramp_check(GainRamp *r, int32_t target_q15, int channels, const char *what)
+{
+    RampCheck c;
+    ramp_start(&c, r, target_q15, channels);
+    ramp_run(r, &c, target_q15, channels, r->ramp_frames + 50, what);
+
+    // Output steps: the Q23 step times the channels sharing a frame, plus rounding
+    int32_t step_lsb = (c.bound * channels >> GAIN_FRAC_BITS) + 2;
+    CHECK(c.done_at >= 0 && c.done_at <= r->ramp_frames, "%s: %d -> %d took %ld frames, ramp is %d", what,
+          c.from >> GAIN_FRAC_BITS, target_q15, c.done_at, r->ramp_frames);
+    CHECK(r->current == target_q15 << GAIN_FRAC_BITS && r->step == 0, "%s: ended at %d (step %d), not %d << %d", what,
+          r->current, r->step, target_q15, GAIN_FRAC_BITS);
+    CHECK(c.max_step <= step_lsb, "%s: %d LSB output step, ramp allows %d", what, c.max_step, step_lsb);
+    // Linear: the step rounded up shortens a ramp by less than one sample per step
+    if (c.bound >= 2)
+        CHECK(c.done_at >= r->ramp_frames - r->ramp_frames / c.bound - 1, "%s: %d -> %d done in %ld of %d frames", what,
+              c.from >> GAIN_FRAC_BITS, target_q15, c.done_at, r->ramp_frames);
+}
+
+static int ramp_max_step;
+
+static void test_ramps(void)
+{
+    int ramp_lengths[] = {GAIN_RAMP_FRAMES_DEFAULT, 1, 3, 100, 4096};
+    char what[96];
+
+    for (size_t k = 0; k < sizeof(ramp_lengths) / sizeof(ramp_lengths[0]); k++)
+        for (int channels = 1; channels <= 2; channels++)
+        {
+            GainRamp r = {.ramp_frames = ramp_lengths[k]};
+            gain_ramp_reset(&r, 0);
+
+            // Volume steps one at a time up and down, then large jumps
+            for (int vol = 1; vol <= GAIN_VOLUME_STEPS; vol++)
+            {
+                snprintf(what, sizeof(what), "ramp %d ch %d: step up to %d", r.ramp_frames, channels, vol);
+                ramp_check(&r, gain_volume_q15(vol), channels, what);
+            }
+            for (int vol = GAIN_VOLUME_STEPS - 1; vol >= 0; vol--)
+            {
+                snprintf(what, sizeof(what), "ramp %d ch %d: step down to %d", r.ramp_frames, channels, vol);
+                ramp_check(&r, gain_volume_q15(vol), channels, what);
+            }
+            for (int vol = 5; vol <= GAIN_VOLUME_STEPS; vol += 5)
+            {
+                // Fade-in from a track start, fade-out for pause/stop
+                snprintf(what, sizeof(what), "ramp %d ch %d: fade in to %d", r.ramp_frames, channels, vol);
+                gain_ramp_reset(&r, 0);
+                ramp_check(&r, gain_volume_q15(vol), channels, what);
+                snprintf(what, sizeof(what), "ramp %d ch %d: fade out from %d", r.ramp_frames, channels, vol);
+                ramp_check(&r, 0, channels, what);
+            }
+            snprintf(what, sizeof(what), "ramp %d ch %d: jump 5 -> 100", r.ramp_frames, channels);
+            ramp_check(&r, gain_volume_q15(5), channels, what);
+            ramp_check(&r, GAIN_UNITY_Q15, channels, what);
+            snprintf(what, sizeof(what), "ramp %d ch %d: jump 100 -> 5", r.ramp_frames, channels);
+            ramp_check(&r, gain_volume_q15(5), channels, what);
+
+            // Skip during a fade-in: the fade-out starts from wherever the fade-in got
+            // to, the next track starts silent and fades in again
+            if (r.ramp_frames >= 3)
+            {
+                snprintf(what, sizeof(what), "ramp %d ch %d: skip", r.ramp_frames, channels);
+                gain_ramp_reset(&r, 0);
+                RampCheck c;
+                ramp_start(&c, &r, GAIN_UNITY_Q15, channels);
+                ramp_run(&r, &c, GAIN_UNITY_Q15, channels, r.ramp_frames / 3, what);
+                CHECK(r.current > 0 && r.current < GAIN_UNITY_Q15 << GAIN_FRAC_BITS, "%s: fade-in at %d", what,
+                      r.current);
+                ramp_check(&r, 0, channels, what);
+                gain_ramp_reset(&r, 0);
+                ramp_check(&r, gain_volume_q15(70), channels, what);
+            }
+            if (r.ramp_frames == GAIN_RAMP_FRAMES_DEFAULT && channels == 2)
+            {
+                gain_ramp_reset(&r, 0);
+                RampCheck c;
+                ramp_start(&c, &r, GAIN_UNITY_Q15, channels);
+                ramp_run(&r, &c, GAIN_UNITY_Q15, channels, r.ramp_frames, "default fade-in");
+                ramp_max_step = c.max_step;
+            }
+        }
+    printf("ramps: default fade-in to unity steps at most %d LSB per frame at full scale\n", ramp_max_step);
+}
+
+// The volume before the Q15 table: a divide by 100 per sample
+static void divide_volume(int16_t *samples, size_t count, int vol)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        int32_t s = ((int32_t)samples[i] * vol) / 100;
+        samples[i] = gain_sat16(s);
+    }
+}
+
+static void bench(void)
+{
+    int16_t *src = malloc(BENCH_SAMPLES * sizeof(int16_t));
+    int16_t *buf = malloc(BENCH_SAMPLES * sizeof(int16_t));
+    uint32_t x = 0x2468ACE1u;
+    for (int i = 0; i < BENCH_SAMPLES; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        src[i] = (int16_t)x;
+    }
+
+    uint64_t q15_ns = 0, div_ns = 0;
+    long sink = 0;
+    int vols[] = {5, 37, 70, 95};
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+    {
+        int vol = vols[r % 4];
+        memcpy(buf, src, BENCH_SAMPLES * sizeof(int16_t));
+        uint64_t t0 = now_ns();
+        gain_apply_const(buf, BENCH_SAMPLES, gain_volume_q15(vol));
+        q15_ns += now_ns() - t0;
+        sink += buf[r];
+
+        memcpy(buf, src, BENCH_SAMPLES * sizeof(int16_t));
+        t0 = now_ns();
+        divide_volume(buf, BENCH_SAMPLES, vol);
+        div_ns += now_ns() - t0;
+        sink += buf[r];
+    }
+    double n = (double)BENCH_SAMPLES * BENCH_ROUNDS;
+    printf("bench: q15 %.2f ns/sample, divide-by-100 %.2f ns/sample (%ld)\n", q15_ns / n, div_ns / n, sink & 1);
+    free(src);
+    free(buf);
+}
+
+int main(void)
+{
+    test_table();
+    test_multiply();
+    test_ramps();
+    bench();
+    printf("gain: %d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,215 @@
+// Gapless chains: tracks decoded back to back through one decoder, the way
+// play_file() switches at a gapless boundary (MP3ResetDecoder, new LAME trim,
+// Info frame skipped), must give exactly the concatenation of each track
+// decoded on its own: every sample in order, nothing dropped, no silence
+// inserted at the joins. Each track's length is checked against its LAME
+// delay and padding.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "mp3_fixture.h"
+#include "mp3_frames.h"
+#include "mp3dec.h"
+
+#define TRACKS 4
+#define JOIN_WINDOW 2304 // Frames checked for silence on each side of a join
+
+typedef struct
+{
+    FixtureStream s;
+    Mp3StreamInfo info;
+    bool has_info;
+    int frames;
+    int channels;
+    long expect_frames; // Output frames after the trim
+} Track;
+
+typedef struct
+{
+    short *pcm;
+    long frames; // Per channel
+    long cap;
+} Pcm;
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                                                               \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            failures++;                                                                                                \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+            printf(__VA_ARGS__);                                                                                       \
+            printf("\n");                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+static void build_track(Track *t, const FixtureFormat *f, int frames, bool lame, uint16_t delay, uint16_t padding,
+                        uint32_t *rng)
+{
+    memset(t, 0, sizeof(*t));
+    if (lame)
+        fixture_lame(&t->s, f, 9, frames, delay, padding);
+    fixture_frames(&t->s, f, 9, frames, true, rng);
+    t->frames = frames;
+    t->channels = f->channels;
+
+    t->info.audio_end = t->info.audio_bytes = (uint32_t)t->s.len;
+    t->has_info = stream_info_parse(&t->info, t->s.data, MIN(t->s.len, (size_t)STREAM_PROBE_SIZE));
+    long total = (long)frames * fixture_samples_per_frame(f);
+    t->expect_frames = lame ? total - delay - padding : total;
+}
+
+// play_file()'s decode of one track: Info frame skipped, LAME trim applied
+static void decode_track(HMP3Decoder dec, const Track *t, Pcm *out)
+{
+    static short pcm[1152 * 2];
+    int32_t trim_skip;
+    int64_t trim_valid;
+    stream_info_trim(&t->info, &trim_skip, &trim_valid);
+
+    uint8_t *p = t->s.data + t->info.audio_start + t->info.info_frame_bytes;
+    int left = (int)(t->s.len - (p - t->s.data));
+    while (left > 0)
+    {
+        int err = MP3Decode(dec, &p, &left, pcm, 0);
+        if (err != ERR_MP3_NONE)
+        {
+            CHECK(0, "decode error %d with %d bytes left", err, left);
+            return;
+        }
+        MP3FrameInfo fi;
+        MP3GetLastFrameInfo(dec, &fi);
+        int skip;
+        int emit = stream_trim_frame(&trim_skip, &trim_valid, fi.outputSamps / fi.nChans, &skip);
+        if (out->frames + emit > out->cap)
+        {
+            out->cap = (out->frames + emit) * 2;
+            out->pcm = realloc(out->pcm, out->cap * t->channels * sizeof(short));
+        }
+        memcpy(out->pcm + out->frames * t->channels, pcm + skip * fi.nChans, emit * fi.nChans * sizeof(short));
+        out->frames += emit;
+    }
+}
+
+// Longest run of all-zero output frames in [from, to)
+static long zero_run(const Pcm *p, int channels, long from, long to)
+{
+    long run = 0, longest = 0;
+    for (long i = MAX(from, 0); i < MIN(to, p->frames); i++)
+    {
+        bool zero = true;
+        for (int ch = 0; ch < channels; ch++)
+            zero = zero && p->pcm[i * channels + ch] == 0;
+        run = zero ? run + 1 : 0;
+        longest = MAX(longest, run);
+    }
+    return longest;
+}
+
+// Silent frames from a position, walking forwards (dir 1) or backwards (dir -1)
+static long silent_frames(const Pcm *p, int channels, long from, int dir)
+{
+    long n = 0;
+    for (long i = from; i >= 0 && i < p->frames; i += dir, n++)
+        for (int ch = 0; ch < channels; ch++)
+            if (p->pcm[i * channels + ch] != 0)
+                return n;
+    return n;
+}
+
+static void run_chain(const char *name, const FixtureFormat *f, uint32_t *rng)
+{
+    Track t[TRACKS];
+    build_track(&t[0], f, 60, true, 576, 1200, rng); // LAME defaults
+    build_track(&t[1], f, 45, true, 0, 529, rng);    // No encoder delay: the decoder start-up is all that is trimmed
+    build_track(&t[2], f, 30, false, 0, 0, rng);     // No LAME tag: nothing trimmed
+    build_track(&t[3], f, 50, true, 1105, 2321, rng);
+
+    // Reference: every track on a fresh decoder
+    Pcm ref[TRACKS] = {0};
+    long joins[TRACKS];
+    long total = 0;
+    for (int i = 0; i < TRACKS; i++)
+    {
+        CHECK(t[i].has_info, "%s track %d: no frame header", name, i);
+        HMP3Decoder dec = MP3InitDecoder();
+        decode_track(dec, &t[i], &ref[i]);
+        MP3FreeDecoder(dec);
+        CHECK(ref[i].frames == t[i].expect_frames, "%s track %d: %ld frames played, trim leaves %ld", name, i,
+              ref[i].frames, t[i].expect_frames);
+        joins[i] = total;
+        total += ref[i].frames;
+    }
+
+    // The chain: one decoder, reset at each boundary as play_file() does; and
+    // without the reset, to show what carried-over state would change
+    Pcm chain = {0}, carried = {0};
+    HMP3Decoder dec = MP3InitDecoder();
+    HMP3Decoder dec_carried = MP3InitDecoder();
+    for (int i = 0; i < TRACKS; i++)
+    {
+        if (i > 0)
+            MP3ResetDecoder(dec);
+        decode_track(dec, &t[i], &chain);
+        decode_track(dec_carried, &t[i], &carried);
+    }
+    MP3FreeDecoder(dec);
+    MP3FreeDecoder(dec_carried);
+
+    CHECK(chain.frames == total, "%s: chain played %ld frames, tracks on their own %ld", name, chain.frames, total);
+    long first_diff = -1, carried_diffs = 0;
+    for (int i = 0; i < TRACKS && chain.frames == total; i++)
+    {
+        const short *at = chain.pcm + joins[i] * f->channels;
+        for (long k = 0; k < ref[i].frames * f->channels; k++)
+        {
+            if (at[k] != ref[i].pcm[k] && first_diff < 0)
+                first_diff = joins[i] * f->channels + k;
+            if (carried.pcm[joins[i] * f->channels + k] != ref[i].pcm[k])
+                carried_diffs++;
+        }
+    }
+    CHECK(first_diff < 0, "%s: chain differs from the tracks on their own at sample %ld", name, first_diff);
+
+    // A join may only be as quiet as the two tracks are there on their own: a
+    // track without a LAME tag keeps the decoder start-up, a trimmed one must not
+    long longest = 0;
+    for (int i = 1; i < TRACKS; i++)
+    {
+        long lead = silent_frames(&ref[i], f->channels, 0, 1);
+        long own = silent_frames(&ref[i - 1], f->channels, ref[i - 1].frames - 1, -1) + lead;
+        long run = zero_run(&chain, f->channels, joins[i] - JOIN_WINDOW, joins[i] + JOIN_WINDOW);
+        CHECK(run <= MAX(own, 4), "%s join %d: %ld silent frames, the tracks have %ld there", name, i, run, own);
+        if (t[i].info.has_lame)
+            CHECK(lead <= 4, "%s track %d: trim left %ld silent frames of decoder start-up", name, i, lead);
+        if (own <= 4)
+            longest = MAX(longest, run);
+    }
+
+    printf("%-8s %ld frames over %d tracks, longest silence at a trimmed join %ld frames; without the reset %ld samples "
+           "differ\n",
+           name, total, TRACKS, longest, carried_diffs);
+
+    for (int i = 0; i < TRACKS; i++)
+    {
+        free(ref[i].pcm);
+        fixture_free(&t[i].s);
+    }
+    free(chain.pcm);
+    free(carried.pcm);
+}
+
+int main(void)
+{
+    uint32_t rng = 0x0DDBA11u;
+    FixtureFormat stereo = {0, 0, 2};
+    FixtureFormat mono = {1, 1, 1};
+    run_chain("mpeg1", &stereo, &rng);
+    run_chain("mpeg2", &mono, &rng);
+    printf("gapless: %d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,399 @@
+// mp3_resync: split headers at the end of a window, the final flag, the
+// free-format lock, and a corruption fuzz that doubles as the recovery benchmark.
+//
+// The fuzz builds streams frame by frame and damages some frames as it goes
+// (overwritten bursts, truncated frames, inserted junk), so the true frame
+// starts are known. It then walks each stream the way play_file() does: frames
+// in sync are taken by header length, anything else goes through mp3_resync on
+// a window that grows in random steps, final only at the end of the file. Every
+// recovery is compared with the first frame a confirmed sync can land on (an
+// intact header whose successor is intact and exactly one frame later).
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <time.h>
+
+#include "mp3_fixture.h"
+#include "mp3_frames.h"
+#include "mp3dec.h"
+
+#define FUZZ_STREAMS 60
+#define FUZZ_FRAMES 400
+#define STEPPING_TRIALS 200 // Old MP3FindSyncWord + MP3Decode stepping, for comparison
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                                                               \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            failures++;                                                                                                \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+            printf(__VA_ARGS__);                                                                                       \
+            printf("\n");                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Lock onto the first frame of a clean stream
+static Mp3SyncLock lock_for(const FixtureStream *s)
+{
+    Mp3SyncLock lock = {0};
+    int off;
+    ResyncResult rs = mp3_resync(s->data, (int)s->len, &lock, true, &off);
+    CHECK(rs == RESYNC_FOUND && off == 0, "lock_for: no frame at 0");
+    return lock;
+}
+
+// Headers cut at every point by the end of the window
+static void test_split_headers(void)
+{
+    uint32_t rng = 5;
+    FixtureFormat f = {0, 1, 2};
+    FixtureStream s = {0};
+    size_t starts[41];
+    for (int i = 0; i < 40; i++)
+        starts[i] = fixture_frame(&s, &f, 1 + fixture_rand(&rng) % 14, fixture_rand(&rng) & 1, true, &rng);
+    starts[40] = s.len;
+    Mp3SyncLock locked = lock_for(&s);
+
+    for (int i = 1; i < 39; i++)
+    {
+        for (int fresh = 0; fresh < 2; fresh++)
+        {
+            Mp3SyncLock lock = fresh ? (Mp3SyncLock){0} : locked;
+            int off;
+
+            // Header cut after k bytes: never found, and its first byte is kept
+            for (int k = 0; k < 4; k++)
+            {
+                size_t from = starts[i] - 13;
+                int len = 13 + k;
+                Mp3SyncLock l = lock;
+                ResyncResult rs = mp3_resync(s.data + from, len, &l, false, &off);
+                CHECK(rs == RESYNC_NONE && off <= 13, "split header k=%d frame %d: rs %d off %d", k, i, rs, off);
+
+                // More data arrives: the frame is found where it is
+                l = lock;
+                size_t next = from + off;
+                rs = mp3_resync(s.data + next, (int)(starts[i + 2] - next), &l, false, &off);
+                CHECK(rs == RESYNC_FOUND && next + off <= starts[i] && (fresh || next + off == starts[i]),
+                      "after split k=%d frame %d: rs %d at %zu", k, i, rs, next + off);
+            }
+
+            // Successor header cut: wait for it, unless no more data is coming
+            size_t frame_len = starts[i + 1] - starts[i];
+            for (int k = 0; k < 4; k++)
+            {
+                Mp3SyncLock l = lock;
+                ResyncResult rs = mp3_resync(s.data + starts[i], (int)(frame_len + k), &l, false, &off);
+                CHECK(rs == RESYNC_NEED_MORE && off == 0, "successor cut k=%d frame %d: rs %d off %d", k, i, rs, off);
+                l = lock;
+                rs = mp3_resync(s.data + starts[i], (int)(frame_len + k), &l, true, &off);
+                CHECK(rs == RESYNC_FOUND && off == 0, "final, successor cut k=%d frame %d: rs %d", k, i, rs);
+            }
+        }
+    }
+
+    // No candidate: keep 3 bytes for a split header, or drop everything at the end
+    uint8_t zeros[64] = {0};
+    zeros[63] = 0xFF;
+    int off;
+    Mp3SyncLock l = locked;
+    CHECK(mp3_resync(zeros, 64, &l, false, &off) == RESYNC_NONE && off == 61, "no candidate: offset %d", off);
+    CHECK(mp3_resync(zeros, 64, &l, true, &off) == RESYNC_NONE && off == 64, "no candidate, final: offset %d", off);
+    CHECK(mp3_resync(zeros, 2, &l, false, &off) == RESYNC_NONE && off == 0, "short window: offset %d", off);
+
+    // A frame of another format is not a frame of this stream
+    FixtureStream other = {0};
+    FixtureFormat g = {0, 0, 1};
+    fixture_frames(&other, &g, 9, 3, true, &rng);
+    l = locked;
+    CHECK(mp3_resync(other.data, (int)other.len, &l, true, &off) == RESYNC_NONE, "other format accepted");
+    fixture_free(&other);
+    fixture_free(&s);
+}
+
+static void test_free_format(void)
+{
+    // MPEG1 44.1 kHz stereo, bitrate index 0: no length, so no confirmation
+    uint8_t buf[3000];
+    memset(buf, 0x11, sizeof(buf));
+    static const uint8_t ff_hdr[4] = {0xFF, 0xFB, 0x00, 0x04};
+    memcpy(buf + 100, ff_hdr, 4);
+    memcpy(buf + 900, ff_hdr, 4);
+
+    Mp3SyncLock lock = {0};
+    int off;
+    ResyncResult rs = mp3_resync(buf, sizeof(buf), &lock, false, &off);
+    CHECK(rs == RESYNC_FOUND && off == 100 && lock.valid && lock.free_format, "free format: rs %d off %d", rs, off);
+
+    // Locked free-format: same format in sync, other rates and normal frames not
+    CHECK(frame_in_sync(buf + 900, 4, &lock), "free format: next frame not in sync");
+    static const uint8_t ff_48k[4] = {0xFF, 0xFB, 0x04, 0x04};
+    static const uint8_t cbr_128[4] = {0xFF, 0xFB, 0x90, 0x04};
+    CHECK(!frame_in_sync(ff_48k, 4, &lock), "free format: 48 kHz frame in a 44.1 kHz stream");
+    CHECK(!frame_in_sync(cbr_128, 4, &lock), "free format: bitrate frame taken as free format");
+    CHECK(!frame_in_sync(buf + 900, 3, &lock), "free format: 3 bytes taken as a header");
+
+    rs = mp3_resync(buf + 104, sizeof(buf) - 104, &lock, false, &off);
+    CHECK(rs == RESYNC_FOUND && off == 796, "free format: resync to the next frame, rs %d off %d", rs, off);
+
+    // A stream with a bitrate never locks onto free-format lookalikes
+    uint32_t rng = 3;
+    FixtureFormat f = {0, 0, 2};
+    FixtureStream s = {0};
+    fixture_frames(&s, &f, 9, 2, true, &rng);
+    Mp3SyncLock cbr = lock_for(&s);
+    rs = mp3_resync(buf, sizeof(buf), &cbr, true, &off);
+    CHECK(rs == RESYNC_NONE && !cbr.free_format, "free format accepted in a CBR stream: rs %d off %d", rs, off);
+    fixture_free(&s);
+}
+
+typedef struct
+{
+    FixtureStream s;
+    size_t *starts;        // True frame starts, in order
+    bool *intact;          // Header bytes untouched
+    uint8_t *is_start;     // Per byte: a true frame start
+    int frames;
+} FuzzStream;
+
+static void fuzz_build(FuzzStream *z, const FixtureFormat *f, uint32_t *rng)
+{
+    memset(z, 0, sizeof(*z));
+    z->starts = malloc(sizeof(size_t) * (FUZZ_FRAMES + 1));
+    z->intact = malloc(sizeof(bool) * (FUZZ_FRAMES + 1));
+    for (int i = 0; i < FUZZ_FRAMES; i++)
+    {
+        size_t at = fixture_frame(&z->s, f, 1 + fixture_rand(rng) % 14, fixture_rand(rng) & 1, true, rng);
+        size_t len = z->s.len - at;
+        z->starts[i] = at;
+        z->intact[i] = true;
+
+        switch (i > 0 ? fixture_rand(rng) % 16 : 15)
+        {
+        case 0: // Burst over part of the frame, maybe the header
+        {
+            size_t from = fixture_rand(rng) % len;
+            size_t n = 1 + fixture_rand(rng) % 600;
+            if (from + n > len)
+                n = len - from;
+            uint8_t header[4];
+            memcpy(header, z->s.data + at, 4);
+            for (size_t b = 0; b < n; b++)
+                z->s.data[at + from + b] = (uint8_t)fixture_rand(rng);
+            z->intact[i] = memcmp(header, z->s.data + at, 4) == 0;
+            break;
+        }
+        case 1: // Frame cut short (lost bytes in transit)
+            z->s.len -= 1 + fixture_rand(rng) % (len - 8);
+            break;
+        case 2: // Junk between frames
+            fixture_append_random(&z->s, 1 + fixture_rand(rng) % 900, rng);
+            break;
+        case 3: // Single bit flip anywhere in the frame
+        {
+            size_t bit = fixture_rand(rng) % (len * 8);
+            z->s.data[at + bit / 8] ^= 0x80 >> (bit % 8);
+            if (bit < 32)
+                z->intact[i] = false;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    z->frames = FUZZ_FRAMES;
+    z->starts[FUZZ_FRAMES] = z->s.len;
+    z->intact[FUZZ_FRAMES] = false;
+    z->is_start = calloc(z->s.len + 1, 1);
+    for (int i = 0; i < z->frames; i++)
+        z->is_start[z->starts[i]] = 1;
+}
+
+static void fuzz_free(FuzzStream *z)
+{
+    fixture_free(&z->s);
+    free(z->starts);
+    free(z->intact);
+    free(z->is_start);
+}
+
+// First frame at or after pos that a confirmed sync can land on
+static size_t expected_recovery(const FuzzStream *z, size_t pos)
+{
+    for (int i = 0; i < z->frames; i++)
+    {
+        if (z->starts[i] < pos || !z->intact[i])
+            continue;
+        Mp3FrameHeader h;
+        if (!parse_frame_header(z->s.data + z->starts[i], &h))
+            continue;
+        if (i + 1 == z->frames)
+            return z->starts[i]; // Accepted unconfirmed at the end of the file
+        if (z->starts[i] + h.frame_bytes == z->starts[i + 1] && z->intact[i + 1])
+            return z->starts[i];
+    }
+    return z->s.len;
+}
+
+typedef struct
+{
+    long resyncs;
+    long exact;      // Landed on the expected frame
+    long false_sync; // Landed on something that is not a frame start
+    long early;      // A true frame before the expected one (its successor matched by chance)
+    long late;       // Skipped the frame a confirmed sync should land on
+    uint64_t skipped_bytes;
+    uint64_t resync_ns;
+    uint64_t scanned_bytes;
+} FuzzStats;
+
+// play_file()'s sync handling over one stream
+static void fuzz_walk(const FuzzStream *z, uint32_t *rng, FuzzStats *st)
+{
+    Mp3SyncLock lock = {0};
+    bool start = true;
+    size_t pos = 0;
+    size_t avail = 0;
+    size_t lost_at = 0; // Where sync was lost; 0 while in sync (a scan waiting for data stays a scan)
+
+    while (pos < z->s.len)
+    {
+        if (avail < pos + 4 && avail < z->s.len)
+        {
+            avail = MIN(z->s.len, avail + 1 + fixture_rand(rng) % 6000);
+            continue;
+        }
+        bool final = avail == z->s.len;
+        Mp3FrameHeader h;
+        if (!start && lost_at == 0 && frame_in_sync(z->s.data + pos, (int)(avail - pos), &lock) &&
+            parse_frame_header(z->s.data + pos, &h))
+        {
+            pos += h.frame_bytes;
+            continue;
+        }
+        if (!start && lost_at == 0)
+            lost_at = pos ? pos : 1;
+
+        int off;
+        uint64_t t0 = now_ns();
+        ResyncResult rs = mp3_resync(z->s.data + pos, (int)(avail - pos), &lock, final, &off);
+        st->resync_ns += now_ns() - t0;
+        st->scanned_bytes += off;
+        if (rs != RESYNC_FOUND)
+        {
+            pos += off;
+            if (final && rs == RESYNC_NONE)
+                break;
+            if (!final)
+                avail = MIN(z->s.len, avail + 1 + fixture_rand(rng) % 6000);
+            continue;
+        }
+
+        size_t found = pos + off;
+        if (!start)
+        {
+            size_t want = expected_recovery(z, lost_at);
+            st->resyncs++;
+            st->skipped_bytes += found - lost_at;
+            if (found == want)
+                st->exact++;
+            else if (!z->is_start[found])
+                st->false_sync++;
+            else if (found < want)
+                st->early++;
+            else
+                st->late++;
+        }
+        start = false;
+        lost_at = 0;
+        pos = found;
+        Mp3FrameHeader fh;
+        if (parse_frame_header(z->s.data + pos, &fh))
+            pos += fh.frame_bytes;
+        else
+            pos += 4;
+    }
+}
+
+// The old recovery: MP3FindSyncWord, try MP3Decode, step one byte on failure
+static void stepping_bench(const FuzzStream *z, uint32_t *rng, long *decodes, uint64_t *ns, long *false_sync)
+{
+    HMP3Decoder dec = MP3InitDecoder();
+    static short pcm[1152 * 2];
+    for (int t = 0; t < STEPPING_TRIALS / 10; t++)
+    {
+        size_t pos = fixture_rand(rng) % (z->s.len / 2);
+        uint64_t t0 = now_ns();
+        while (pos + 4 < z->s.len)
+        {
+            int off = MP3FindSyncWord(z->s.data + pos, (int)(z->s.len - pos));
+            if (off < 0)
+                break;
+            pos += off;
+            uint8_t *in = z->s.data + pos;
+            int left = (int)(z->s.len - pos);
+            (*decodes)++;
+            int err = MP3Decode(dec, &in, &left, pcm, 0);
+            if (err == ERR_MP3_NONE || err == ERR_MP3_MAINDATA_UNDERFLOW)
+                break;
+            pos++;
+        }
+        *ns += now_ns() - t0;
+        if (pos < z->s.len && !z->is_start[pos])
+            (*false_sync)++;
+    }
+    MP3FreeDecoder(dec);
+}
+
+static void test_fuzz(void)
+{
+    static const FixtureFormat formats[] = {{0, 0, 2}, {0, 1, 1}, {0, 2, 2}, {1, 0, 2}, {1, 1, 1}, {1, 2, 2}};
+    uint32_t rng = 0xC0FFEE;
+    FuzzStats st = {0};
+    long step_decodes = 0, step_false = 0;
+    uint64_t step_ns = 0;
+
+    for (int n = 0; n < FUZZ_STREAMS; n++)
+    {
+        FuzzStream z;
+        fuzz_build(&z, &formats[n % 6], &rng);
+        fuzz_walk(&z, &rng, &st);
+        if (n < 10)
+            stepping_bench(&z, &rng, &step_decodes, &step_ns, &step_false);
+        fuzz_free(&z);
+    }
+
+    double false_pct = st.resyncs ? 100.0 * st.false_sync / st.resyncs : 0;
+    printf("resync: %ld recoveries, %ld exact, %ld early, %ld late, %.2f%% false sync, %.0f bytes and %.2f us "
+           "per recovery, %.0f MB/s scan\n",
+           st.resyncs, st.exact, st.early, st.late, false_pct, st.resyncs ? (double)st.skipped_bytes / st.resyncs : 0,
+           st.resyncs ? st.resync_ns / 1000.0 / st.resyncs : 0,
+           st.resync_ns ? st.scanned_bytes * 1000.0 / st.resync_ns : 0);
+    printf("stepping: %d recoveries, %.1f decode attempts and %.2f us per recovery, %.2f%% false sync\n",
+           STEPPING_TRIALS, (double)step_decodes / STEPPING_TRIALS, step_ns / 1000.0 / STEPPING_TRIALS,
+           100.0 * step_false / STEPPING_TRIALS);
+
+    CHECK(st.resyncs > 500, "fuzz: only %ld recoveries", st.resyncs);
+    CHECK(st.late == 0, "fuzz: %ld recoveries skipped a confirmable frame", st.late);
+    CHECK(false_pct < 0.5, "fuzz: false sync rate %.2f%%", false_pct);
+}
+
+int main(void)
+{
+    test_split_headers();
+    test_free_format();
+    test_fuzz();
+    printf("resync: %d failures\n", failures);
+    return failures ? 1 : 0;
+}
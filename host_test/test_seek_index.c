@@ -0,0 +1,303 @@
+// Seek index from an upload (seek_index_feed) against a full decode.
+//
+// Each synthetic stream is decoded with helix through the same frame loop as
+// play_file(): resync with mp3_resync, skip the Info frame, index every frame
+// that decodes (or underflows the bit reservoir), abort on a decode error or a
+// mid-stream resync. The frames that loop decodes are the ground truth. The
+// upload path feeds the raw file bytes, tags and trailers included, in random
+// chunk sizes and must end with the same frame count and entry offsets, or
+// with no index where playback builds none.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "mp3_fixture.h"
+#include "mp3_frames.h"
+#include "mp3dec.h"
+
+#define DECODE_WINDOW 16384 // Like the playback ring: frames arrive in windows, final at the end
+
+typedef struct
+{
+    const char *name;
+    FixtureStream s;
+    size_t audio_start;      // First frame (the Info frame if there is one)
+    size_t audio_end;        // Where the ID3v1/APEv2 trailers start
+    size_t info_frame_bytes;
+    bool expect_index;       // Whether playback keeps its index
+} Case;
+
+typedef struct
+{
+    uint32_t *offsets; // Every decoded frame
+    uint32_t frames;
+    int resyncs;
+    int decode_errors;
+    SeekIndexBuilder index; // Built the way play_file() builds it
+} Decoded;
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                                                               \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            failures++;                                                                                                \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+            printf(__VA_ARGS__);                                                                                       \
+            printf("\n");                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+// play_file()'s frame loop over [audio_start, audio_end)
+static void decode_reference(const Case *c, Decoded *d)
+{
+    HMP3Decoder dec = MP3InitDecoder();
+    static short pcm[1152 * 2];
+    Mp3SyncLock lock = {0};
+    bool need_resync = true;
+    bool scanning = false;
+    size_t pos = c->audio_start;
+
+    memset(d, 0, sizeof(*d));
+    d->offsets = malloc(sizeof(uint32_t) * (c->s.len / 24 + 1));
+    seek_index_begin(&d->index);
+
+    while (pos < c->audio_end)
+    {
+        int len = (int)MIN(c->audio_end - pos, (size_t)DECODE_WINDOW);
+        bool final = pos + len == c->audio_end;
+        uint8_t *p = c->s.data + pos;
+
+        int offset = 0;
+        bool resynced = need_resync || scanning || !frame_in_sync(p, len, &lock);
+        if (resynced)
+        {
+            scanning = true;
+            ResyncResult rs = mp3_resync(p, len, &lock, final, &offset);
+            if (rs != RESYNC_FOUND)
+            {
+                if (offset == 0)
+                    break;
+                pos += offset;
+                continue;
+            }
+            if (!need_resync)
+            {
+                d->resyncs++;
+                seek_index_abort(&d->index);
+            }
+            need_resync = false;
+            scanning = false;
+        }
+        pos += offset;
+        p += offset;
+        len -= offset;
+
+        if (c->info_frame_bytes > 0 && pos == c->audio_start)
+        {
+            pos += c->info_frame_bytes;
+            continue;
+        }
+
+        uint8_t *in = p;
+        int left = len;
+        int err = MP3Decode(dec, &in, &left, pcm, 0);
+        int consumed = (int)(in - p);
+        if (err == ERR_MP3_NONE || err == ERR_MP3_MAINDATA_UNDERFLOW)
+        {
+            Mp3FrameHeader h;
+            if (parse_frame_header(p, &h))
+            {
+                seek_index_add_frame(&d->index, (uint32_t)pos, h.sample_rate, h.samples_per_frame);
+                d->offsets[d->frames++] = (uint32_t)pos;
+            }
+            pos += consumed;
+        }
+        else if (err == ERR_MP3_INDATA_UNDERFLOW)
+        {
+            break; // Truncated last frame
+        }
+        else
+        {
+            d->decode_errors++;
+            pos += consumed > 0 ? consumed : 1;
+            need_resync = true;
+            seek_index_abort(&d->index);
+        }
+    }
+    MP3FreeDecoder(dec);
+}
+
+static bool index_matches(const SeekIndexBuilder *b, const Decoded *d, int sample_rate, const char *what,
+                          const char *name)
+{
+    bool ok = b->valid && b->total_frames == d->frames && b->sample_rate == (uint32_t)sample_rate &&
+              b->count == (d->frames + b->frames_per_entry - 1) / b->frames_per_entry;
+    for (uint32_t i = 0; ok && i < b->count; i++)
+        ok = b->offsets[i] == d->offsets[i * b->frames_per_entry];
+    CHECK(ok, "%s: %s index (valid %d, %u frames, %u entries of %u) differs from %u decoded frames", name, what,
+          b->valid, b->total_frames, b->count, b->frames_per_entry, d->frames);
+    return ok;
+}
+
+// Feed the whole file in chunks; max_chunk 0 = random sizes up to 9000 bytes
+static void feed_file(const Case *c, SeekIndexBuilder *b, size_t max_chunk, uint32_t *rng)
+{
+    seek_index_begin(b);
+    size_t pos = 0;
+    while (pos < c->s.len)
+    {
+        size_t n = max_chunk ? max_chunk : 1 + fixture_rand(rng) % 9000;
+        if (n > c->s.len - pos)
+            n = c->s.len - pos;
+        seek_index_feed(b, c->s.data + pos, n);
+        pos += n;
+    }
+    seek_index_end(b);
+}
+
+static void run_case(Case *c, int sample_rate, bool byte_feed, uint32_t *rng)
+{
+    Decoded d;
+    decode_reference(c, &d);
+
+    if (c->expect_index)
+    {
+        CHECK(d.resyncs == 0 && d.decode_errors == 0, "%s: playback saw %d resyncs, %d errors", c->name, d.resyncs,
+              d.decode_errors);
+        index_matches(&d.index, &d, sample_rate, "playback", c->name);
+    }
+    else
+    {
+        CHECK(!d.index.valid, "%s: playback kept an index after %d resyncs, %d errors", c->name, d.resyncs,
+              d.decode_errors);
+    }
+
+    size_t chunks[] = {0, 0, 0, 8192, 1};
+    for (size_t k = 0; k < sizeof(chunks) / sizeof(chunks[0]); k++)
+    {
+        if (chunks[k] == 1 && !byte_feed)
+            continue;
+        SeekIndexBuilder b;
+        feed_file(c, &b, chunks[k], rng);
+        char what[32];
+        snprintf(what, sizeof(what), "upload (chunk %zu)", chunks[k]);
+        if (d.index.valid)
+            index_matches(&b, &d, sample_rate, what, c->name);
+        else if (d.resyncs > 0)
+            CHECK(!b.valid, "%s: %s kept an index playback drops (%u frames)", c->name, what, b.total_frames);
+        seek_index_abort(&b);
+    }
+
+    printf("%-12s %7zu bytes %6u frames  index %s\n", c->name, c->s.len, d.frames,
+           d.index.valid ? "kept" : "dropped");
+    seek_index_abort(&d.index);
+    free(d.offsets);
+    fixture_free(&c->s);
+}
+
+int main(void)
+{
+    uint32_t rng = 0x12345678;
+
+    {
+        // CBR with an ID3v2 tag, an Info frame and an ID3v1 trailer
+        Case c = {"cbr", .expect_index = true};
+        FixtureFormat f = {0, 0, 2};
+        fixture_id3v2(&c.s, 3000, false, &rng);
+        c.audio_start = fixture_xing(&c.s, &f, 9, "Info", 400, 0);
+        c.info_frame_bytes = c.s.len - c.audio_start;
+        fixture_frames(&c.s, &f, 9, 400, true, &rng);
+        c.audio_end = c.s.len;
+        fixture_id3v1(&c.s);
+        run_case(&c, 44100, true, &rng);
+    }
+    {
+        // VBR behind a Xing frame; an APEv2 tag whose cover holds a confirming false sync
+        Case c = {"vbr-ape", .expect_index = true};
+        FixtureFormat f = {0, 1, 1};
+        c.audio_start = fixture_xing(&c.s, &f, 5, "Xing", 600, 0);
+        c.info_frame_bytes = c.s.len - c.audio_start;
+        fixture_frames(&c.s, &f, 0, 600, true, &rng);
+        c.audio_end = c.s.len;
+        fixture_apev2(&c.s, 2000, &f);
+        fixture_id3v1(&c.s);
+        run_case(&c, 48000, true, &rng);
+    }
+    {
+        // MPEG2: two ID3v2 tags, junk before the first frame, truncated last frame
+        Case c = {"lsf-trunc", .expect_index = true};
+        FixtureFormat f = {1, 0, 2};
+        fixture_id3v2(&c.s, 700, false, &rng);
+        fixture_id3v2(&c.s, 20000, true, &rng);
+        fixture_append_random(&c.s, 300, &rng);
+        c.audio_start = c.s.len;
+        fixture_frames(&c.s, &f, 0, 300, true, &rng);
+        c.s.len -= 50;
+        c.audio_end = c.s.len;
+        run_case(&c, 22050, true, &rng);
+    }
+    {
+        // Zero padding after the last frame: no frame follows, so sync loss is harmless
+        Case c = {"tail-zeros", .expect_index = true};
+        FixtureFormat f = {0, 2, 2};
+        c.audio_start = c.s.len;
+        fixture_frames(&c.s, &f, 11, 200, true, &rng);
+        fixture_append(&c.s, NULL, 700);
+        c.audio_end = c.s.len;
+        run_case(&c, 32000, true, &rng);
+    }
+    {
+        // Long 16 kHz stream of small frames: the table fills up and is decimated
+        // (helix is built with the 12-bit syncword, so no MPEG2.5 here)
+        Case c = {"decimated", .expect_index = true};
+        FixtureFormat f = {1, 2, 1};
+        fixture_id3v2(&c.s, 100, false, &rng);
+        c.audio_start = c.s.len;
+        fixture_frames(&c.s, &f, 1, SEEK_INDEX_MAX_ENTRIES * SEEK_INDEX_FRAMES_PER_ENTRY + 5000, false, &rng);
+        c.audio_end = c.s.len;
+        run_case(&c, 16000, false, &rng);
+    }
+    {
+        // A burst of garbage mid-stream: playback resyncs, so neither path keeps an index
+        Case c = {"garbage", .expect_index = false};
+        FixtureFormat f = {0, 0, 2};
+        c.audio_start = c.s.len;
+        fixture_frames(&c.s, &f, 0, 150, true, &rng);
+        fixture_append_random(&c.s, 900, &rng);
+        fixture_frames(&c.s, &f, 0, 150, true, &rng);
+        c.audio_end = c.s.len;
+        fixture_id3v1(&c.s);
+        run_case(&c, 44100, true, &rng);
+    }
+    {
+        // Frames cut short mid-stream: the next header is not where the length says
+        Case c = {"cut-frame", .expect_index = false};
+        FixtureFormat f = {1, 1, 1};
+        c.audio_start = c.s.len;
+        fixture_frames(&c.s, &f, 8, 120, true, &rng);
+        c.s.len -= 37;
+        fixture_frames(&c.s, &f, 8, 120, true, &rng);
+        c.audio_end = c.s.len;
+        run_case(&c, 24000, true, &rng);
+    }
+    {
+        // Intact headers but a frame that fails to decode: playback drops its index
+        Case c = {"bad-frame", .expect_index = false};
+        FixtureFormat f = {0, 0, 2};
+        c.audio_start = c.s.len;
+        fixture_frames(&c.s, &f, 9, 100, true, &rng);
+        size_t bad = fixture_frame(&c.s, &f, 9, 0, true, &rng);
+        c.s.data[bad + 4 + 2] |= 0x0F; // part2_3_length 4095 (side info bits 20..31):
+        c.s.data[bad + 4 + 3] = 0xFF;  // more bits than the frame has, ERR_MP3_INVALID_SCALEFACT
+        fixture_frames(&c.s, &f, 9, 100, true, &rng);
+        c.audio_end = c.s.len;
+        run_case(&c, 44100, false, &rng);
+    }
+
+    printf("seek index: %d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,401 @@
+// Stream info parsing from fixture bytes: Xing/Info (with TOC and LAME tag),
+// VBRI (with entry merging) and plain CBR first frames, the trailer scan, and
+// the seek/duration/trim arithmetic built on them. Expected values are worked
+// out from the byte layouts here, not from the code under test.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mp3_fixture.h"
+#include "mp3_frames.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                                                               \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            failures++;                                                                                                \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+            printf(__VA_ARGS__);                                                                                       \
+            printf("\n");                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+#define CHECK_EQ(a, b) CHECK((long long)(a) == (long long)(b), "%s = %lld, expected %lld", #a, (long long)(a), (long long)(b))
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void put_be16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+// MPEG1 Layer III, 128 kbps, 44.1 kHz, stereo, no padding: 417-byte frames
+static const uint8_t HDR_MPEG1_128[4] = {0xFF, 0xFB, 0x90, 0x04};
+#define FRAME_128_BYTES 417
+#define XING_AT_MPEG1_STEREO (4 + 32)
+
+// A probe window as probe_stream_info() hands it over: audio_start at buf[0]
+static void info_init(Mp3StreamInfo *info, uint32_t audio_start, uint32_t audio_end)
+{
+    memset(info, 0, sizeof(*info));
+    info->audio_start = audio_start;
+    info->audio_end = audio_end;
+    info->audio_bytes = audio_end - audio_start;
+}
+
+static void test_cbr(void)
+{
+    uint8_t buf[STREAM_PROBE_SIZE] = {0};
+    Mp3StreamInfo info;
+
+    // Junk before the header: audio_start moves to it
+    memcpy(buf + 5, HDR_MPEG1_128, 4);
+    info_init(&info, 1000, 1000 + 5 + 1000000);
+    CHECK(stream_info_parse(&info, buf, sizeof(buf)), "cbr: no header found");
+    CHECK_EQ(info.audio_start, 1005);
+    CHECK_EQ(info.audio_bytes, 1000000);
+    CHECK_EQ(info.bitrate_kbps, 128);
+    CHECK_EQ(info.sample_rate, 44100);
+    CHECK_EQ(info.samples_per_frame, 1152);
+    CHECK_EQ(info.info_frame_bytes, 0);
+    CHECK_EQ(info.total_frames, 0);
+    CHECK_EQ(stream_info_duration_ms(&info), 1000000 * 8 / 128); // 62500
+
+    uint32_t off = 0;
+    CHECK(stream_info_seek(&info, 30000, &off), "cbr: seek failed");
+    CHECK_EQ(off, 1005 + 30000 * 128 / 8);
+    CHECK(stream_info_seek(&info, 10000000, &off), "cbr: seek past end failed");
+    CHECK_EQ(off, 1005 + (62499 * 128 / 8)); // Clamped to the last millisecond
+
+    int32_t skip;
+    int64_t valid;
+    stream_info_trim(&info, &skip, &valid);
+    CHECK_EQ(skip, 0);
+    CHECK_EQ(valid, -1);
+
+    // No header anywhere in the window
+    memset(buf, 0, sizeof(buf));
+    info_init(&info, 0, 5000);
+    CHECK(!stream_info_parse(&info, buf, sizeof(buf)), "cbr: header found in zeros");
+}
+
+// Xing frame with every field: frames, bytes, TOC, quality, then a LAME tag
+static size_t build_xing(uint8_t *buf, const char *tag, uint32_t flags, uint32_t frames, uint32_t bytes,
+                         const uint8_t *toc, const char *encoder, uint16_t delay, uint16_t padding)
+{
+    memcpy(buf, HDR_MPEG1_128, 4);
+    uint8_t *p = buf + XING_AT_MPEG1_STEREO;
+    memcpy(p, tag, 4);
+    put_be32(p + 4, flags);
+    uint8_t *q = p + 8;
+    if (flags & 0x01)
+    {
+        put_be32(q, frames);
+        q += 4;
+    }
+    if (flags & 0x02)
+    {
+        put_be32(q, bytes);
+        q += 4;
+    }
+    if (flags & 0x04)
+    {
+        memcpy(q, toc, 100);
+        q += 100;
+    }
+    if (flags & 0x08)
+    {
+        put_be32(q, 57); // Quality
+        q += 4;
+    }
+    if (encoder)
+    {
+        // LAME tag: 9-byte version string, then delay/padding as 2 x 12 bits at +21
+        memcpy(q, encoder, 4);
+        memcpy(q + 4, "3.100", 5);
+        q[21] = delay >> 4;
+        q[22] = (uint8_t)((delay & 0x0F) << 4 | padding >> 8);
+        q[23] = padding & 0xFF;
+        q += 36;
+    }
+    return q - buf;
+}
+
+static void test_xing(void)
+{
+    uint8_t buf[STREAM_PROBE_SIZE] = {0};
+    uint8_t toc[100];
+    Mp3StreamInfo info;
+
+    // Curved TOC: toc[i] = 256 * (i/100)^2, so interpolation is not a straight line
+    for (int i = 0; i < 100; i++)
+        toc[i] = (uint8_t)(i * i * 256 / 10000);
+
+    build_xing(buf, "Xing", 0x0F, 5000, 4000000, toc, "LAME", 576, 1234);
+    info_init(&info, 2048, 2048 + 4100000);
+    CHECK(stream_info_parse(&info, buf, sizeof(buf)), "xing: no header");
+    CHECK_EQ(info.info_frame_bytes, FRAME_128_BYTES);
+    CHECK_EQ(info.total_frames, 5000);
+    CHECK_EQ(info.audio_bytes, 4000000); // The header's byte count wins when it fits
+    CHECK(info.has_xing_toc && memcmp(info.xing_toc, toc, 100) == 0, "xing: TOC not copied");
+    CHECK(info.has_lame, "xing: LAME tag missed");
+    CHECK_EQ(info.encoder_delay, 576);
+    CHECK_EQ(info.encoder_padding, 1234);
+
+    uint32_t duration = stream_info_duration_ms(&info);
+    CHECK_EQ(duration, 5000ull * 1152 * 1000 / 44100); // 130612
+
+    // TOC interpolation: 50.5 % lies halfway between toc[50] = 64 and toc[51] = 66
+    uint32_t off = 0;
+    uint32_t target = (uint32_t)(duration * 505ull / 1000);
+    uint32_t pct_x1000 = (uint32_t)((uint64_t)target * 100000 / duration);
+    CHECK_EQ(pct_x1000 / 1000, 50);
+    uint32_t frac = pct_x1000 % 1000;
+    CHECK(stream_info_seek(&info, target, &off), "xing: seek failed");
+    CHECK_EQ(off, 2048 + (uint64_t)(64 * 1000 + 2 * frac) * 4000000 / 256000);
+
+    // idx 99: the upper point is the end of the audio (256), not toc[100]
+    target = (uint32_t)(duration * 9950ull / 10000);
+    pct_x1000 = (uint32_t)((uint64_t)target * 100000 / duration);
+    CHECK_EQ(pct_x1000 / 1000, 99);
+    frac = pct_x1000 % 1000;
+    CHECK(stream_info_seek(&info, target, &off), "xing: seek at 99%% failed");
+    CHECK_EQ(off, 2048 + (uint64_t)(toc[99] * 1000 + (256 - toc[99]) * frac) * 4000000 / 256000);
+    CHECK(off < 2048 + 4000000, "xing: 99%% seek past the audio");
+
+    // Past the end clamps to the last millisecond, still inside the audio
+    CHECK(stream_info_seek(&info, duration + 5000, &off), "xing: seek past end failed");
+    CHECK(off < 2048 + 4000000 && off > 2048 + 3900000, "xing: end seek landed at %u", off);
+
+    int32_t skip;
+    int64_t valid;
+    stream_info_trim(&info, &skip, &valid);
+    CHECK_EQ(skip, 576 + MP3_DECODER_DELAY);
+    CHECK_EQ(valid, 5000 * 1152 - 576 - 1234);
+
+    // A byte count larger than the file is ignored
+    memset(buf, 0, sizeof(buf));
+    build_xing(buf, "Xing", 0x03, 100, 9000000, NULL, NULL, 0, 0);
+    info_init(&info, 0, 50000);
+    stream_info_parse(&info, buf, sizeof(buf));
+    CHECK_EQ(info.audio_bytes, 50000);
+    CHECK_EQ(info.total_frames, 100);
+    CHECK(!info.has_xing_toc && !info.has_lame, "xing: fields that are not there");
+
+    // TOC cut off by the end of the probe window: not used, and no LAME read past it
+    memset(buf, 0, sizeof(buf));
+    build_xing(buf, "Xing", 0x07, 100, 40000, toc, "LAME", 576, 1234);
+    info_init(&info, 0, 50000);
+    stream_info_parse(&info, buf, XING_AT_MPEG1_STEREO + 8 + 8 + 50);
+    CHECK(!info.has_xing_toc && !info.has_lame, "xing: truncated TOC used");
+    CHECK_EQ(info.total_frames, 100);
+
+    // CBR "Info" frame from ffmpeg: Lavf tag, no TOC; delay 0x0FFF and padding 0x0FFF
+    // use all 12 bits of each field
+    memset(buf, 0, sizeof(buf));
+    build_xing(buf, "Info", 0x0B, 2000, 0, NULL, "Lavf", 0x0FFF, 0x0FFF);
+    info_init(&info, 0, 2000 * FRAME_128_BYTES);
+    stream_info_parse(&info, buf, sizeof(buf));
+    CHECK_EQ(info.info_frame_bytes, FRAME_128_BYTES);
+    CHECK(info.has_lame, "info: Lavf tag missed");
+    CHECK_EQ(info.encoder_delay, 0x0FFF);
+    CHECK_EQ(info.encoder_padding, 0x0FFF);
+    stream_info_seek(&info, 1000, &off);
+    CHECK_EQ(off, 1000 * 128 / 8); // No TOC: the CBR estimate within audio_bytes
+
+    // Padding larger than the stream: trim keeps the delay, length unknown
+    memset(buf, 0, sizeof(buf));
+    build_xing(buf, "Info", 0x01, 1, 0, NULL, "LAME", 576, 4000);
+    info_init(&info, 0, 10000);
+    stream_info_parse(&info, buf, sizeof(buf));
+    int32_t skip2;
+    int64_t valid2;
+    stream_info_trim(&info, &skip2, &valid2);
+    CHECK_EQ(skip2, 576 + MP3_DECODER_DELAY);
+    CHECK_EQ(valid2, -1);
+}
+
+// VBRI header (Fraunhofer) at byte 36 of the first frame
+static void build_vbri(uint8_t *buf, uint32_t bytes, uint32_t frames, uint16_t entries, uint16_t scale,
+                       uint16_t entry_size, uint16_t frames_per_entry, const uint32_t *table)
+{
+    memcpy(buf, HDR_MPEG1_128, 4);
+    uint8_t *p = buf + FRAME_VBRI_OFFSET;
+    memcpy(p, "VBRI", 4);
+    put_be16(p + 4, 1);    // Version
+    put_be16(p + 6, 1105); // Delay
+    put_be16(p + 8, 75);   // Quality
+    put_be32(p + 10, bytes);
+    put_be32(p + 14, frames);
+    put_be16(p + 18, entries);
+    put_be16(p + 20, scale);
+    put_be16(p + 22, entry_size);
+    put_be16(p + 24, frames_per_entry);
+    uint8_t *q = p + 26;
+    for (int i = 0; i < entries; i++)
+        for (int b = entry_size - 1; b >= 0; b--)
+            *q++ = (uint8_t)(table[i] >> (8 * b));
+}
+
+static void test_vbri(void)
+{
+    uint8_t buf[STREAM_PROBE_SIZE] = {0};
+    uint32_t table[600];
+    Mp3StreamInfo info;
+
+    for (int i = 0; i < 600; i++)
+        table[i] = 300 + (i * 37) % 200; // Scaled by 2 below
+
+    // 100 entries: kept one to one
+    build_vbri(buf, 3000000, 10000, 100, 2, 2, 100, table);
+    info_init(&info, 500, 500 + 3100000);
+    CHECK(stream_info_parse(&info, buf, sizeof(buf)), "vbri: no header");
+    CHECK_EQ(info.info_frame_bytes, FRAME_128_BYTES);
+    CHECK_EQ(info.total_frames, 10000);
+    CHECK_EQ(info.audio_bytes, 3000000);
+    CHECK_EQ(info.vbri_entries, 100);
+    CHECK_EQ(info.vbri_frames_per_entry, 100);
+    uint32_t sum = 0;
+    bool ok = info.vbri_offsets[0] == 0;
+    for (int i = 0; i < 100; i++)
+    {
+        sum += table[i] * 2;
+        ok = ok && info.vbri_offsets[i + 1] == sum;
+    }
+    CHECK(ok, "vbri: cumulative offsets wrong");
+    CHECK(!info.has_lame, "vbri: LAME tag invented");
+
+    // Seek to frame 2550: entry 25, the sum of the first 25 table entries
+    uint32_t off = 0;
+    uint32_t target = (uint32_t)(2550ull * 1152 * 1000 / 44100) + 1;
+    CHECK(stream_info_seek(&info, target, &off), "vbri: seek failed");
+    CHECK_EQ(off, 500 + info.vbri_offsets[25]);
+
+    // 300 three-byte entries: merged in threes into 100 points
+    memset(buf, 0, sizeof(buf));
+    build_vbri(buf, 3000000, 30000, 300, 1, 3, 100, table);
+    info_init(&info, 0, 3100000);
+    stream_info_parse(&info, buf, sizeof(buf));
+    CHECK_EQ(info.vbri_entries, 100);
+    CHECK_EQ(info.vbri_frames_per_entry, 300);
+    sum = 0;
+    ok = true;
+    for (int i = 0; i < 300; i++)
+    {
+        sum += table[i];
+        if ((i + 1) % 3 == 0)
+            ok = ok && info.vbri_offsets[(i + 1) / 3] == sum;
+    }
+    CHECK(ok, "vbri: merged offsets wrong");
+
+    // 129 entries: pairs, the odd last entry is dropped
+    memset(buf, 0, sizeof(buf));
+    build_vbri(buf, 3000000, 12900, 129, 1, 2, 100, table);
+    info_init(&info, 0, 3100000);
+    stream_info_parse(&info, buf, sizeof(buf));
+    CHECK_EQ(info.vbri_entries, 64);
+    CHECK_EQ(info.vbri_frames_per_entry, 200);
+    CHECK_EQ(info.vbri_offsets[64], info.vbri_offsets[63] + table[126] + table[127]);
+
+    // Seeking past the last point stays on it
+    stream_info_seek(&info, stream_info_duration_ms(&info) - 1, &off);
+    CHECK_EQ(off, info.vbri_offsets[64]);
+
+    // Table cut off by the probe window: only complete entries are read
+    memset(buf, 0, sizeof(buf));
+    build_vbri(buf, 3000000, 10000, 100, 1, 4, 100, table);
+    info_init(&info, 0, 3100000);
+    stream_info_parse(&info, buf, FRAME_VBRI_OFFSET + 26 + 10 * 4 + 2);
+    CHECK_EQ(info.vbri_entries, 10);
+
+    // Bad entry size: totals still used, no table
+    memset(buf, 0, sizeof(buf));
+    build_vbri(buf, 3000000, 10000, 100, 1, 5, 100, table);
+    info_init(&info, 0, 3100000);
+    stream_info_parse(&info, buf, sizeof(buf));
+    CHECK_EQ(info.vbri_entries, 0);
+    CHECK_EQ(info.total_frames, 10000);
+}
+
+static void test_audio_end(void)
+{
+    uint32_t rng = 99;
+    FixtureFormat f = {0, 0, 2};
+
+    // Tail of: audio, APEv2 (header + items + footer), ID3v1
+    FixtureStream s = {0};
+    fixture_append_random(&s, 5000, &rng);
+    size_t ape_at = s.len;
+    fixture_apev2(&s, 1000, &f);
+    fixture_id3v1(&s);
+    CHECK_EQ(stream_info_audio_end(s.data + s.len - STREAM_TAIL_BYTES, s.len), ape_at);
+
+    // ID3v1 only
+    s.len = ape_at;
+    fixture_id3v1(&s);
+    CHECK_EQ(stream_info_audio_end(s.data + s.len - STREAM_TAIL_BYTES, s.len), ape_at);
+
+    // APEv2 only: its footer is the last 32 bytes
+    s.len = ape_at;
+    fixture_apev2(&s, 1000, &f);
+    CHECK_EQ(stream_info_audio_end(s.data + s.len - STREAM_TAIL_BYTES, s.len), ape_at);
+
+    // Neither
+    s.len = 5000;
+    CHECK_EQ(stream_info_audio_end(s.data + s.len - STREAM_TAIL_BYTES, s.len), 5000);
+    fixture_free(&s);
+}
+
+// The whole probe on a generated file, as probe_stream_info() walks it
+static void test_probe_file(void)
+{
+    uint32_t rng = 7;
+    FixtureFormat f = {0, 0, 2};
+    FixtureStream s = {0};
+    fixture_id3v2(&s, 5000, false, &rng);
+    fixture_id3v2(&s, 300, true, &rng);
+    size_t xing_at = fixture_xing(&s, &f, 9, "Xing", 250, 0);
+    fixture_frames(&s, &f, 0, 250, true, &rng);
+    size_t end_at = s.len;
+    fixture_apev2(&s, 600, &f);
+    fixture_id3v1(&s);
+
+    Mp3StreamInfo info;
+    memset(&info, 0, sizeof(info));
+    info.audio_end = stream_info_audio_end(s.data + s.len - STREAM_TAIL_BYTES, s.len);
+    for (int tags = 0; tags < 4; tags++)
+    {
+        uint32_t tag_size = id3v2_tag_size(s.data + info.audio_start);
+        if (tag_size == 0)
+            break;
+        info.audio_start += tag_size;
+    }
+    info.audio_bytes = info.audio_end - info.audio_start;
+    CHECK(stream_info_parse(&info, s.data + info.audio_start, STREAM_PROBE_SIZE), "probe: no header");
+    CHECK_EQ(info.audio_start, xing_at);
+    CHECK_EQ(info.audio_end, end_at);
+    CHECK_EQ(info.total_frames, 250);
+    CHECK_EQ(info.info_frame_bytes, FRAME_128_BYTES);
+    fixture_free(&s);
+}
+
+int main(void)
+{
+    test_cbr();
+    test_xing();
+    test_vbri();
+    test_audio_end();
+    test_probe_file();
+    printf("stream info: %d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+#include "fat_verify.h"
+
+#include <string.h>
+
+// Short name directory entry fields
+#define DIR_NAME 0
+#define DIR_FST_CLUS_HI 20 // FAT32 only, zero on FAT16
+#define DIR_FST_CLUS_LO 26
+#define DIR_FILE_SIZE 28
+#define DIR_ENTRY_SIZE 32
+
+static uint32_t read_le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t read_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// FAT entry of clst through a one-sector cache in sector (*cached: its sector
+// number, 0 = none). False on a read error.
+static bool fat_entry(const FatVolume *vol, FatSectorRead read, void *ctx, uint32_t clst, uint8_t *sector,
+                      uint32_t *cached, uint32_t *value)
+{
+    uint32_t bytes = vol->fat_bits / 8;
+    uint32_t s = vol->fat_start + clst * bytes / vol->sector_size;
+    if (*cached != s)
+    {
+        if (!read(ctx, s, sector))
+            return false;
+        *cached = s;
+    }
+    const uint8_t *p = sector + clst * bytes % vol->sector_size;
+    *value = vol->fat_bits == 32 ? read_le32(p) & 0x0FFFFFFF : read_le16(p);
+    return true;
+}
+
+FatVerifyResult fat_verify_file(const FatVolume *vol, FatSectorRead read, void *ctx, uint32_t dir_sect,
+                                uint32_t dir_offset, uint32_t first_cluster, uint32_t size, const uint8_t *tail,
+                                uint32_t tail_len, uint8_t *sector)
+{
+    if (dir_offset + DIR_ENTRY_SIZE > vol->sector_size)
+        return FAT_VERIFY_ENTRY;
+    if (!read(ctx, dir_sect, sector))
+        return FAT_VERIFY_IO;
+    const uint8_t *dir = sector + dir_offset;
+    uint32_t entry_cluster = read_le16(dir + DIR_FST_CLUS_LO);
+    if (vol->fat_bits == 32)
+        entry_cluster |= read_le16(dir + DIR_FST_CLUS_HI) << 16;
+    if (dir[DIR_NAME] == 0x00 || dir[DIR_NAME] == 0xE5 || entry_cluster != first_cluster ||
+        read_le32(dir + DIR_FILE_SIZE) != size)
+        return FAT_VERIFY_ENTRY;
+    if (size == 0)
+        return first_cluster == 0 ? FAT_VERIFY_OK : FAT_VERIFY_CHAIN;
+
+    // Exactly as many clusters as the size needs, then the end mark
+    uint32_t cluster_bytes = vol->sector_size * vol->cluster_sectors;
+    uint32_t need = (uint32_t)(((uint64_t)size + cluster_bytes - 1) / cluster_bytes);
+    uint32_t eoc = vol->fat_bits == 32 ? 0x0FFFFFF8 : 0xFFF8;
+    uint32_t cached = 0;
+    uint32_t clst = first_cluster;
+    for (uint32_t i = 0;; i++)
+    {
+        uint32_t next;
+        if (clst < 2 || clst >= vol->n_fatent)
+            return FAT_VERIFY_CHAIN;
+        if (!fat_entry(vol, read, ctx, clst, sector, &cached, &next))
+            return FAT_VERIFY_IO;
+        if (i + 1 == need)
+        {
+            if (next < eoc)
+                return FAT_VERIFY_CHAIN;
+            break;
+        }
+        clst = next;
+    }
+
+    // The last sector: the partial one sits in the file's buffer until f_sync
+    uint32_t last = size - 1;
+    uint32_t in_cluster = last % cluster_bytes / vol->sector_size;
+    if (!read(ctx, vol->data_start + (clst - 2) * vol->cluster_sectors + in_cluster, sector))
+        return FAT_VERIFY_IO;
+    uint32_t n = last % vol->sector_size + 1;
+    uint32_t k = n < tail_len ? n : tail_len;
+    if (memcmp(sector + n - k, tail + tail_len - k, k) != 0)
+        return FAT_VERIFY_DATA;
+    return FAT_VERIFY_OK;
+}
+
+const char *fat_verify_result_name(FatVerifyResult r)
+{
+    switch (r)
+    {
+    case FAT_VERIFY_OK:
+        return "ok";
+    case FAT_VERIFY_IO:
+        return "read error";
+    case FAT_VERIFY_ENTRY:
+        return "directory entry";
+    case FAT_VERIFY_CHAIN:
+        return "cluster chain";
+    case FAT_VERIFY_DATA:
+        return "last sector";
+    }
+    return "?";
+}
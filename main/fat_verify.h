@@ -0,0 +1,41 @@
+// Read-back check of a file committed on a FAT16/FAT32 volume, from the sectors
+// on the card rather than FATFS's window: used by the upload handler after
+// fsync()/fclose() and by the host power-cut test. No ESP-IDF dependencies; the
+// caller supplies the volume layout and a raw sector read.
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Volume layout as FATFS keeps it after the mount
+typedef struct
+{
+    uint32_t fat_start;       // First sector of the first FAT
+    uint32_t data_start;      // First sector of cluster 2
+    uint32_t n_fatent;        // Number of clusters + 2
+    uint32_t sector_size;
+    uint32_t cluster_sectors;
+    int fat_bits;             // 16 or 32
+} FatVolume;
+
+typedef bool (*FatSectorRead)(void *ctx, uint32_t sector, uint8_t *buf);
+
+typedef enum
+{
+    FAT_VERIFY_OK,
+    FAT_VERIFY_IO,    // A sector read failed
+    FAT_VERIFY_ENTRY, // Directory entry gone, or another size or first cluster
+    FAT_VERIFY_CHAIN, // Cluster chain too short, too long or through a bad cluster
+    FAT_VERIFY_DATA   // Last sector differs from the bytes written
+} FatVerifyResult;
+
+// Check that the directory entry at dir_offset of dir_sect records size bytes
+// starting at first_cluster, that the FAT chain from there has exactly the
+// clusters size needs before its end mark, and that the file's last sector
+// holds the end of tail (the last tail_len bytes written). sector is scratch
+// space of vol->sector_size bytes.
+FatVerifyResult fat_verify_file(const FatVolume *vol, FatSectorRead read, void *ctx, uint32_t dir_sect,
+                                uint32_t dir_offset, uint32_t first_cluster, uint32_t size, const uint8_t *tail,
+                                uint32_t tail_len, uint8_t *sector);
+
+const char *fat_verify_result_name(FatVerifyResult r);
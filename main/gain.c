@@ -0,0 +1,97 @@
+#include "gain.h"
+
+#include <string.h>
+
+// Q15 gain per volume step on a 0.4 dB/step curve (step 1 = -39.6 dB, 100 = unity, 0 = mute)
+static const int32_t volume_gain_q15[GAIN_VOLUME_STEPS + 1] = {
+        0,   343,   359,   376,   394,   413,   432,   452,   474,   496,
+      519,   544,   569,   596,   624,   654,   685,   717,   751,   786,
+      823,   862,   903,   945,   990,  1036,  1085,  1136,  1190,  1246,
+     1305,  1366,  1430,  1498,  1568,  1642,  1720,  1801,  1886,  1974,
+     2068,  2165,  2267,  2374,  2486,  2603,  2726,  2854,  2988,  3129,
+     3277,  3431,  3593,  3762,  3940,  4125,  4320,  4523,  4736,  4960,
+     5193,  5438,  5694,  5963,  6244,  6538,  6846,  7169,  7507,  7860,
+     8231,  8619,  9025,  9450,  9896, 10362, 10851, 11362, 11897, 12458,
+    13045, 13660, 14304, 14978, 15684, 16423, 17197, 18007, 18856, 19745,
+    20675, 21650, 22670, 23738, 24857, 26029, 27255, 28540, 29885, 31293,
+    32768,
+};
+
+int32_t gain_volume_q15(int vol)
+{
+    if (vol < 0)
+        vol = 0;
+    if (vol > GAIN_VOLUME_STEPS)
+        vol = GAIN_VOLUME_STEPS;
+    return volume_gain_q15[vol];
+}
+
+// Multiply-and-shift with rounding; no divide per sample
+void gain_apply_const(int16_t *samples, size_t count, int32_t gain)
+{
+    if (gain == GAIN_UNITY_Q15)
+        return;
+    if (gain == 0)
+    {
+        memset(samples, 0, count * sizeof(int16_t));
+        return;
+    }
+
+    size_t count4 = count / 4;
+    size_t remainder = count % 4;
+
+    while (count4--)
+    {
+        samples[0] = gain_mul_q15(samples[0], gain);
+        samples[1] = gain_mul_q15(samples[1], gain);
+        samples[2] = gain_mul_q15(samples[2], gain);
+        samples[3] = gain_mul_q15(samples[3], gain);
+        samples += 4;
+    }
+
+    while (remainder--)
+    {
+        *samples = gain_mul_q15(*samples, gain);
+        samples++;
+    }
+}
+
+void gain_ramp_reset(GainRamp *r, int32_t gain_q15)
+{
+    r->current = r->target = gain_q15 << GAIN_FRAC_BITS;
+    r->step = 0;
+}
+
+void gain_ramp_process(GainRamp *r, int16_t *samples, size_t count, int channels, int32_t target_q15)
+{
+    int32_t target = target_q15 << GAIN_FRAC_BITS;
+    int32_t cur = r->current;
+
+    if (target != r->target || (r->step == 0 && cur != target))
+    {
+        // Round the step away from zero so the ramp never takes more than ramp_frames
+        int32_t span = r->ramp_frames * channels;
+        int32_t diff = target - cur;
+        r->target = target;
+        r->step = diff > 0 ? (diff + span - 1) / span : -((span - 1 - diff) / span);
+    }
+
+    if (cur != target)
+    {
+        int32_t step = r->step;
+        while (count > 0 && cur != target)
+        {
+            cur += step;
+            if ((step > 0 && cur > target) || (step < 0 && cur < target))
+                cur = target;
+            *samples = gain_mul_q15(*samples, cur >> GAIN_FRAC_BITS);
+            samples++;
+            count--;
+        }
+        r->current = cur;
+        if (cur == target)
+            r->step = 0;
+    }
+
+    gain_apply_const(samples, count, cur >> GAIN_FRAC_BITS);
+}
@@ -0,0 +1,53 @@
+// Volume gain for the I2S feeder: Q15 gain per volume step and the
+// multiply-shift-saturate that applies it. No ESP-IDF dependencies; see host_test/.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// === Volume Gain ===
+#define GAIN_UNITY_Q15 32768
+#define GAIN_VOLUME_STEPS 100
+#define GAIN_DB_PER_STEP 0.4 // Step n is -0.4 * (100 - n) dB; step 0 is mute
+
+// Q15 gain for a volume step, clamped to 0..GAIN_VOLUME_STEPS
+int32_t gain_volume_q15(int vol);
+
+static inline int16_t gain_sat16(int32_t s)
+{
+    if (s > 32767)
+        return 32767;
+    if (s < -32768)
+        return -32768;
+    return (int16_t)s;
+}
+
+// One sample times a Q15 gain, rounded half up and saturated
+static inline int16_t gain_mul_q15(int16_t sample, int32_t gain)
+{
+    return gain_sat16((sample * gain + 16384) >> 15);
+}
+
+// Apply a constant Q15 gain in place: untouched at unity, zeroed at mute
+void gain_apply_const(int16_t *samples, size_t count, int32_t gain);
+
+// === Gain Ramp: linear moves between gains, used for volume changes and fades ===
+#define GAIN_RAMP_FRAMES_DEFAULT 1152 // One MP3 frame
+#define GAIN_FRAC_BITS 8              // Ramp state is Q15 gain << 8 for sub-step increments
+
+typedef struct
+{
+    int32_t current; // Q(15 + GAIN_FRAC_BITS); 0 = silent
+    int32_t target;  // Where the ramp in progress ends, same format
+    int32_t step;    // Per sample, fixed for the whole ramp; 0 = none in progress
+    int ramp_frames; // A ramp of any size ends within this many frames
+} GainRamp;
+
+// Jump to a gain without a ramp (e.g. silence before a track fades in)
+void gain_ramp_reset(GainRamp *r, int32_t gain_q15);
+
+// Apply the gain in place over interleaved samples, moving towards target_q15
+// by a fixed step per sample; flat stretches use the constant-gain path. The
+// step is set when the target changes, so a ramp is linear however the
+// samples are split across calls.
+void gain_ramp_process(GainRamp *r, int16_t *samples, size_t count, int channels, int32_t target_q15);
@@ -12,10 +12,17 @@
 #include "driver/sdspi_host.h"
 #include "driver/spi_common.h"
 #include "esp_vfs_fat.h"
+#include "ff.h"
+#include "diskio_impl.h"
+#include "diskio_sdmmc.h"
 #include "sdmmc_cmd.h"
 #include "u8g2.h"
 #include "u8g2_esp32_hal.h"
 #include "mp3dec.h"
+#include "fat_verify.h"
+#include "gain.h"
+#include "mp3_bench.h"
+#include "mp3_frames.h"
 #include "esp_pm.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
@@ -67,13 +74,16 @@ static const char *TAG = "MP3_PLAYER";
 
 // --- DEFINES FOR DYNAMIC SIZES ---
 #define MP3_BUF_SIZE_PLAYING (16 * 1024)
+#define MP3_BUF_MIRROR_PLAYING (2 * 1024) // >= one max-size MP3 frame (1441 bytes)
+#define PCM_BUF_SIZE_PLAYING (16 * 1024)
 #define UPLOAD_BUF_SIZE_WIFI (16 * 1024)
-#define RECV_BUF_SIZE_WIFI (16 * 1024)
+#define UPLOAD_HALF_SIZE (UPLOAD_BUF_SIZE_WIFI / 2) // Whole 4 KB FAT sectors: written straight from the buffer
 
 // Add these defines near WiFi configuration section
 #define DEFAULT_AP_SSID "MP3Player_Config"
 #define DEFAULT_AP_PASS "12345678"
 #define NVS_WIFI_NAMESPACE "wifi_config"
+#define NVS_PLAYER_NAMESPACE "player"
 #define MAX_SSID_LEN 32
 #define MAX_PASS_LEN 64
 
@@ -85,10 +95,11 @@ httpd_handle_t config_server = NULL;
 
 // === STATIC BUFFERS - Tránh fragmentation ===
 uint8_t *input_buffer = NULL;       // Allocated only during playback
-uint8_t *upload_buffer_ptr = NULL;  // Allocated only during WiFi
-uint8_t *receive_buffer_ptr = NULL; // Allocated only during WiFi
+size_t inputBufferSize = 0;         // Compressed ring size in input_buffer (plus the mirror)
+uint8_t *pcm_buffer = NULL;         // Allocated only during playback
+void *decoder_arena = NULL;         // Helix state, reused for every track (no per-track malloc)
+uint8_t *upload_buffer_ptr = NULL;  // Allocated only during WiFi: two halves, received into directly
 
-static size_t buffer_index = 0;
 static FILE *upload_file = NULL;
 static size_t total_received = 0;
 static int64_t upload_start_time = 0;
@@ -107,6 +118,10 @@ short output_buffer[PCM_FRAME_SAMPLES];
 
 u8g2_t u8g2;
 i2s_chan_handle_t tx_handle = NULL;
+#define I2S_DMA_DESC_NUM 8
+#define I2S_DMA_FRAME_NUM 1020
+int audioOutRate = 0;     // Format the I2S channel is currently configured for
+int audioOutChannels = 0;
 
 // Global variables
 TaskHandle_t playbackTaskHandle = NULL;
@@ -114,9 +129,17 @@ TaskHandle_t displayTaskHandle = NULL;
 volatile bool stopPlayback = false;
 volatile bool isPlayerActive = false; // Flag to tell us if play_file is using memory
 
-FILE *currentAudioFile = NULL;
+FIL *currentAudioFile = NULL;
 size_t currentFileSize = 0;
 size_t currentFilePosition = 0;
+uint32_t currentPositionMs = 0;      // Decoded position within the track
+uint32_t currentDurationMs = 0;      // 0 = unknown
+bool seekAvailable = false;          // Current track has a seek index or VBR/CBR header info
+volatile int32_t seekRequestMs = -1; // Set by the UI, consumed by play_file
+
+// Resume point (persisted in NVS when playback is stopped mid-track)
+char resumePath[256] = "";
+uint32_t resumePositionMs = 0;
 
 // Button Pin Configuration
 #define BTN_MENU 0
@@ -137,12 +160,13 @@ typedef enum
     MODE_PLAYING,
     MODE_MENU,
     MODE_PLAYLIST,
-    MODE_VOLUME
+    MODE_VOLUME,
+    MODE_SEEK
 } MenuMode;
 
 MenuMode currentMode = MODE_PLAYING;
 int menuSelection = 0;
-const int menuItems = 7;
+const int menuItems = 10;
 
 typedef enum
 {
@@ -153,6 +177,16 @@ typedef enum
 
 AutoPlayMode autoPlayMode = AUTOPLAY_ON;
 
+typedef enum
+{
+    LOWPOWER_OFF,  // Full stereo, full rate
+    LOWPOWER_AUTO, // Mono + half rate for tracks that look like speech (long, low bitrate)
+    LOWPOWER_MONO, // Mono downmix for every track
+    LOWPOWER_HALF  // Mono + half rate for every track
+} LowPowerMode;
+
+LowPowerMode lowPowerMode = LOWPOWER_OFF; // Applied at each track start
+
 // Playback state
 bool isPlaying = false;
 bool isPaused = false;
@@ -183,28 +217,65 @@ uint32_t playlistScrollStartTime = 0;
 int playlistScrollOffset = 0;
 uint32_t lastPlaylistScrollTime = 0;
 
-// Playlist structure
+// Playlist structure: packed records plus one string arena with every file and
+// folder name (relative to its folder, NUL-terminated). The display name is a
+// slice of the file name, the same bytes without the ".mp3" suffix.
+#define PLAYLIST_ROOT MOUNT_POINT "/"
+#define PLAYLIST_MAX_DEPTH 8 // Folder levels below the root that are scanned
 typedef struct
 {
-    char filepath[256];
-    char displayname[128];
-    char shortname[32];
+    uint32_t name_off;    // File name in playlistNames
+    uint8_t name_len;
+    uint8_t display_len;  // Leading bytes of the name shown in the UI
+    uint16_t folder;      // Index in playlistFolders
+    uint32_t file_size;
+    uint32_t mtime;       // FAT date << 16 | time
+    uint32_t duration_ms; // 0 = unknown until played
 } PlaylistItem;
 
+// Folder tree, in scan (depth-first) order: a folder's own tracks are
+// consecutive, and so are all tracks below it, so a folder is a track range
+typedef struct
+{
+    uint32_t name_off;    // Folder name in playlistNames ("" for the root)
+    uint8_t name_len;
+    uint8_t depth;        // 0 = root
+    uint16_t parent;
+    uint16_t first_child; // Subfolders are consecutive records
+    uint16_t child_count;
+    uint32_t first_track; // Tracks directly in this folder
+    uint32_t track_count;
+    uint32_t subtree_end; // One past the last track anywhere below this folder
+} PlaylistFolder;
+
 PlaylistItem *playlist = NULL;
 int playlistSize = 0;
 int playlistCapacity = 0;
+PlaylistFolder *playlistFolders = NULL;
+int playlistFolderCount = 0;
+int playlistFolderCapacity = 0;
+char *playlistNames = NULL;    // Bump-allocated string arena
+size_t playlistNamesUsed = 0;
+size_t playlistNamesCapacity = 0;
+
+// Playback queue: the track range autoplay walks (a folder, or everything)
+int queueFirst = 0;
+int queueEnd = -1; // -1 = whole playlist
 
 void show_ready_screen(int track_count);
 void show_playing_screen(void);
 void handle_buttons(void);
 void show_playlist_screen(void);
 void show_volume_screen(void);
+void show_seek_screen(void);
+void request_seek_relative(int32_t delta_ms);
 void show_loading_screen(const char *message);                 // Added
 void show_error_screen(const char *error, const char *detail); // Added
 void show_wifi_info_screen(void);                              // Added
 static httpd_handle_t start_webserver(void);                   // Added
-bool add_to_playlist(const char *filepath, const char *displayname);
+bool add_to_playlist(const char *name, int folder, uint32_t file_size, uint32_t mtime);
+bool fatfs_path(const char *path, char *out, size_t out_size);
+static bool i2s_send_overflow_cb(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx);
 static void wifi_event_handler(void *arg, esp_event_base_t event_base,
                                int32_t event_id, void *event_data);
 
@@ -320,6 +391,49 @@ esp_err_t clear_wifi_credentials(void)
     return err;
 }
 
+// Resume Point Storage Functions
+esp_err_t save_resume_point(const char *filepath, uint32_t position_ms)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_PLAYER_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK)
+        return err;
+
+    err = nvs_set_str(nvs_handle, "resume_path", filepath);
+    if (err == ESP_OK)
+        err = nvs_set_u32(nvs_handle, "resume_ms", position_ms);
+    if (err == ESP_OK)
+        err = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+
+    if (err == ESP_OK && position_ms > 0)
+    {
+        printf("Resume point saved: %s @ %lu ms\n", filepath, (unsigned long)position_ms);
+    }
+    return err;
+}
+
+esp_err_t load_resume_point(void)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_PLAYER_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (err != ESP_OK)
+        return err;
+
+    size_t path_len = sizeof(resumePath);
+    err = nvs_get_str(nvs_handle, "resume_path", resumePath, &path_len);
+    if (err == ESP_OK)
+        err = nvs_get_u32(nvs_handle, "resume_ms", &resumePositionMs);
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK)
+    {
+        resumePath[0] = '\0';
+        resumePositionMs = 0;
+    }
+    return err;
+}
+
 // URL decode helper function
 static void url_decode(char *dst, const char *src)
 {
@@ -598,6 +712,157 @@ static void wifi_init_sta_stored(void)
     esp_netif_set_default_netif(sta_netif);
 }
 
+// === SPSC Ring Buffer (lock-free, one producer task + one consumer task) ===
+// head/tail are free-running byte counters; size must be a power of two.
+// With mirror > 0 the buffer holds size + mirror bytes and the first `mirror`
+// bytes are duplicated past the end, so up to `mirror` bytes can always be
+// read contiguously across the wrap point.
+typedef struct
+{
+    uint8_t *buf;
+    size_t size;
+    size_t mirror;
+    size_t head;         // Total bytes written (producer only)
+    size_t tail;         // Total bytes read (consumer only)
+    volatile bool eof;   // Producer has no more data for this track
+    uint32_t underruns;  // Consumer found the ring empty before eof
+    size_t mirror_bytes; // Bytes copied to keep the mirrored tail in sync
+} SpscRing;
+
+static void ring_init(SpscRing *r, uint8_t *buf, size_t size, size_t mirror)
+{
+    r->buf = buf;
+    r->size = size;
+    r->mirror = mirror;
+    r->mirror_bytes = 0;
+    r->head = 0;
+    r->tail = 0;
+    r->eof = false;
+    r->underruns = 0;
+}
+
+// Drop buffered data (both sides must be parked); statistics are kept
+static void ring_flush(SpscRing *r)
+{
+    r->tail = r->head;
+    r->eof = false;
+}
+
+// Empty ring only (both sides parked): advance both counters so ring offsets
+// match file offsets modulo `align`, so reads into the ring can stay aligned
+static void ring_align_to(SpscRing *r, uint32_t file_offset, size_t align)
+{
+    size_t pos = r->head + ((file_offset - (uint32_t)r->head) & (align - 1));
+    r->head = pos;
+    r->tail = pos;
+}
+
+static inline size_t ring_used(const SpscRing *r)
+{
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+static inline size_t ring_free(const SpscRing *r)
+{
+    return r->size - ring_used(r);
+}
+
+// Producer: contiguous writable region at head
+static inline uint8_t *ring_write_ptr(SpscRing *r, size_t *contiguous)
+{
+    size_t offset = r->head & (r->size - 1);
+    size_t space = ring_free(r);
+    *contiguous = MIN(space, r->size - offset);
+    return r->buf + offset;
+}
+
+static inline void ring_commit(SpscRing *r, size_t n)
+{
+    size_t offset = r->head & (r->size - 1);
+    if (offset < r->mirror)
+    {
+        size_t n_mirror = MIN(n, r->mirror - offset);
+        memcpy(r->buf + r->size + offset, r->buf + offset, n_mirror);
+        r->mirror_bytes += n_mirror;
+    }
+    __atomic_store_n(&r->head, r->head + n, __ATOMIC_RELEASE);
+}
+
+// Consumer: contiguous readable region at tail (extends into the mirror)
+static inline uint8_t *ring_read_ptr(SpscRing *r, size_t *contiguous)
+{
+    size_t offset = r->tail & (r->size - 1);
+    size_t avail = ring_used(r);
+    *contiguous = MIN(avail, r->size - offset + r->mirror);
+    return r->buf + offset;
+}
+
+static inline void ring_consume(SpscRing *r, size_t n)
+{
+    __atomic_store_n(&r->tail, r->tail + n, __ATOMIC_RELEASE);
+}
+
+static size_t ring_write(SpscRing *r, const uint8_t *src, size_t len)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        size_t contiguous;
+        uint8_t *dst = ring_write_ptr(r, &contiguous);
+        if (contiguous == 0)
+            break;
+        size_t n = MIN(contiguous, len - done);
+        memcpy(dst, src + done, n);
+        ring_commit(r, n);
+        done += n;
+    }
+    return done;
+}
+
+static size_t ring_read(SpscRing *r, uint8_t *dst, size_t len)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        size_t contiguous;
+        uint8_t *src = ring_read_ptr(r, &contiguous);
+        if (contiguous == 0)
+            break;
+        size_t n = MIN(contiguous, len - done);
+        memcpy(dst + done, src, n);
+        ring_consume(r, n);
+        done += n;
+    }
+    return done;
+}
+
+// === Helper: Playback buffers (released while WiFi owns the heap) ===
+bool alloc_playback_buffers(void)
+{
+    if (input_buffer == NULL)
+    {
+        input_buffer = (uint8_t *)malloc(MP3_BUF_SIZE_PLAYING + MP3_BUF_MIRROR_PLAYING);
+        inputBufferSize = input_buffer ? MP3_BUF_SIZE_PLAYING : 0;
+    }
+    if (pcm_buffer == NULL)
+        pcm_buffer = (uint8_t *)malloc(PCM_BUF_SIZE_PLAYING);
+    if (decoder_arena == NULL)
+        decoder_arena = heap_caps_aligned_alloc(MP3_ARENA_ALIGN, MP3GetDecoderArenaSize(), MALLOC_CAP_8BIT);
+
+    return input_buffer != NULL && pcm_buffer != NULL && decoder_arena != NULL;
+}
+
+void free_playback_buffers(void)
+{
+    free(input_buffer);
+    input_buffer = NULL;
+    inputBufferSize = 0;
+    free(pcm_buffer);
+    pcm_buffer = NULL;
+    heap_caps_free(decoder_arena);
+    decoder_arena = NULL;
+}
+
 // === Helper: Xóa playlist cũ để giải phóng RAM ===
 void free_playlist(void)
 {
@@ -606,194 +871,960 @@ void free_playlist(void)
         free(playlist);
         playlist = NULL;
     }
+    free(playlistFolders);
+    playlistFolders = NULL;
+    free(playlistNames);
+    playlistNames = NULL;
     playlistSize = 0;
     playlistCapacity = 0;
+    playlistFolderCount = 0;
+    playlistFolderCapacity = 0;
+    playlistNamesUsed = 0;
+    playlistNamesCapacity = 0;
+    queueFirst = 0;
+    queueEnd = -1;
     printf("Playlist cleared.\n");
 }
 
-// === Helper: Quét thẻ nhớ tìm file MP3 ===
-void scan_mp3_files(void)
+// Folder path relative to PLAYLIST_ROOT, each component followed by '/' ("" for the root)
+static size_t playlist_folder_path(int folder, char *out, size_t out_size)
 {
-    printf("Scanning SD card for MP3 files...\n");
+    int chain[PLAYLIST_MAX_DEPTH];
+    int n = 0;
+    for (int f = folder; f > 0 && n < PLAYLIST_MAX_DEPTH; f = playlistFolders[f].parent)
+        chain[n++] = f;
+
+    size_t len = 0;
+    out[0] = '\0';
+    while (n-- > 0 && len < out_size)
+        len += snprintf(out + len, out_size - len, "%s/", playlistNames + playlistFolders[chain[n]].name_off);
+    return MIN(len, out_size - 1);
+}
 
-    // Đảm bảo playlist trống trước khi scan
-    free_playlist();
+// File name of a track, relative to its folder
+static inline const char *playlist_name(int track)
+{
+    return playlistNames + playlist[track].name_off;
+}
+
+// Full VFS path of a track (PLAYLIST_ROOT and folder names are stored once, not per track)
+void playlist_path(int track, char *out, size_t out_size)
+{
+    char folder[256];
+    playlist_folder_path(playlist[track].folder, folder, sizeof(folder));
+    snprintf(out, out_size, "%s%s%s", PLAYLIST_ROOT, folder, playlist_name(track));
+}
 
-    DIR *dir = opendir("/sdcard");
-    struct dirent *ent;
+void playlist_display(int track, char *out, size_t out_size)
+{
+    size_t len = MIN((size_t)playlist[track].display_len, out_size - 1);
+    memcpy(out, playlist_name(track), len);
+    out[len] = '\0';
+}
+
+// Records + arena in use, for the memory report
+static size_t playlist_bytes(void)
+{
+    return playlistSize * sizeof(PlaylistItem) + playlistFolderCount * sizeof(PlaylistFolder) + playlistNamesUsed;
+}
 
-    if (dir)
+// Give back the slack left by doubling, so the heap stays in one piece for WiFi
+static void playlist_shrink_to_fit(void)
+{
+    if (playlistSize > 0 && playlistCapacity > playlistSize)
     {
-        while ((ent = readdir(dir)) != NULL)
+        PlaylistItem *p = realloc(playlist, playlistSize * sizeof(PlaylistItem));
+        if (p)
         {
-            // Kiểm tra đuôi file .mp3 hoặc .MP3
-            if (strstr(ent->d_name, ".mp3") || strstr(ent->d_name, ".MP3"))
-            {
-                size_t name_len = strlen(ent->d_name);
-                // Giới hạn độ dài tên file để tránh tràn bộ nhớ
-                if (name_len < 240)
-                {
-                    char filepath[256];
-                    snprintf(filepath, sizeof(filepath), "/sdcard/%s", ent->d_name);
-
-                    char displayname[128];
-                    strncpy(displayname, ent->d_name, sizeof(displayname) - 1);
-                    displayname[sizeof(displayname) - 1] = '\0';
-
-                    // Xóa đuôi .mp3 khi hiển thị cho đẹp
-                    char *ext = strstr(displayname, ".mp3");
-                    if (ext)
-                        *ext = '\0';
-                    ext = strstr(displayname, ".MP3");
-                    if (ext)
-                        *ext = '\0';
-
-                    if (!add_to_playlist(filepath, displayname))
-                    {
-                        printf("Playlist full or RAM full!\n");
-                        break;
-                    }
-                }
-            }
+            playlist = p;
+            playlistCapacity = playlistSize;
         }
-        closedir(dir);
     }
-    else
+    if (playlistFolderCount > 0 && playlistFolderCapacity > playlistFolderCount)
     {
-        printf("Failed to open directory /sdcard\n");
+        PlaylistFolder *f = realloc(playlistFolders, playlistFolderCount * sizeof(PlaylistFolder));
+        if (f)
+        {
+            playlistFolders = f;
+            playlistFolderCapacity = playlistFolderCount;
+        }
+    }
+    if (playlistNamesUsed > 0 && playlistNamesCapacity > playlistNamesUsed)
+    {
+        char *n = realloc(playlistNames, playlistNamesUsed);
+        if (n)
+        {
+            playlistNames = n;
+            playlistNamesCapacity = playlistNamesUsed;
+        }
     }
-
-    printf("Scan finished. Found %d tracks.\n", playlistSize);
 }
 
-// === WiFi Event Handler ===
-static void wifi_event_handler(void *arg, esp_event_base_t event_base,
-                               int32_t event_id, void *event_data)
+// Copy a name into the arena; returns its offset, or -1 when out of memory
+static int32_t playlist_intern(const char *name, size_t len)
 {
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START)
-    {
-        esp_wifi_connect();
-    }
-    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
+    if (playlistNamesUsed + len + 1 > playlistNamesCapacity)
     {
-        esp_wifi_connect();
+        size_t newCapacity = MAX(playlistNamesCapacity * 2, playlistNamesUsed + len + 1);
+        newCapacity = MAX(newCapacity, 1024);
+        char *newNames = (char *)realloc(playlistNames, newCapacity);
+        if (newNames == NULL)
+            return -1;
+        playlistNames = newNames;
+        playlistNamesCapacity = newCapacity;
     }
-    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
+    int32_t off = playlistNamesUsed;
+    memcpy(playlistNames + off, name, len);
+    playlistNames[off + len] = '\0';
+    playlistNamesUsed += len + 1;
+    return off;
+}
+
+// Append a folder record below `parent`; returns its index, or -1
+static int playlist_add_folder(const char *name, int parent)
+{
+    size_t len = strlen(name);
+    if (len > UINT8_MAX || playlistFolderCount >= UINT16_MAX)
+        return -1;
+    if (playlistFolderCount >= playlistFolderCapacity)
     {
-        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
+        int newCapacity = playlistFolderCapacity ? playlistFolderCapacity * 2 : 16;
+        PlaylistFolder *newFolders = (PlaylistFolder *)realloc(playlistFolders, newCapacity * sizeof(PlaylistFolder));
+        if (newFolders == NULL)
+            return -1;
+        playlistFolders = newFolders;
+        playlistFolderCapacity = newCapacity;
     }
+    int32_t off = playlist_intern(name, len);
+    if (off < 0)
+        return -1;
+
+    int index = playlistFolderCount++;
+    PlaylistFolder *f = &playlistFolders[index];
+    memset(f, 0, sizeof(*f));
+    f->name_off = off;
+    f->name_len = len;
+    f->parent = parent;
+    f->depth = (index == 0) ? 0 : playlistFolders[parent].depth + 1;
+    f->first_track = f->subtree_end = playlistSize;
+    return index;
 }
 
-// === Helper: Flush buffer với error handling ===
-static inline esp_err_t flush_buffer_to_sd(FILE *file, const uint8_t *buffer, size_t size)
+static bool is_mp3_name(const char *name)
 {
-    if (size == 0)
-        return ESP_OK;
+    size_t len = strlen(name);
+    return len > 4 && strcasecmp(name + len - 4, ".mp3") == 0;
+}
 
-    size_t aligned_size = (size / 512) * 512;
-    size_t remainder = size % 512;
+// === Playlist Cache ===
+// The playlist is kept in PLAYLIST_CACHE_PATH as the header, the folder records,
+// the track records and the name arena back to back, so boot is four sequential
+// reads straight into the playlist instead of a directory walk. The header
+// stamps the volume: its serial number, free/total cluster counts, and a
+// fingerprint of the start of every cached folder (see playlist_dir_fingerprint).
+// Any file written or deleted elsewhere moves the cluster counts, a reformat
+// or another card changes the serial, and a rename or a same-size replacement
+// near the start of a folder changes the fingerprint; each forces a rescan.
+// Our own sidecar writes re-stamp it, and uploads/deletes from the web UI
+// remove the cache outright. What the stamp still cannot see (a change deeper
+// in a large folder) is caught per track when it is opened: a failed open, or
+// a size or mtime that differs from the record, drops the cache for the next
+// boot. The "Rescan" menu item drops it on demand.
+#define PLAYLIST_CACHE_PATH MOUNT_POINT "/.mp3idx"
+#define PLAYLIST_CACHE_MAGIC 0x534C504D // "MPLS" (".idx" sidecars are "MIDX")
+#define PLAYLIST_CACHE_VERSION 5
 
-    if (aligned_size > 0)
+typedef struct
+{
+    uint32_t free_clusters;
+    uint32_t total_clusters;
+    uint32_t volume_serial;   // Boot sector volume ID: new after a reformat
+    uint32_t dir_fingerprint; // Scanned entries in the first cluster of each folder
+} PlaylistCacheStamp;
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_size;     // sizeof(PlaylistItem)
+    uint16_t folder_size;    // sizeof(PlaylistFolder)
+    uint16_t folder_count;
+    uint32_t count;
+    uint32_t names_bytes;    // Name arena after the records
+    PlaylistCacheStamp stamp; // Taken after the cache was written
+} PlaylistCacheHeader;
+
+static bool playlistCacheValid = false; // Cache file matches the playlist in RAM
+static bool volumeSerialKnown = false;  // Read once per mount, see volume_serial()
+static uint32_t volumeSerial = 0;
+
+static uint32_t fnv1a(uint32_t h, const void *p, size_t n)
+{
+    const uint8_t *b = (const uint8_t *)p;
+    while (n--)
+        h = (h ^ *b++) * 16777619u;
+    return h;
+}
+
+// Volume ID from the boot sector. Read straight from the disk once per mount
+// (at boot, before playback starts), not on every stamp: the raw read bypasses
+// the FATFS lock the SD reader task relies on.
+static bool volume_serial(FATFS *fs, uint32_t *serial)
+{
+    if (!volumeSerialKnown)
     {
-        size_t written = fwrite(buffer, 1, aligned_size, file);
-        if (written != aligned_size)
+        BYTE *sect = malloc(FF_MAX_SS);
+        if (!sect || ff_disk_read(fs->pdrv, sect, fs->volbase, 1) != RES_OK)
         {
-            return ESP_FAIL;
+            free(sect);
+            return false;
         }
+        int at = fs->fs_type == FS_FAT32 ? 67 : 39; // BS_VolID32 / BS_VolID
+#if FF_FS_EXFAT
+        if (fs->fs_type == FS_EXFAT)
+            at = 100; // VolumeSerialNumber
+#endif
+        volumeSerial = sect[at] | (sect[at + 1] << 8) | (sect[at + 2] << 16) | ((uint32_t)sect[at + 3] << 24);
+        volumeSerialKnown = true;
+        free(sect);
     }
+    *serial = volumeSerial;
+    return true;
+}
 
-    if (remainder > 0)
+// Hash of what scan_folder() would see in the first cluster of every cached
+// folder: per folder the entry count, the newest date/time and the names. One
+// cluster per folder keeps boot far cheaper than a walk while catching renames
+// and replaced files the cluster counts miss; a folder that is gone fails.
+static bool playlist_dir_fingerprint(uint32_t *fingerprint)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < playlistFolderCount; i++)
     {
-        size_t written = fwrite(buffer + aligned_size, 1, remainder, file);
-        if (written != remainder)
+        char rel[256];
+        char vfs_path[300];
+        char dir_path[300];
+        FF_DIR dir;
+        size_t rel_len = playlist_folder_path(i, rel, sizeof(rel));
+        if (rel_len > 0)
+            rel[--rel_len] = '\0'; // FATFS wants no trailing separator
+        snprintf(vfs_path, sizeof(vfs_path), "%s%s", PLAYLIST_ROOT, rel);
+        if (!fatfs_path(vfs_path, dir_path, sizeof(dir_path)) || f_opendir(&dir, dir_path) != FR_OK)
+            return false;
+
+        uint32_t entries = 0, newest = 0;
+        FILINFO fno;
+        while (dir.clust == dir.obj.sclust && f_readdir(&dir, &fno) == FR_OK && fno.fname[0] != '\0')
         {
-            return ESP_FAIL;
+            if ((fno.fattrib & (AM_HID | AM_SYS)) || fno.fname[0] == '.' ||
+                !((fno.fattrib & AM_DIR) || is_mp3_name(fno.fname)))
+                continue;
+            entries++;
+            newest = MAX(newest, ((uint32_t)fno.fdate << 16) | fno.ftime);
+            h = fnv1a(h, fno.fname, strlen(fno.fname) + 1);
         }
+        f_closedir(&dir);
+        h = fnv1a(h, &entries, sizeof(entries));
+        h = fnv1a(h, &newest, sizeof(newest));
     }
+    *fingerprint = h;
+    return true;
+}
 
-    return ESP_OK;
+// Stamp of the card as it is now, for the folders of the playlist in RAM
+static bool playlist_cache_stamp(PlaylistCacheStamp *stamp)
+{
+    char drive[8];
+    FATFS *fs;
+    DWORD free_clust;
+    if (!fatfs_path(PLAYLIST_ROOT, drive, sizeof(drive)) || f_getfree(drive, &free_clust, &fs) != FR_OK)
+        return false;
+    memset(stamp, 0, sizeof(*stamp));
+    stamp->free_clusters = free_clust;
+    stamp->total_clusters = fs->n_fatent - 2;
+    return volume_serial(fs, &stamp->volume_serial) && playlist_dir_fingerprint(&stamp->dir_fingerprint);
 }
 
-// === Initialize WiFi with Performance Optimizations ===
-static void wifi_init_sta(void)
+void playlist_cache_invalidate(void)
 {
-    esp_netif_init();
-    esp_event_loop_create_default();
-    esp_netif_t *sta_netif = esp_netif_create_default_wifi_sta();
+    unlink(PLAYLIST_CACHE_PATH);
+    playlistCacheValid = false;
+}
 
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    esp_wifi_init(&cfg);
+// Rewrite only the header stamp: after our own writes to a card whose playlist is known
+void playlist_cache_restamp(void)
+{
+    if (!playlistCacheValid)
+        return;
 
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
-    esp_event_handler_instance_register(WIFI_EVENT,
-                                        ESP_EVENT_ANY_ID,
-                                        &wifi_event_handler,
-                                        NULL,
-                                        &instance_any_id);
-    esp_event_handler_instance_register(IP_EVENT,
-                                        IP_EVENT_STA_GOT_IP,
-                                        &wifi_event_handler,
-                                        NULL,
-                                        &instance_got_ip);
+    PlaylistCacheHeader hdr;
+    FILE *f = fopen(PLAYLIST_CACHE_PATH, "r+b");
+    bool ok = f && fread(&hdr, sizeof(hdr), 1, f) == 1 && playlist_cache_stamp(&hdr.stamp) &&
+              fseek(f, 0, SEEK_SET) == 0 && fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+    if (f)
+        fclose(f);
+    if (!ok)
+        playlist_cache_invalidate();
+}
 
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = WIFI_SSID,
-            .password = WIFI_PASS,
-            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
-        },
-    };
+// Record a duration learned during playback; only the 4 bytes of its record change
+void playlist_cache_set_duration(int track, uint32_t duration_ms)
+{
+    if (track < 0 || track >= playlistSize || duration_ms == 0 || playlist[track].duration_ms == duration_ms)
+        return;
+    playlist[track].duration_ms = duration_ms;
+    if (!playlistCacheValid)
+        return;
 
-    esp_wifi_set_mode(WIFI_MODE_STA);
-    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    FILE *f = fopen(PLAYLIST_CACHE_PATH, "r+b");
+    long pos = sizeof(PlaylistCacheHeader) + playlistFolderCount * sizeof(PlaylistFolder) +
+               track * sizeof(PlaylistItem) + offsetof(PlaylistItem, duration_ms);
+    bool ok = f && fseek(f, pos, SEEK_SET) == 0 && fwrite(&duration_ms, sizeof(duration_ms), 1, f) == 1;
+    if (f)
+        fclose(f);
+    if (!ok)
+        playlist_cache_invalidate();
+}
 
-    esp_wifi_set_ps(WIFI_PS_NONE);
-    esp_wifi_set_bandwidth(WIFI_IF_STA, WIFI_BW_HT40);
-    esp_wifi_set_max_tx_power(84);
+// Lazy check of a record against the card, once its file is open: refresh it
+// and drop the cache if the file changed behind the stamp's back
+void playlist_cache_verify(int track, uint32_t file_size)
+{
+    if (track < 0 || track >= playlistSize)
+        return;
 
-    esp_wifi_start();
+    PlaylistItem *item = &playlist[track];
+    char path[256];
+    char ff_path[300];
+    FILINFO fno;
+    uint32_t mtime = item->mtime;
+    playlist_path(track, path, sizeof(path));
+    if (fatfs_path(path, ff_path, sizeof(ff_path)) && f_stat(ff_path, &fno) == FR_OK)
+        mtime = ((uint32_t)fno.fdate << 16) | fno.ftime;
+    if (file_size == item->file_size && mtime == item->mtime)
+        return;
 
-    esp_netif_set_default_netif(sta_netif);
+    printf("Playlist: %s changed on the card (%lu -> %lu bytes), cache dropped\n", path,
+           (unsigned long)item->file_size, (unsigned long)file_size);
+    item->file_size = file_size;
+    item->mtime = mtime;
+    item->duration_ms = 0;
+    playlist_cache_invalidate();
 }
 
-bool add_to_playlist(const char *filepath, const char *displayname)
+// Every record must point at a terminated name inside the arena and at sane ranges
+static bool playlist_cache_check(uint32_t names_bytes)
 {
-    if (playlistSize >= playlistCapacity)
+#define NAME_OK(off, len) ((size_t)(off) + (len) < names_bytes && playlistNames[(off) + (len)] == '\0')
+    for (int i = 0; i < playlistFolderCount; i++)
     {
-        int newCapacity = playlistCapacity + 20;
-        PlaylistItem *newPlaylist = (PlaylistItem *)realloc(playlist, newCapacity * sizeof(PlaylistItem));
-
-        if (newPlaylist == NULL)
-        {
+        const PlaylistFolder *f = &playlistFolders[i];
+        if (!NAME_OK(f->name_off, f->name_len) || (i > 0 && f->parent >= i) ||
+            f->first_child + f->child_count > playlistFolderCount || f->depth >= PLAYLIST_MAX_DEPTH ||
+            f->first_track + f->track_count > f->subtree_end || f->subtree_end > (uint32_t)playlistSize)
+            return false;
+    }
+    for (int i = 0; i < playlistSize; i++)
+    {
+        const PlaylistItem *item = &playlist[i];
+        if (!NAME_OK(item->name_off, item->name_len) || item->display_len > item->name_len ||
+            item->folder >= playlistFolderCount)
             return false;
-        }
-
-        playlist = newPlaylist;
-        playlistCapacity = newCapacity;
     }
+    return true;
+#undef NAME_OK
+}
 
-    strncpy(playlist[playlistSize].filepath, filepath, sizeof(playlist[playlistSize].filepath) - 1);
-    playlist[playlistSize].filepath[sizeof(playlist[playlistSize].filepath) - 1] = '\0';
+static bool playlist_cache_load(void)
+{
+    FILE *f = fopen(PLAYLIST_CACHE_PATH, "rb");
+    if (!f)
+        return false;
+    setvbuf(f, NULL, _IONBF, 0); // Large reads go straight into the playlist
 
-    strncpy(playlist[playlistSize].displayname, displayname, sizeof(playlist[playlistSize].displayname) - 1);
-    playlist[playlistSize].displayname[sizeof(playlist[playlistSize].displayname) - 1] = '\0';
+    PlaylistCacheHeader hdr;
+    PlaylistCacheStamp now;
+    bool ok = fread(&hdr, sizeof(hdr), 1, f) == 1 && hdr.magic == PLAYLIST_CACHE_MAGIC &&
+              hdr.version == PLAYLIST_CACHE_VERSION && hdr.entry_size == sizeof(PlaylistItem) &&
+              hdr.folder_size == sizeof(PlaylistFolder) && hdr.folder_count > 0 && hdr.names_bytes > 0;
 
-    playlistSize++;
+    if (ok)
+    {
+        // Exact-size allocations, nothing to grow or copy
+        playlistFolders = malloc(hdr.folder_count * sizeof(PlaylistFolder));
+        playlist = hdr.count ? malloc(hdr.count * sizeof(PlaylistItem)) : NULL;
+        playlistNames = malloc(hdr.names_bytes);
+        ok = playlistFolders && (playlist || !hdr.count) && playlistNames &&
+             fread(playlistFolders, sizeof(PlaylistFolder), hdr.folder_count, f) == hdr.folder_count &&
+             fread(playlist, sizeof(PlaylistItem), hdr.count, f) == hdr.count &&
+             fread(playlistNames, 1, hdr.names_bytes, f) == hdr.names_bytes;
+        playlistFolderCount = playlistFolderCapacity = playlistFolders ? hdr.folder_count : 0;
+        playlistSize = playlistCapacity = playlist ? hdr.count : 0;
+        playlistNamesUsed = playlistNamesCapacity = playlistNames ? hdr.names_bytes : 0;
+    }
+    fclose(f);
+
+    // The fingerprint walks the cached folders, so the stamp is checked last
+    if (!ok || !playlist_cache_check(hdr.names_bytes) || !playlist_cache_stamp(&now) ||
+        memcmp(&now, &hdr.stamp, sizeof(now)) != 0)
+    {
+        free_playlist();
+        return false;
+    }
+    playlistCacheValid = true;
     return true;
 }
 
-void vietnamese_to_ascii(const char *input, char *output, size_t output_size)
+static void playlist_cache_save(void)
 {
-    size_t in_idx = 0;
-    size_t out_idx = 0;
-    size_t input_len = strlen(input);
+    FILE *f = fopen(PLAYLIST_CACHE_PATH, "wb");
+    if (!f)
+        return;
+    setvbuf(f, NULL, _IONBF, 0);
+
+    PlaylistCacheHeader hdr = {
+        .magic = PLAYLIST_CACHE_MAGIC,
+        .version = PLAYLIST_CACHE_VERSION,
+        .entry_size = sizeof(PlaylistItem),
+        .folder_size = sizeof(PlaylistFolder),
+        .folder_count = playlistFolderCount,
+        .count = playlistSize,
+        .names_bytes = playlistNamesUsed,
+    };
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+              fwrite(playlistFolders, sizeof(PlaylistFolder), playlistFolderCount, f) == (size_t)playlistFolderCount &&
+              fwrite(playlist, sizeof(PlaylistItem), playlistSize, f) == (size_t)playlistSize &&
+              fwrite(playlistNames, 1, playlistNamesUsed, f) == playlistNamesUsed;
+    fclose(f);
 
-    while (in_idx < input_len && out_idx < output_size - 1)
+    // Stamp last: writing the cache itself moves the free cluster count
+    playlistCacheValid = ok;
+    if (ok)
     {
-        unsigned char c = input[in_idx];
+        f = fopen(PLAYLIST_CACHE_PATH, "r+b");
+        ok = f && playlist_cache_stamp(&hdr.stamp) && fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+        if (f)
+            fclose(f);
+    }
+    if (!ok)
+        playlist_cache_invalidate();
+}
 
-        if (c < 0x80)
+// === Helper: Quét thẻ nhớ tìm file MP3 ===
+// Folder walk on FATFS: one f_readdir per entry gives name, size and mtime
+// together (a VFS readdir + stat would search the directory per file). Folders
+// are visited depth-first from a fixed PLAYLIST_MAX_DEPTH stack of
+// (folder, next child) pairs instead of recursion, so it runs on any task
+// stack, and the scan sleeps a tick every SCAN_YIELD_ENTRIES entries.
+#define SCAN_YIELD_ENTRIES 32
+
+static uint32_t scanEntries = 0;
+static size_t scanPeakHeapUse = 0;
+static size_t scanFreeHeapStart = 0;
+static uint32_t scanProgressMs = 0;
+
+// Read one folder: its tracks become consecutive records and its subfolders
+// consecutive folder records
+static void scan_folder(int folder)
+{
+    char rel[256];
+    size_t rel_len = playlist_folder_path(folder, rel, sizeof(rel));
+    if (rel_len > 0)
+        rel[--rel_len] = '\0'; // FATFS wants no trailing separator
+
+    char vfs_path[300];
+    char dir_path[300];
+    FF_DIR dir;
+    snprintf(vfs_path, sizeof(vfs_path), "%s%s", PLAYLIST_ROOT, rel);
+    if (!fatfs_path(vfs_path, dir_path, sizeof(dir_path)) || f_opendir(&dir, dir_path) != FR_OK)
+    {
+        printf("Failed to open directory %s\n", vfs_path);
+        return;
+    }
+
+    int first_track = playlistSize;
+    int first_child = playlistFolderCount;
+    bool descend = playlistFolders[folder].depth + 1 < PLAYLIST_MAX_DEPTH;
+    FILINFO fno;
+    while (f_readdir(&dir, &fno) == FR_OK && fno.fname[0] != '\0')
+    {
+        if (++scanEntries % SCAN_YIELD_ENTRIES == 0)
+            vTaskDelay(1);
+
+        // Giới hạn độ dài tên file để tránh tràn bộ nhớ: the full path must fit in 256 bytes
+        size_t len = strlen(fno.fname);
+        if ((fno.fattrib & (AM_HID | AM_SYS)) || fno.fname[0] == '.' || rel_len + len + 16 >= 240)
+            continue;
+
+        if (fno.fattrib & AM_DIR)
+        {
+            if (descend && playlist_add_folder(fno.fname, folder) < 0)
+                break;
+        }
+        else if (is_mp3_name(fno.fname))
+        {
+            if (!add_to_playlist(fno.fname, folder, fno.fsize, ((uint32_t)fno.fdate << 16) | fno.ftime))
+            {
+                printf("Playlist full or RAM full!\n");
+                break;
+            }
+        }
+    }
+    f_closedir(&dir);
+
+    PlaylistFolder *f = &playlistFolders[folder];
+    f->first_track = first_track;
+    f->track_count = playlistSize - first_track;
+    f->subtree_end = playlistSize;
+    f->first_child = first_child;
+    f->child_count = playlistFolderCount - first_child;
+
+    size_t free_now = esp_get_free_heap_size();
+    if (scanFreeHeapStart > free_now)
+        scanPeakHeapUse = MAX(scanPeakHeapUse, scanFreeHeapStart - free_now);
+
+    uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    if (now - scanProgressMs >= 250)
+    {
+        char msg[32];
+        snprintf(msg, sizeof(msg), "Scanning %d", playlistSize);
+        show_loading_screen(msg);
+        scanProgressMs = now;
+    }
+}
+
+static void scan_mp3_dir(void)
+{
+    struct
+    {
+        uint16_t folder;
+        uint16_t next_child;
+    } stack[PLAYLIST_MAX_DEPTH];
+    int sp = 0;
+
+    scanEntries = 0;
+    scanPeakHeapUse = 0;
+    scanFreeHeapStart = esp_get_free_heap_size();
+    if (playlist_add_folder("", 0) != 0)
+        return;
+    scan_folder(0);
+    stack[sp].folder = 0;
+    stack[sp++].next_child = playlistFolders[0].first_child;
+
+    // Depth-first: a folder's subtree is finished before its next sibling starts,
+    // so every subtree is one consecutive track range
+    while (sp > 0)
+    {
+        const PlaylistFolder *top = &playlistFolders[stack[sp - 1].folder];
+        if (stack[sp - 1].next_child >= top->first_child + top->child_count)
+        {
+            sp--;
+            continue;
+        }
+        int child = stack[sp - 1].next_child++;
+        scan_folder(child);
+        if (playlistFolders[child].child_count > 0 && sp < PLAYLIST_MAX_DEPTH)
+        {
+            stack[sp].folder = child;
+            stack[sp++].next_child = playlistFolders[child].first_child;
+        }
+    }
+
+    // Children come after their parent, so one backwards pass closes every subtree
+    for (int i = playlistFolderCount - 1; i > 0; i--)
+    {
+        PlaylistFolder *parent = &playlistFolders[playlistFolders[i].parent];
+        parent->subtree_end = MAX(parent->subtree_end, playlistFolders[i].subtree_end);
+    }
+    playlist_shrink_to_fit();
+}
+
+void scan_mp3_files(void)
+{
+    int64_t t0 = esp_timer_get_time();
+
+    // Đảm bảo playlist trống trước khi scan
+    free_playlist();
+
+    if (playlist_cache_load())
+    {
+        printf("Playlist: %d tracks in %d folders from cache in %lu ms\n", playlistSize, playlistFolderCount,
+               (unsigned long)((esp_timer_get_time() - t0) / 1000));
+    }
+    else
+    {
+        printf("Scanning SD card for MP3 files...\n");
+        scan_mp3_dir();
+        playlist_cache_save();
+        printf("Scan finished. Found %d tracks in %d folders in %lu ms (peak heap %u bytes).\n", playlistSize,
+               playlistFolderCount, (unsigned long)((esp_timer_get_time() - t0) / 1000), (unsigned)scanPeakHeapUse);
+    }
+
+    if (playlistSize > 0)
+    {
+        size_t per_track = playlist_bytes() / playlistSize;
+        size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+        printf("Playlist RAM: %u bytes, %u per track; free heap %lu fits ~%u more\n",
+               (unsigned)playlist_bytes(), (unsigned)per_track,
+               (unsigned long)esp_get_free_heap_size(), (unsigned)(largest / per_track));
+    }
+}
+
+// === Playlist Journal ===
+// Uploads and deletes from the web UI are logged here while WiFi is up, and
+// playlist_apply_journal() patches the playlist in place when it stops: one
+// f_stat per changed file instead of a walk of the whole card. The web UI only
+// writes to MOUNT_POINT itself, so only the root folder's tracks change. A file
+// touched twice keeps one entry with its last operation; if the journal
+// overflows the change set is unknown and the caller rescans instead.
+#define PLAYLIST_JOURNAL_MAX 32
+
+typedef enum
+{
+    JOURNAL_ADD,
+    JOURNAL_REMOVE
+} JournalOp;
+
+typedef struct
+{
+    uint8_t op;
+    uint32_t duration_ms; // From the upload's seek index, 0 = unknown
+    char name[64];        // Relative to PLAYLIST_ROOT
+} JournalEntry;
+
+static JournalEntry playlistJournal[PLAYLIST_JOURNAL_MAX];
+static int playlistJournalCount = 0;
+static bool playlistJournalOverflow = false;
+
+void playlist_journal_record(JournalOp op, const char *name, uint32_t duration_ms)
+{
+    if (!is_mp3_name(name))
+        return; // Not a track, the playlist does not change
+
+    int i = 0;
+    while (i < playlistJournalCount && strcasecmp(playlistJournal[i].name, name) != 0)
+        i++;
+    if (i == playlistJournalCount)
+    {
+        if (i >= PLAYLIST_JOURNAL_MAX || strlen(name) >= sizeof(playlistJournal[i].name))
+        {
+            playlistJournalOverflow = true;
+            return;
+        }
+        strcpy(playlistJournal[i].name, name);
+        playlistJournalCount++;
+    }
+    playlistJournal[i].op = op;
+    playlistJournal[i].duration_ms = duration_ms;
+}
+
+// Track of `folder` with this file name (FAT names are case-insensitive), or -1
+static int playlist_find(int folder, const char *name)
+{
+    const PlaylistFolder *f = &playlistFolders[folder];
+    for (uint32_t i = f->first_track; i < f->first_track + f->track_count; i++)
+    {
+        if (strcasecmp(playlist_name(i), name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Track with this full VFS path, or -1
+int playlist_find_path(const char *path)
+{
+    for (int i = 0; i < playlistSize; i++)
+    {
+        char track_path[256];
+        playlist_path(i, track_path, sizeof(track_path));
+        if (strcmp(track_path, path) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// `ancestor` is `folder` or one of its parents
+static bool playlist_folder_within(int ancestor, int folder)
+{
+    for (int f = folder;; f = playlistFolders[f].parent)
+    {
+        if (f == ancestor)
+            return true;
+        if (f == 0)
+            return false;
+    }
+}
+
+// A record was inserted (delta = 1) or removed (delta = -1) at `pos` among the
+// tracks of `folder`: ranges that contain it grow or shrink, later ones move
+static void playlist_shift_ranges(int folder, int pos, int delta)
+{
+    for (int i = 0; i < playlistFolderCount; i++)
+    {
+        PlaylistFolder *f = &playlistFolders[i];
+        if (playlist_folder_within(i, folder))
+        {
+            f->subtree_end += delta;
+        }
+        else if ((int)f->first_track > pos || (delta > 0 && (int)f->first_track == pos))
+        {
+            f->first_track += delta;
+            f->subtree_end += delta;
+        }
+    }
+    playlistFolders[folder].track_count += delta;
+}
+
+static void playlist_remove(int track)
+{
+    int folder = playlist[track].folder;
+    memmove(&playlist[track], &playlist[track + 1], (playlistSize - track - 1) * sizeof(PlaylistItem));
+    playlistSize--;
+    playlist_shift_ranges(folder, track, -1);
+}
+
+// Append a track after the folder's own tracks; returns its index, or -1
+static int playlist_insert(int folder, const char *name)
+{
+    if (!add_to_playlist(name, folder, 0, 0))
+        return -1;
+
+    int pos = playlistFolders[folder].first_track + playlistFolders[folder].track_count;
+    PlaylistItem item = playlist[playlistSize - 1];
+    memmove(&playlist[pos + 1], &playlist[pos], (playlistSize - 1 - pos) * sizeof(PlaylistItem));
+    playlist[pos] = item;
+    playlist_shift_ranges(folder, pos, 1);
+    return pos;
+}
+
+// Rebuild the arena without the names of removed tracks (kept as is if RAM is short)
+static void playlist_compact_names(void)
+{
+    size_t used = 0;
+    for (int i = 0; i < playlistFolderCount; i++)
+        used += playlistFolders[i].name_len + 1;
+    for (int i = 0; i < playlistSize; i++)
+        used += playlist[i].name_len + 1;
+    if (used == playlistNamesUsed)
+        return;
+
+    char *names = (char *)malloc(used);
+    if (names == NULL)
+        return;
+    size_t off = 0;
+    for (int i = 0; i < playlistFolderCount; i++)
+    {
+        memcpy(names + off, playlistNames + playlistFolders[i].name_off, playlistFolders[i].name_len + 1);
+        playlistFolders[i].name_off = off;
+        off += playlistFolders[i].name_len + 1;
+    }
+    for (int i = 0; i < playlistSize; i++)
+    {
+        memcpy(names + off, playlistNames + playlist[i].name_off, playlist[i].name_len + 1);
+        playlist[i].name_off = off;
+        off += playlist[i].name_len + 1;
+    }
+    free(playlistNames);
+    playlistNames = names;
+    playlistNamesUsed = playlistNamesCapacity = used;
+}
+
+// Patch the playlist with the journal and save the cache. Only added or
+// replaced files are looked at; false means the playlist must be rescanned.
+bool playlist_apply_journal(void)
+{
+    bool ok = !playlistJournalOverflow && playlistFolderCount > 0;
+    int added = 0, removed = 0;
+
+    for (int i = 0; ok && i < playlistJournalCount; i++)
+    {
+        const JournalEntry *e = &playlistJournal[i];
+        int track = playlist_find(0, e->name);
+
+        char path[300];
+        char ff_path[300];
+        FILINFO fno;
+        snprintf(path, sizeof(path), "%s%s", PLAYLIST_ROOT, e->name);
+        bool exists = e->op == JOURNAL_ADD && fatfs_path(path, ff_path, sizeof(ff_path)) &&
+                      f_stat(ff_path, &fno) == FR_OK && !(fno.fattrib & AM_DIR);
+        if (!exists)
+        {
+            // Deleted, or an upload that did not leave a file behind
+            if (track >= 0)
+            {
+                playlist_remove(track);
+                removed++;
+            }
+            continue;
+        }
+
+        if (track < 0)
+        {
+            track = playlist_insert(0, e->name);
+            ok = track >= 0;
+            if (!ok)
+                break;
+            added++;
+        }
+        playlist[track].file_size = fno.fsize;
+        playlist[track].mtime = ((uint32_t)fno.fdate << 16) | fno.ftime;
+        playlist[track].duration_ms = e->duration_ms;
+    }
+
+    playlistJournalCount = 0;
+    playlistJournalOverflow = false;
+    if (!ok)
+        return false;
+
+    playlist_compact_names();
+    playlist_shrink_to_fit();
+    playlist_cache_save();
+    printf("Playlist patched: +%d -%d, %d tracks\n", added, removed, playlistSize);
+    return true;
+}
+
+// === WiFi Event Handler ===
+static void wifi_event_handler(void *arg, esp_event_base_t event_base,
+                               int32_t event_id, void *event_data)
+{
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START)
+    {
+        esp_wifi_connect();
+    }
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
+    {
+        esp_wifi_connect();
+    }
+    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
+    {
+        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
+    }
+}
+
+// === Helper: Flush buffer với error handling ===
+static inline esp_err_t flush_buffer_to_sd(FILE *file, const uint8_t *buffer, size_t size)
+{
+    if (size == 0)
+        return ESP_OK;
+
+    size_t aligned_size = (size / 512) * 512;
+    size_t remainder = size % 512;
+
+    if (aligned_size > 0)
+    {
+        size_t written = fwrite(buffer, 1, aligned_size, file);
+        if (written != aligned_size)
+        {
+            return ESP_FAIL;
+        }
+    }
+
+    if (remainder > 0)
+    {
+        size_t written = fwrite(buffer + aligned_size, 1, remainder, file);
+        if (written != remainder)
+        {
+            return ESP_FAIL;
+        }
+    }
+
+    return ESP_OK;
+}
+
+// === Initialize WiFi with Performance Optimizations ===
+static void wifi_init_sta(void)
+{
+    esp_netif_init();
+    esp_event_loop_create_default();
+    esp_netif_t *sta_netif = esp_netif_create_default_wifi_sta();
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    esp_wifi_init(&cfg);
+
+    esp_event_handler_instance_t instance_any_id;
+    esp_event_handler_instance_t instance_got_ip;
+    esp_event_handler_instance_register(WIFI_EVENT,
+                                        ESP_EVENT_ANY_ID,
+                                        &wifi_event_handler,
+                                        NULL,
+                                        &instance_any_id);
+    esp_event_handler_instance_register(IP_EVENT,
+                                        IP_EVENT_STA_GOT_IP,
+                                        &wifi_event_handler,
+                                        NULL,
+                                        &instance_got_ip);
+
+    wifi_config_t wifi_config = {
+        .sta = {
+            .ssid = WIFI_SSID,
+            .password = WIFI_PASS,
+            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
+        },
+    };
+
+    esp_wifi_set_mode(WIFI_MODE_STA);
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+
+    esp_wifi_set_ps(WIFI_PS_NONE);
+    esp_wifi_set_bandwidth(WIFI_IF_STA, WIFI_BW_HT40);
+    esp_wifi_set_max_tx_power(84);
+
+    esp_wifi_start();
+
+    esp_netif_set_default_netif(sta_netif);
+}
+
+// Append a track to `folder`; `name` is relative to it and must end in ".mp3"
+bool add_to_playlist(const char *name, int folder, uint32_t file_size, uint32_t mtime)
+{
+    size_t len = strlen(name);
+    if (len > UINT8_MAX || len < 4)
+        return false;
+
+    // Records and arena both double; scan_mp3_dir() trims the slack afterwards
+    if (playlistSize >= playlistCapacity)
+    {
+        int newCapacity = playlistCapacity ? playlistCapacity * 2 : 32;
+        PlaylistItem *newPlaylist = (PlaylistItem *)realloc(playlist, newCapacity * sizeof(PlaylistItem));
+
+        if (newPlaylist == NULL)
+        {
+            return false;
+        }
+
+        playlist = newPlaylist;
+        playlistCapacity = newCapacity;
+    }
+    int32_t off = playlist_intern(name, len);
+    if (off < 0)
+    {
+        return false;
+    }
+
+    PlaylistItem *item = &playlist[playlistSize];
+    item->name_off = off;
+    item->name_len = len;
+    item->display_len = len - 4; // Xóa đuôi .mp3 khi hiển thị cho đẹp
+    item->folder = folder;
+    item->file_size = file_size;
+    item->mtime = mtime;
+    item->duration_ms = 0;
+
+    playlistSize++;
+    return true;
+}
+
+void vietnamese_to_ascii(const char *input, char *output, size_t output_size)
+{
+    size_t in_idx = 0;
+    size_t out_idx = 0;
+    size_t input_len = strlen(input);
+
+    while (in_idx < input_len && out_idx < output_size - 1)
+    {
+        unsigned char c = input[in_idx];
+
+        if (c < 0x80)
         {
             output[out_idx++] = c;
             in_idx++;
@@ -934,6 +1965,10 @@ void display_update_task(void *pvParameters)
             {
                 show_volume_screen();
             }
+            else if (currentMode == MODE_SEEK)
+            {
+                show_seek_screen();
+            }
             last_update = now;
         }
 
@@ -1052,6 +2087,125 @@ bool is_button_pressed(int button_index)
 int debug_input_bytes_consumed = 0;
 float debug_progress_percent = 0.0f;
 
+// === Playlist Browser ===
+// Rows of a folder: ".." and "Play folder" below the root, then subfolders
+// that hold tracks, then the folder's own tracks. playlistSelection is a row
+// of browseFolder. Only MENU/CENTER/UP/DOWN are wired (GPIO 20/21 are the
+// console UART), so every action is a row that CENTER picks.
+#define BROWSE_HEADER_ROWS(folder) ((folder) != 0 ? 2 : 0)
+
+typedef enum
+{
+    BROWSE_UP,
+    BROWSE_PLAY,
+    BROWSE_FOLDER,
+    BROWSE_TRACK
+} BrowseRow;
+
+int browseFolder = 0;
+
+static inline bool folder_has_tracks(int folder)
+{
+    return playlistFolders[folder].subtree_end > playlistFolders[folder].first_track;
+}
+
+static int browse_row_count(int folder)
+{
+    if (playlistFolderCount == 0)
+        return 0;
+    const PlaylistFolder *f = &playlistFolders[folder];
+    int rows = BROWSE_HEADER_ROWS(folder) + f->track_count;
+    for (int c = 0; c < f->child_count; c++)
+        rows += folder_has_tracks(f->first_child + c);
+    return rows;
+}
+
+// What a row stands for; *index is the folder or track behind it
+static BrowseRow browse_row(int folder, int row, int *index)
+{
+    const PlaylistFolder *f = &playlistFolders[folder];
+    if (folder != 0 && row-- == 0)
+    {
+        *index = f->parent;
+        return BROWSE_UP;
+    }
+    if (folder != 0 && row-- == 0)
+    {
+        *index = folder;
+        return BROWSE_PLAY;
+    }
+    for (int c = 0; c < f->child_count; c++)
+    {
+        int child = f->first_child + c;
+        if (folder_has_tracks(child) && row-- == 0)
+        {
+            *index = child;
+            return BROWSE_FOLDER;
+        }
+    }
+    *index = f->first_track + row;
+    return BROWSE_TRACK;
+}
+
+// Row of subfolder `child` (or, with child < 0, of `track`) inside `folder`
+static int browse_row_of(int folder, int child, int track)
+{
+    const PlaylistFolder *f = &playlistFolders[folder];
+    int row = BROWSE_HEADER_ROWS(folder);
+    for (int c = 0; c < f->child_count; c++)
+    {
+        if (f->first_child + c == child)
+            return row;
+        row += folder_has_tracks(f->first_child + c);
+    }
+    return (child < 0 && track >= (int)f->first_track) ? row + track - f->first_track : 0;
+}
+
+static void browse_select(int folder, int row)
+{
+    browseFolder = folder;
+    playlistSelection = row;
+    playlistScrollStartTime = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    playlistScrollOffset = 0;
+    lastPlaylistScrollTime = playlistScrollStartTime;
+}
+
+// Open the browser on the folder of `track`
+static void browse_open_at(int track)
+{
+    if (track >= 0 && track < playlistSize)
+        browse_select(playlist[track].folder, browse_row_of(playlist[track].folder, -1, track));
+    else
+        browse_select(0, 0);
+}
+
+static inline int queue_end(void)
+{
+    return (queueEnd < 0) ? playlistSize : queueEnd;
+}
+
+// Queue the track range of a folder (everything below it) and start at `track`
+static void queue_folder(int folder, int track)
+{
+    queueFirst = playlistFolders[folder].first_track;
+    queueEnd = playlistFolders[folder].subtree_end;
+    printf("Queue: folder %s, tracks %d-%d\n", playlistNames + playlistFolders[folder].name_off,
+           queueFirst + 1, queueEnd);
+    nextTrackIndex = track;
+}
+
+// Start the queued track and switch to the playing screen
+static void browse_play(int track)
+{
+    nextTrackIndex = track;
+    changeTrack = true;
+    stopPlayback = true;
+    currentMode = MODE_PLAYING;
+    isPaused = false;
+    strcpy(currentTrackName, "Loading...");
+    show_playing_screen();
+}
+
 void show_playlist_screen(void)
 {
     u8g2_ClearBuffer(&u8g2);
@@ -1060,28 +2214,51 @@ void show_playlist_screen(void)
     u8g2_DrawBox(&u8g2, 0, 0, 128, 12);
     u8g2_SetDrawColor(&u8g2, 0);
     u8g2_SetFont(&u8g2, u8g2_font_helvB08_tr);
-    const char *headerText = "PLAYLIST";
+    char headerText[22] = "PLAYLIST";
+    if (browseFolder != 0)
+    {
+        // Folder name, cut to the header width
+        char asciiFolder[128];
+        vietnamese_to_ascii(playlistNames + playlistFolders[browseFolder].name_off, asciiFolder, sizeof(asciiFolder));
+        snprintf(headerText, sizeof(headerText), "%s", asciiFolder);
+    }
     int headerWidth = u8g2_GetStrWidth(&u8g2, headerText);
     u8g2_DrawStr(&u8g2, (128 - headerWidth) / 2, 10, headerText);
 
     u8g2_SetDrawColor(&u8g2, 1);
     u8g2_SetFont(&u8g2, u8g2_font_6x10_tr);
 
+    int rows = browse_row_count(browseFolder);
     int startIdx = playlistSelection > 0 ? playlistSelection - 1 : 0;
     int endIdx = startIdx + 4;
-    if (endIdx > playlistSize)
-        endIdx = playlistSize;
+    if (endIdx > rows)
+        endIdx = rows;
 
     for (int i = startIdx; i < endIdx; i++)
     {
         int y = 14 + (i - startIdx) * 11;
 
+        // Tracks are numbered within their folder; "+" marks a folder, "<" goes up, ">" plays
+        int index;
+        BrowseRow kind = browse_row(browseFolder, i, &index);
         char trackNum[25];
-        snprintf(trackNum, sizeof(trackNum), "%d.", i + 1);
+        char displayName[256];
+        if (kind == BROWSE_TRACK)
+        {
+            snprintf(trackNum, sizeof(trackNum), "%d.", index - (int)playlistFolders[browseFolder].first_track + 1);
+            playlist_display(index, displayName, sizeof(displayName));
+        }
+        else
+        {
+            strcpy(trackNum, kind == BROWSE_FOLDER ? "+" : kind == BROWSE_PLAY ? ">" : "<");
+            strcpy(displayName, kind == BROWSE_FOLDER ? playlistNames + playlistFolders[index].name_off
+                                : kind == BROWSE_PLAY ? "Play folder"
+                                                      : "..");
+        }
         u8g2_DrawStr(&u8g2, 2, y + 7, trackNum);
 
         char asciiName[128];
-        vietnamese_to_ascii(playlist[i].displayname, asciiName, sizeof(asciiName));
+        vietnamese_to_ascii(displayName, asciiName, sizeof(asciiName));
 
         if (i == playlistSelection)
         {
@@ -1155,6 +2332,7 @@ static inline uint32_t calculate_display_hash(void)
 {
     return (uint32_t)currentTrack ^
            (uint32_t)(currentFilePosition >> 10) ^
+           ((currentPositionMs / 1000) << 8) ^
            (isPaused ? 0x80000000 : 0) ^
            (volumeAnimCurrent << 16);
 }
@@ -1264,15 +2442,8 @@ void show_playing_screen(void)
         u8g2_DrawStr(&u8g2, nameX, 24, asciiTrackName);
     }
 
-    uint32_t elapsed;
-    if (isPaused)
-    {
-        elapsed = (pauseStartTime - playbackStartTime - totalPausedTime) / 1000;
-    }
-    else
-    {
-        elapsed = (xTaskGetTickCount() * portTICK_PERIOD_MS - playbackStartTime - totalPausedTime) / 1000;
-    }
+    // Decoded position, so seeks and pauses are reflected exactly
+    uint32_t elapsed = currentPositionMs / 1000;
 
     int minutes = elapsed / 60;
     int seconds = elapsed % 60;
@@ -1290,15 +2461,9 @@ void show_playing_screen(void)
     u8g2_DrawRFrame(&u8g2, barX, barY, barWidth, barHeight, 2);
 
     int progress = 0;
-    if (currentFileSize > 0 && currentAudioFile != NULL && currentFilePosition > 0)
+    if (currentDurationMs > 0 && currentAudioFile != NULL)
     {
-        unsigned long long numerator = (unsigned long long)currentFilePosition * (unsigned long long)(barWidth - 2);
-        progress = (int)(numerator / currentFileSize);
-
-        if (progress < 0)
-        {
-            progress = 0;
-        }
+        progress = (int)((uint64_t)currentPositionMs * (barWidth - 2) / currentDurationMs);
         if (progress > (barWidth - 2))
         {
             progress = barWidth - 2;
@@ -1417,8 +2582,8 @@ void show_menu_screen(void)
     u8g2_SetDrawColor(&u8g2, 1);
     u8g2_SetFont(&u8g2, u8g2_font_6x10_tr);
 
-    const char *items[] = {"Play/Pause", "Stop", "Volume", "Playlist",
-                           "Auto-Play", "WiFi Upload", "WiFi Config"};
+    const char *items[] = {"Play/Pause", "Stop", "Volume", "Playlist", "Auto-Play",
+                           "WiFi Upload", "WiFi Config", "Seek", "Low Power", "Rescan"};
 
     // Show only 5 items at a time with scrolling
     int startIdx = (menuSelection > 2) ? menuSelection - 2 : 0;
@@ -1452,16 +2617,24 @@ void show_menu_screen(void)
             u8g2_DrawStr(&u8g2, 20, y + 7, items[i]);
         }
 
+        const char *statusText = NULL;
         if (i == 4) // Auto-Play status
         {
-            const char *statusText;
             if (autoPlayMode == AUTOPLAY_OFF)
                 statusText = "[OFF]";
             else if (autoPlayMode == AUTOPLAY_ON)
                 statusText = "[ON]";
             else
                 statusText = "[RND]";
+        }
+        else if (i == 8) // Low-power decode status
+        {
+            static const char *const lowPowerText[] = {"[OFF]", "[AUTO]", "[MONO]", "[HALF]"};
+            statusText = lowPowerText[lowPowerMode];
+        }
 
+        if (statusText)
+        {
             int statusWidth = u8g2_GetStrWidth(&u8g2, statusText);
 
             if (i == menuSelection)
@@ -1483,12 +2656,11 @@ void show_menu_screen(void)
 // === Start WiFi Mode (Free MP3 RAM -> Alloc WiFi RAM) ===
 bool start_wifi_mode(void)
 {
-    // 1. Free MP3 buffer
-    if (input_buffer != NULL)
+    // 1. Free MP3 buffers
+    if (input_buffer != NULL || pcm_buffer != NULL)
     {
-        free(input_buffer);
-        input_buffer = NULL;
-        printf("MEMORY: Freed MP3 Buffer\n");
+        free_playback_buffers();
+        printf("MEMORY: Freed MP3 Buffers\n");
     }
 
     // === NEW: Force garbage collection ===
@@ -1499,29 +2671,15 @@ bool start_wifi_mode(void)
     printf("Min heap ever: %lu bytes\n", esp_get_minimum_free_heap_size());
 
     // 2. Try allocating WiFi Buffers
-    upload_buffer_ptr = (uint8_t *)heap_caps_malloc(UPLOAD_BUF_SIZE_WIFI, MALLOC_CAP_8BIT);
+    upload_buffer_ptr = (uint8_t *)heap_caps_aligned_alloc(4, UPLOAD_BUF_SIZE_WIFI, MALLOC_CAP_DMA);
 
     if (upload_buffer_ptr == NULL)
     {
         printf("FAILED to alloc upload buffer (%d KB)\n", UPLOAD_BUF_SIZE_WIFI / 1024);
         printf("Free heap: %lu bytes\n", esp_get_free_heap_size());
 
-        // Restore MP3 buffer
-        input_buffer = (uint8_t *)malloc(MP3_BUF_SIZE_PLAYING);
-        return false;
-    }
-
-    receive_buffer_ptr = (uint8_t *)heap_caps_malloc(RECV_BUF_SIZE_WIFI, MALLOC_CAP_8BIT);
-
-    if (receive_buffer_ptr == NULL)
-    {
-        printf("FAILED to alloc receive buffer (%d KB)\n", RECV_BUF_SIZE_WIFI / 1024);
-        printf("Free heap: %lu bytes\n", esp_get_free_heap_size());
-
-        // Clean up and restore
-        free(upload_buffer_ptr);
-        upload_buffer_ptr = NULL;
-        input_buffer = (uint8_t *)malloc(MP3_BUF_SIZE_PLAYING);
+        // Restore MP3 buffers
+        alloc_playback_buffers();
         return false;
     }
 
@@ -1568,28 +2726,19 @@ void stop_wifi_mode(void)
     // 3. Free WiFi Buffers
     if (upload_buffer_ptr)
     {
-        free(upload_buffer_ptr);
+        heap_caps_free(upload_buffer_ptr);
         upload_buffer_ptr = NULL;
     }
-    if (receive_buffer_ptr)
-    {
-        free(receive_buffer_ptr);
-        receive_buffer_ptr = NULL;
-    }
 
-    // 4. Restore MP3 Buffer
-    if (input_buffer == NULL)
+    // 4. Restore MP3 Buffers
+    if (!alloc_playback_buffers())
     {
-        input_buffer = (uint8_t *)malloc(MP3_BUF_SIZE_PLAYING);
-        if (input_buffer == NULL)
-        {
-            printf("CRITICAL: Failed to re-alloc MP3 buffer. System Halted.\n");
-            show_error_screen("Memory Error", "Restart Req");
-            while (1)
-                vTaskDelay(100);
-        }
+        printf("CRITICAL: Failed to re-alloc MP3 buffers. System Halted.\n");
+        show_error_screen("Memory Error", "Restart Req");
+        while (1)
+            vTaskDelay(100);
     }
-    printf("MEMORY: Restored MP3 Buffer\n");
+    printf("MEMORY: Restored MP3 Buffers\n");
 }
 
 void handle_buttons(void)
@@ -1614,7 +2763,7 @@ void handle_buttons(void)
             currentMode = MODE_MENU;
             show_menu_screen();
         }
-        else if (currentMode == MODE_VOLUME)
+        else if (currentMode == MODE_VOLUME || currentMode == MODE_SEEK)
         {
             currentMode = MODE_MENU;
             show_menu_screen();
@@ -1638,10 +2787,9 @@ void handle_buttons(void)
         }
         else if (currentMode == MODE_PLAYLIST)
         {
-            playlistSelection = (playlistSelection - 1 + playlistSize) % playlistSize;
-            playlistScrollStartTime = xTaskGetTickCount() * portTICK_PERIOD_MS;
-            playlistScrollOffset = 0;
-            lastPlaylistScrollTime = xTaskGetTickCount() * portTICK_PERIOD_MS;
+            int rows = browse_row_count(browseFolder);
+            if (rows > 0)
+                browse_select(browseFolder, (playlistSelection - 1 + rows) % rows);
             show_playlist_screen();
         }
         else if (currentMode == MODE_VOLUME)
@@ -1650,6 +2798,11 @@ void handle_buttons(void)
             volumeAnimTarget = volumeAnimCurrent;
             show_volume_screen();
         }
+        else if (currentMode == MODE_SEEK)
+        {
+            request_seek_relative(10000);
+            show_seek_screen();
+        }
         else if (currentMode == MODE_PLAYING)
         {
             volumeAnimCurrent = (volumeAnimCurrent + 5) > 100 ? 100 : (volumeAnimCurrent + 5);
@@ -1671,10 +2824,9 @@ void handle_buttons(void)
         }
         else if (currentMode == MODE_PLAYLIST)
         {
-            playlistSelection = (playlistSelection + 1) % playlistSize;
-            playlistScrollStartTime = xTaskGetTickCount() * portTICK_PERIOD_MS;
-            playlistScrollOffset = 0;
-            lastPlaylistScrollTime = xTaskGetTickCount() * portTICK_PERIOD_MS;
+            int rows = browse_row_count(browseFolder);
+            if (rows > 0)
+                browse_select(browseFolder, (playlistSelection + 1) % rows);
             show_playlist_screen();
         }
         else if (currentMode == MODE_VOLUME)
@@ -1683,6 +2835,11 @@ void handle_buttons(void)
             volumeAnimTarget = volumeAnimCurrent;
             show_volume_screen();
         }
+        else if (currentMode == MODE_SEEK)
+        {
+            request_seek_relative(-10000);
+            show_seek_screen();
+        }
         else if (currentMode == MODE_PLAYING)
         {
             volumeAnimCurrent = (volumeAnimCurrent - 5) < 0 ? 0 : (volumeAnimCurrent - 5);
@@ -1709,6 +2866,12 @@ void handle_buttons(void)
                 show_ready_screen(totalTracks);
             }
         }
+        else if (currentMode == MODE_PLAYLIST && browseFolder != 0)
+        {
+            int parent = playlistFolders[browseFolder].parent;
+            browse_select(parent, browse_row_of(parent, browseFolder, -1));
+            show_playlist_screen();
+        }
         else if (currentMode == MODE_PLAYLIST)
         {
             currentMode = MODE_MENU;
@@ -1716,7 +2879,7 @@ void handle_buttons(void)
         }
         else if (currentMode == MODE_PLAYING)
         {
-            if (currentTrack > 0)
+            if (currentTrack > queueFirst)
             {
                 nextTrackIndex = currentTrack - 1;
                 changeTrack = true;
@@ -1729,9 +2892,21 @@ void handle_buttons(void)
     // RIGHT button
     if (is_button_pressed(5))
     {
-        if (currentMode == MODE_PLAYING)
+        if (currentMode == MODE_PLAYLIST && browse_row_count(browseFolder) > 0)
         {
-            if (currentTrack < playlistSize - 1)
+            // Queue a whole folder: the selected one, or the open one from the selected track
+            int index;
+            BrowseRow kind = browse_row(browseFolder, playlistSelection, &index);
+            if (kind == BROWSE_FOLDER || kind == BROWSE_PLAY)
+                queue_folder(index, playlistFolders[index].first_track);
+            else if (kind == BROWSE_TRACK)
+                queue_folder(browseFolder, index);
+            if (kind != BROWSE_UP)
+                browse_play(nextTrackIndex);
+        }
+        else if (currentMode == MODE_PLAYING)
+        {
+            if (currentTrack < queue_end() - 1)
             {
                 nextTrackIndex = currentTrack + 1;
                 changeTrack = true;
@@ -1793,10 +2968,7 @@ void handle_buttons(void)
 
             case 3: // Playlist
                 currentMode = MODE_PLAYLIST;
-                playlistSelection = currentTrack;
-                playlistScrollStartTime = xTaskGetTickCount() * portTICK_PERIOD_MS;
-                playlistScrollOffset = 0;
-                lastPlaylistScrollTime = xTaskGetTickCount() * portTICK_PERIOD_MS;
+                browse_open_at(currentTrack);
                 show_playlist_screen();
                 break;
 
@@ -1860,15 +3032,24 @@ void handle_buttons(void)
                     stop_wifi_mode();
 
                     // 2. === CẬP NHẬT PLAYLIST MỚI === (Code mới thêm)
+                    // Patch in this session's uploads/deletes; rescan only if that fails
                     show_loading_screen("Updating Files...");
-                    scan_mp3_files(); // Scan lại thẻ nhớ
+                    char current_path[256] = "";
+                    if (currentTrack < playlistSize)
+                        playlist_path(currentTrack, current_path, sizeof(current_path));
+                    if (!playlist_apply_journal())
+                        scan_mp3_files(); // Scan lại thẻ nhớ
 
                     // 3. Cập nhật biến toàn cục
                     totalTracks = playlistSize;
-
-                    // Reset bài hát về đầu danh sách để tránh lỗi nếu danh sách thay đổi
-                    currentTrack = 0;
-                    strcpy(currentTrackName, "Updated");
+                    queueFirst = 0;
+                    queueEnd = -1;
+
+                    // Keep the current track by path; the list start if it was deleted
+                    int kept = playlist_find_path(current_path);
+                    currentTrack = (kept >= 0) ? kept : 0;
+                    if (kept < 0)
+                        strcpy(currentTrackName, "Updated");
                 }
                 else
                 {
@@ -1924,27 +3105,90 @@ void handle_buttons(void)
                 }
                 show_menu_screen();
                 break;
+
+            case 7: // Seek
+                currentMode = MODE_SEEK;
+                show_seek_screen();
+                break;
+
+            case 8: // Low Power (takes effect from the next track)
+                lowPowerMode = (LowPowerMode)((lowPowerMode + 1) % 4);
+                show_menu_screen();
+                break;
+
+            case 9: // Rescan: drop the playlist cache and walk the card again
+            {
+                if (isPlaying || currentAudioFile != NULL || isPlayerActive)
+                {
+                    show_loading_screen("Stopping Audio...");
+                    stopPlayback = true;
+                    isPlaying = false;
+                    isPaused = false;
+                    int safety_timeout = 0;
+                    while (isPlayerActive && safety_timeout < 50)
+                    {
+                        vTaskDelay(pdMS_TO_TICKS(100));
+                        safety_timeout++;
+                    }
+                }
+
+                char current_path[256] = "";
+                if (currentTrack < playlistSize)
+                    playlist_path(currentTrack, current_path, sizeof(current_path));
+                playlist_cache_invalidate();
+                scan_mp3_files();
+
+                totalTracks = playlistSize;
+                queueFirst = 0;
+                queueEnd = -1;
+                int kept = playlist_find_path(current_path);
+                currentTrack = (kept >= 0) ? kept : 0;
+                if (kept < 0)
+                    strcpy(currentTrackName, "Updated");
+                show_menu_screen();
+                break;
+            }
             }
         }
-        else if (currentMode == MODE_PLAYLIST)
+        else if (currentMode == MODE_PLAYLIST && browse_row_count(browseFolder) > 0)
         {
-            nextTrackIndex = playlistSelection;
-            changeTrack = true;
-            stopPlayback = true;
-
-            currentMode = MODE_PLAYING;
-            isPaused = false;
+            int index;
+            BrowseRow kind = browse_row(browseFolder, playlistSelection, &index);
+            if (kind == BROWSE_UP || kind == BROWSE_FOLDER)
+            {
+                // Enter a folder, or go back up and land on the folder we came from
+                int row = (kind == BROWSE_UP) ? browse_row_of(index, browseFolder, -1) : 0;
+                browse_select(index, row);
+                show_playlist_screen();
+                return;
+            }
 
-            strcpy(currentTrackName, "Loading...");
-            show_playing_screen();
+            if (kind == BROWSE_PLAY)
+            {
+                // Everything below the open folder, from its first track
+                queue_folder(index, playlistFolders[index].first_track);
+            }
+            else if (browseFolder != 0)
+            {
+                // A track in a folder plays on through that folder
+                queue_folder(browseFolder, index);
+            }
+            else
+            {
+                // A track in the root plays on through the whole library
+                queueFirst = 0;
+                queueEnd = -1;
+                nextTrackIndex = index;
+            }
+            browse_play(nextTrackIndex);
         }
         else if (currentMode == MODE_PLAYING)
         {
             if (!isPlaying && !isPaused)
             {
+                // Restart the last track; play_file() resumes it if it was stopped mid-way
                 isPlaying = true;
                 isPaused = false;
-                currentTrack = 0;
                 stopPlayback = false;
                 playbackStartTime = xTaskGetTickCount() * portTICK_PERIOD_MS;
                 totalPausedTime = 0;
@@ -2054,28 +3298,119 @@ void init_i2s()
     i2s_chan_config_t chan_cfg = {
         .id = I2S_NUM_AUTO,
         .role = I2S_ROLE_MASTER,
-        .dma_desc_num = 8,
-        .dma_frame_num = 1020,
+        .dma_desc_num = I2S_DMA_DESC_NUM,
+        .dma_frame_num = I2S_DMA_FRAME_NUM,
         .auto_clear = true,
     };
     ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, &tx_handle, NULL));
 
-    i2s_std_config_t std_cfg = {
-        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(44100),
-        .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_STEREO),
-        .gpio_cfg = {
-            .mclk = I2S_GPIO_UNUSED,
-            .bclk = I2S_BCK_IO,
-            .ws = I2S_WS_IO,
-            .dout = I2S_DO_IO,
-            .din = I2S_GPIO_UNUSED,
-        },
-    };
+    i2s_std_config_t std_cfg = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(44100),
+        .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_STEREO),
+        .gpio_cfg = {
+            .mclk = I2S_GPIO_UNUSED,
+            .bclk = I2S_BCK_IO,
+            .ws = I2S_WS_IO,
+            .dout = I2S_DO_IO,
+            .din = I2S_GPIO_UNUSED,
+        },
+    };
+
+    ESP_ERROR_CHECK(i2s_channel_init_std_mode(tx_handle, &std_cfg));
+
+    // Count DMA underruns for the pipeline stats
+    i2s_event_callbacks_t cbs = {
+        .on_send_q_ovf = i2s_send_overflow_cb,
+    };
+    ESP_ERROR_CHECK(i2s_channel_register_event_callback(tx_handle, &cbs, NULL));
+
+    ESP_ERROR_CHECK(i2s_channel_enable(tx_handle));
+    audioOutRate = 44100;
+    audioOutChannels = 2;
+
+    printf("I2S: %d desc × %d frames = %d bytes DMA buffer\n",
+           I2S_DMA_DESC_NUM, I2S_DMA_FRAME_NUM, I2S_DMA_DESC_NUM * I2S_DMA_FRAME_NUM * 4);
+}
+
+// === Audio Output (I2S format state, reconfigured only on a real change) ===
+typedef struct
+{
+    uint32_t track_starts;      // Tracks that reached the first queued PCM sample
+    uint32_t reconfigs;         // Clock/slot changes actually applied
+    uint32_t reconfigs_skipped; // Track starts that kept the running format
+    uint32_t last_switch_us;    // Track open (or gapless boundary) -> first PCM queued
+    uint32_t max_switch_us;
+} AudioOutputMetrics;
+
+static AudioOutputMetrics audioOutMetrics;
+
+bool audio_output_matches(int sample_rate, int channels)
+{
+    return sample_rate == audioOutRate && channels == audioOutChannels;
+}
+
+// Push one DMA ring worth of silence so everything queued before it has
+// reached the DAC; afterwards the channel can be stopped without a click
+void audio_output_drain(void)
+{
+    static const int16_t silence[256] = {0};
+    size_t total = (size_t)I2S_DMA_DESC_NUM * I2S_DMA_FRAME_NUM * audioOutChannels * sizeof(int16_t);
+
+    while (total > 0)
+    {
+        size_t written = 0;
+        if (i2s_channel_write(tx_handle, silence, MIN(total, sizeof(silence)), &written, pdMS_TO_TICKS(500)) != ESP_OK)
+            break;
+        total -= written;
+    }
+}
+
+// Caller must make sure nothing else is writing to the channel (PCM ring empty)
+void audio_output_configure(int sample_rate, int channels)
+{
+    if (audio_output_matches(sample_rate, channels))
+    {
+        audioOutMetrics.reconfigs_skipped++;
+        return;
+    }
+
+    audio_output_drain();
+    i2s_channel_disable(tx_handle);
+
+    if (sample_rate != audioOutRate)
+    {
+        i2s_std_clk_config_t clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(sample_rate);
+        i2s_channel_reconfig_std_clock(tx_handle, &clk_cfg);
+    }
+    if (channels != audioOutChannels)
+    {
+        // Mono streams are sent to both slots
+        i2s_std_slot_config_t slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(
+            I2S_DATA_BIT_WIDTH_16BIT, channels == 1 ? I2S_SLOT_MODE_MONO : I2S_SLOT_MODE_STEREO);
+        slot_cfg.slot_mask = I2S_STD_SLOT_BOTH;
+        i2s_channel_reconfig_std_slot(tx_handle, &slot_cfg);
+    }
+
+    i2s_channel_enable(tx_handle);
+    printf("Audio output: %d Hz %s -> %d Hz %s\n", audioOutRate, audioOutChannels == 1 ? "mono" : "stereo",
+           sample_rate, channels == 1 ? "mono" : "stereo");
+    audioOutRate = sample_rate;
+    audioOutChannels = channels;
+    audioOutMetrics.reconfigs++;
+}
 
-    ESP_ERROR_CHECK(i2s_channel_init_std_mode(tx_handle, &std_cfg));
-    ESP_ERROR_CHECK(i2s_channel_enable(tx_handle));
+void audio_output_track_started(int64_t switch_start_us)
+{
+    uint32_t us = (uint32_t)(esp_timer_get_time() - switch_start_us);
+    audioOutMetrics.track_starts++;
+    audioOutMetrics.last_switch_us = us;
+    if (us > audioOutMetrics.max_switch_us)
+        audioOutMetrics.max_switch_us = us;
+}
 
-    printf("I2S: 8 desc × 1020 frames = %d bytes DMA buffer\n", 8 * 1020 * 4);
+void get_audio_output_metrics(AudioOutputMetrics *metrics)
+{
+    *metrics = audioOutMetrics;
 }
 
 // void init_sd()
@@ -2199,177 +3534,966 @@ void init_sd()
         while (1) vTaskDelay(100);
     }
 
-    printf("\n===========================================\n");
-    printf("SD Card Mounted Successfully!\n");
-    printf("Name: %s\n", card->cid.name);
-    printf("Size: %llu MB\n", ((uint64_t)card->csd.capacity) * card->csd.sector_size / (1024 * 1024));
-    printf("Speed: %d kHz\n", host.max_freq_khz);
-    printf("===========================================\n");
+    printf("\n===========================================\n");
+    printf("SD Card Mounted Successfully!\n");
+    printf("Name: %s\n", card->cid.name);
+    printf("Size: %llu MB\n", ((uint64_t)card->csd.capacity) * card->csd.sector_size / (1024 * 1024));
+    printf("Speed: %d kHz\n", host.max_freq_khz);
+    printf("===========================================\n");
+
+    global_host = host;
+    global_slot_config = slot_config;
+    global_card = card;
+}
+
+// === Track Files (FATFS fast seek) ===
+// Tracks are opened on FATFS directly instead of through VFS so the FIL can carry
+// a cluster link map table (CLMT): f_lseek then looks the cluster up in the map
+// instead of following the FAT chain from the first cluster. Maps live in a small
+// pool keyed by start cluster and size, so replaying a track reuses its map.
+#define CLMT_POOL_SLOTS 4  // Current + pre-opened gapless track, plus recently played ones
+#define CLMT_POOL_WORDS 64 // (64 - 1) / 2 = 31 fragments; more fragmented files seek by chain walk
+
+typedef struct
+{
+    DWORD sclust;       // First cluster of the file, 0 = slot free
+    FSIZE_t size;
+    uint8_t users;      // Open FILs pointing at tbl; never evicted while > 0
+    uint32_t last_used; // LRU stamp
+    DWORD tbl[CLMT_POOL_WORDS];
+} ClmtSlot;
+
+static ClmtSlot clmtPool[CLMT_POOL_SLOTS];
+static uint32_t clmtClock = 0;
+static uint32_t clmtHits = 0;
+static uint32_t clmtBuilds = 0;
+
+// Cluster chains can change under a cached map on any write or delete
+void clmt_pool_invalidate(void)
+{
+    for (int i = 0; i < CLMT_POOL_SLOTS; i++)
+    {
+        if (clmtPool[i].users == 0)
+            clmtPool[i].sclust = 0;
+    }
+}
+
+#if FF_USE_FASTSEEK
+static ClmtSlot *clmt_attach(FIL *fp)
+{
+    DWORD sclust = fp->obj.sclust;
+    FSIZE_t size = fp->obj.objsize;
+    if (sclust == 0 || size == 0)
+        return NULL;
+
+    ClmtSlot *victim = NULL;
+    for (int i = 0; i < CLMT_POOL_SLOTS; i++)
+    {
+        ClmtSlot *s = &clmtPool[i];
+        if (s->sclust == sclust && s->size == size)
+        {
+            s->users++;
+            s->last_used = ++clmtClock;
+            fp->cltbl = s->tbl;
+            clmtHits++;
+            return s;
+        }
+        if (s->users == 0 && (!victim || s->last_used < victim->last_used))
+            victim = s;
+    }
+    if (!victim)
+        return NULL;
+
+    victim->sclust = 0;
+    victim->tbl[0] = CLMT_POOL_WORDS;
+    fp->cltbl = victim->tbl;
+    if (f_lseek(fp, CREATE_LINKMAP) != FR_OK)
+    {
+        // FR_NOT_ENOUGH_CORE: too many fragments for the slot
+        fp->cltbl = NULL;
+        return NULL;
+    }
+    victim->sclust = sclust;
+    victim->size = size;
+    victim->users = 1;
+    victim->last_used = ++clmtClock;
+    clmtBuilds++;
+    return victim;
+}
+
+static void clmt_detach(FIL *fp)
+{
+    for (int i = 0; fp->cltbl && i < CLMT_POOL_SLOTS; i++)
+    {
+        if (clmtPool[i].tbl == fp->cltbl && clmtPool[i].users > 0)
+            clmtPool[i].users--;
+    }
+    fp->cltbl = NULL;
+}
+#endif
+
+// VFS path under MOUNT_POINT -> FATFS path on the card's logical drive
+bool fatfs_path(const char *path, char *out, size_t out_size)
+{
+    BYTE pdrv = global_card ? ff_diskio_get_pdrv_card(global_card) : 0xFF;
+    size_t mount_len = strlen(MOUNT_POINT);
+    if (pdrv == 0xFF || strncmp(path, MOUNT_POINT, mount_len) != 0)
+        return false;
+    return snprintf(out, out_size, "%u:%s", (unsigned)pdrv, path + mount_len) < (int)out_size;
+}
+
+// Open a file under MOUNT_POINT read-only on FATFS; fast_seek attaches a pooled map
+FIL *track_open(const char *path, bool fast_seek)
+{
+    char fpath[280];
+    if (!fatfs_path(path, fpath, sizeof(fpath)))
+        return NULL;
+
+    FIL *fp = calloc(1, sizeof(FIL));
+    if (!fp)
+        return NULL;
+    if (f_open(fp, fpath, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+    {
+        free(fp);
+        return NULL;
+    }
+#if FF_USE_FASTSEEK
+    if (fast_seek)
+    {
+        ClmtSlot *slot = clmt_attach(fp);
+        printf("Fast seek: %s, %lu fragment(s) (%lu maps built, %lu reused)\n",
+               slot ? "mapped" : "chain walk", slot ? (unsigned long)(slot->tbl[0] - 1) / 2 : 0,
+               (unsigned long)clmtBuilds, (unsigned long)clmtHits);
+    }
+#endif
+    return fp;
+}
+
+void track_close(FIL *fp)
+{
+    if (!fp)
+        return;
+#if FF_USE_FASTSEEK
+    clmt_detach(fp);
+#endif
+    f_close(fp);
+    free(fp);
+}
+
+static inline uint32_t track_size(FIL *fp)
+{
+    return (uint32_t)f_size(fp);
+}
+
+static inline bool track_seek(FIL *fp, uint32_t offset)
+{
+    return f_lseek(fp, offset) == FR_OK;
+}
+
+static inline size_t track_read(FIL *fp, void *dst, size_t len)
+{
+    UINT got = 0;
+    if (f_read(fp, dst, len, &got) != FR_OK)
+        return 0;
+    return got;
+}
+
+// Add this function
+void remount_sd_card(void)
+{
+    printf("Remounting SD card to refresh FAT cache...\n");
+    
+    // Unmount
+    esp_vfs_fat_sdcard_unmount(MOUNT_POINT, global_card);
+    vTaskDelay(pdMS_TO_TICKS(500));
+    
+    // Remount
+    esp_vfs_fat_sdmmc_mount_config_t mount_config = {
+        .format_if_mount_failed = false,
+        .max_files = 5,
+        .allocation_unit_size = 64 * 1024,
+        .use_one_fat = false,
+        .disk_status_check_enable = false
+    };
+
+    sdmmc_card_t *card_new;
+    esp_err_t ret = esp_vfs_fat_sdspi_mount(MOUNT_POINT, &global_host,
+                                            &global_slot_config, &mount_config, &card_new);
+    
+    if (ret == ESP_OK)
+    {
+        global_card = card_new;
+        clmt_pool_invalidate();
+        volumeSerialKnown = false; // Possibly another card
+        printf("SD card remounted successfully\n");
+    }
+    else
+    {
+        printf("SD remount failed: 0x%x\n", ret);
+    }
+}
+
+// === Gain Stage: volume with linear ramps, fade-in on start/resume, fade-out on pause/stop ===
+// Runs in the I2S feeder on the PCM about to be written, so volume changes and
+// fades act on the next DMA batch instead of after the whole PCM ring
+static GainRamp gainRamp = {.ramp_frames = GAIN_RAMP_FRAMES_DEFAULT}; // Starts silent so playback fades in
+static volatile bool gainFadeOut = false; // Ramp to silence (stop/skip), then hold
+
+void set_gain_ramp_frames(int frames)
+{
+    gainRamp.ramp_frames = frames < 1 ? 1 : frames;
+}
+
+static inline int32_t gain_stage_target(void)
+{
+    if (gainFadeOut || isPaused)
+        return 0;
+    return gain_volume_q15(volumeAnimCurrent);
+}
+
+static inline bool gain_stage_silent(void)
+{
+    return gainRamp.current == 0;
+}
+
+// Add this helper function
+bool validate_file_clusters(const char *filename)
+{
+    FIL *test_file = track_open(filename, true);
+    if (!test_file)
+    {
+        printf("Cannot open file for validation\n");
+        return false;
+    }
+    
+    // Get file size
+    long file_size = track_size(test_file);
+    
+    printf("Validating file: %s (%ld bytes)\n", filename, file_size);
+    
+    // Try reading at multiple points throughout the file
+    const int test_points = 20;  // ← INCREASED from 10 to 20 for better coverage
+    uint8_t test_buffer[512];
+    bool all_ok = true;
+    
+    for (int i = 0; i < test_points; i++)
+    {
+        // Test at 0%, 5%, 10%, ..., 95%
+        long test_position = (file_size / test_points) * i;
+        
+        if (!track_seek(test_file, test_position))
+        {
+            printf("  FAIL at position %ld (seek error)\n", test_position);
+            all_ok = false;
+            break;
+        }
+        
+        size_t read_bytes = track_read(test_file, test_buffer, sizeof(test_buffer));
+        if (read_bytes != sizeof(test_buffer) && i < test_points - 1)
+        {
+            printf("  FAIL at position %ld (read error: %zu bytes)\n", test_position, read_bytes);
+            all_ok = false;
+            break;
+        }
+        
+        printf("  OK at %ld (%d%%)\n", test_position, (i * 100) / test_points);
+        vTaskDelay(pdMS_TO_TICKS(10)); // Small delay between seeks
+    }
+    
+    // === ADD: Explicitly test the last 1KB of the file ===
+    if (all_ok && file_size > 1024)
+    {
+        printf("  Testing end of file...\n");
+        if (!track_seek(test_file, file_size - 1024))
+        {
+            printf("  FAIL at end (seek error)\n");
+            all_ok = false;
+        }
+        else
+        {
+            size_t read_bytes = track_read(test_file, test_buffer, 512);
+            if (read_bytes != 512)
+            {
+                printf("  FAIL at end (read error: %zu bytes)\n", read_bytes);
+                all_ok = false;
+            }
+            else
+            {
+                printf("  OK at end (100%%)\n");
+            }
+        }
+    }
+    
+    track_close(test_file);
+    printf("Validation %s\n", all_ok ? "PASSED" : "FAILED");
+    return all_ok;
+}
+
+// === Seek Index (".idx" sidecar: one file offset every N frames) ===
+#define SEEK_INDEX_MAGIC 0x5844494D // "MIDX"
+#define SEEK_INDEX_VERSION 3 // 3: uploads index only the frames playback decodes (confirmed sync, no trailers)
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t frames_per_entry;
+    uint32_t file_size;    // Sidecar is stale if the MP3 size changed
+    uint32_t total_frames;
+    uint32_t sample_rate;
+    uint16_t samples_per_frame;
+    uint16_t reserved;
+    uint32_t entry_count;  // uint32_t offsets[entry_count] follow
+} SeekIndexHeader;
+
+static void seek_index_path(const char *mp3_path, char *idx_path, size_t idx_size)
+{
+    strncpy(idx_path, mp3_path, idx_size - 1);
+    idx_path[idx_size - 1] = '\0';
+    char *ext = strrchr(idx_path, '.');
+    if (ext && strchr(ext, '/') == NULL && (size_t)(ext - idx_path) + 4 < idx_size)
+        strcpy(ext, ".idx");
+    else if (strlen(idx_path) + 4 < idx_size)
+        strcat(idx_path, ".idx");
+}
+
+// Write the sidecar and release the builder
+bool seek_index_finish(SeekIndexBuilder *b, const char *mp3_path, uint32_t file_size)
+{
+    bool ok = false;
+    seek_index_end(b);
+    if (b->valid && b->total_frames > 0)
+    {
+        char idx_path[264];
+        seek_index_path(mp3_path, idx_path, sizeof(idx_path));
+
+        SeekIndexHeader hdr = {
+            .magic = SEEK_INDEX_MAGIC,
+            .version = SEEK_INDEX_VERSION,
+            .frames_per_entry = b->frames_per_entry,
+            .file_size = file_size,
+            .total_frames = b->total_frames,
+            .sample_rate = b->sample_rate,
+            .samples_per_frame = b->samples_per_frame,
+            .entry_count = b->count,
+        };
+
+        FILE *idx = fopen(idx_path, "wb");
+        if (idx)
+        {
+            ok = fwrite(&hdr, sizeof(hdr), 1, idx) == 1 &&
+                 fwrite(b->offsets, sizeof(uint32_t), b->count, idx) == b->count;
+            fclose(idx);
+            if (!ok)
+                unlink(idx_path);
+            playlist_cache_restamp(); // Our own write: the playlist is unchanged
+        }
+        printf("Seek index %s: %s (%lu frames, %lu entries)\n", ok ? "written" : "FAILED",
+               idx_path, (unsigned long)b->total_frames, (unsigned long)b->count);
+    }
+    seek_index_abort(b);
+    return ok;
+}
+
+// O(1) load: read and validate the fixed-size header only
+bool load_seek_index(const char *mp3_path, uint32_t file_size, SeekIndexHeader *hdr)
+{
+    char idx_path[264];
+    seek_index_path(mp3_path, idx_path, sizeof(idx_path));
+
+    FILE *idx = fopen(idx_path, "rb");
+    if (!idx)
+        return false;
+
+    bool ok = fread(hdr, sizeof(*hdr), 1, idx) == 1 &&
+              hdr->magic == SEEK_INDEX_MAGIC &&
+              hdr->version == SEEK_INDEX_VERSION &&
+              hdr->file_size == file_size &&
+              hdr->sample_rate > 0 &&
+              hdr->frames_per_entry > 0 &&
+              hdr->entry_count > 0;
+    fclose(idx);
+    return ok;
+}
+
+static inline uint32_t seek_index_duration_ms(const SeekIndexHeader *hdr)
+{
+    return (uint32_t)((uint64_t)hdr->total_frames * hdr->samples_per_frame * 1000 / hdr->sample_rate);
+}
+
+// O(1) lookup: one seek + one 4-byte read. Returns the frame number landed on.
+bool seek_index_lookup(const char *mp3_path, const SeekIndexHeader *hdr, uint32_t target_ms,
+                       uint32_t *file_offset, uint32_t *frame)
+{
+    char idx_path[264];
+    seek_index_path(mp3_path, idx_path, sizeof(idx_path));
+
+    uint32_t target_frame = (uint32_t)((uint64_t)target_ms * hdr->sample_rate / (1000 * hdr->samples_per_frame));
+    uint32_t entry = target_frame / hdr->frames_per_entry;
+    if (entry >= hdr->entry_count)
+        entry = hdr->entry_count - 1;
+
+    FILE *idx = fopen(idx_path, "rb");
+    if (!idx)
+        return false;
+
+    bool ok = fseek(idx, sizeof(*hdr) + entry * sizeof(uint32_t), SEEK_SET) == 0 &&
+              fread(file_offset, sizeof(uint32_t), 1, idx) == 1;
+    fclose(idx);
+
+    *frame = entry * hdr->frames_per_entry;
+    return ok;
+}
+
+// === Stream Info (Xing/Info, VBRI and LAME headers of the first frame) ===
+static Mp3StreamInfo currentStreamInfo;
+
+// Offset past the last audio byte, from the last STREAM_TAIL_BYTES of the file
+static uint32_t find_audio_end(FIL *f, uint32_t file_size, uint8_t *scratch)
+{
+    if (file_size < STREAM_TAIL_BYTES)
+        return file_size;
+    if (!track_seek(f, file_size - STREAM_TAIL_BYTES) || track_read(f, scratch, STREAM_TAIL_BYTES) != STREAM_TAIL_BYTES)
+        return file_size;
+    return stream_info_audio_end(scratch, file_size);
+}
+
+// One extra header read per track. `scratch` must hold STREAM_PROBE_SIZE bytes.
+// audio_start/audio_end are valid even when no frame header is found.
+bool probe_stream_info(FIL *f, uint32_t file_size, uint8_t *scratch, Mp3StreamInfo *info)
+{
+    memset(info, 0, sizeof(*info));
+    info->audio_end = find_audio_end(f, file_size, scratch);
+
+    // Seek straight past ID3v2 tags (cover art can make them hundreds of KB);
+    // some taggers write more than one
+    size_t n = 0;
+    for (int tags = 0; tags < 4; tags++)
+    {
+        track_seek(f, info->audio_start);
+        n = track_read(f, scratch, STREAM_PROBE_SIZE);
+        uint32_t tag_size = (n >= 10) ? id3v2_tag_size(scratch) : 0;
+        if (tag_size == 0 || info->audio_start + tag_size >= info->audio_end)
+            break;
+        info->audio_start += tag_size;
+    }
+    info->audio_bytes = info->audio_end - MIN(info->audio_start, info->audio_end);
+
+    return stream_info_parse(info, scratch, n);
+}
+
+// === Low-Power Decode ===
+// Speech needs neither stereo nor content above ~8 kHz. Mono folds the channels
+// before the IMDCT (mid-side streams skip the side channel entirely); half rate
+// synthesizes only the lower 16 subbands and halves the I2S clock with it.
+#define LOWPOWER_AUTO_MAX_KBPS 96
+#define LOWPOWER_AUTO_MIN_MS (10 * 60 * 1000)
+#define LOWPOWER_HALF_MIN_RATE 32000 // Half rate must still cover the speech band
+
+static int decode_mode_for_track(const Mp3StreamInfo *info, bool has_info)
+{
+    bool speech = has_info && info->bitrate_kbps > 0 && info->bitrate_kbps <= LOWPOWER_AUTO_MAX_KBPS &&
+                  stream_info_duration_ms(info) >= LOWPOWER_AUTO_MIN_MS;
+    int mode = 0;
+
+    if (lowPowerMode == LOWPOWER_MONO)
+        mode = MP3_DECODE_MONO;
+    else if (lowPowerMode == LOWPOWER_HALF || (lowPowerMode == LOWPOWER_AUTO && speech))
+        mode = MP3_DECODE_MONO | MP3_DECODE_HALFRATE;
+
+    if (!has_info || info->sample_rate < LOWPOWER_HALF_MIN_RATE)
+        mode &= ~MP3_DECODE_HALFRATE;
+    return mode;
+}
+
+// Returns the output rate shift: trims and positions stay in source samples
+static int apply_decode_mode(HMP3Decoder decoder, const Mp3StreamInfo *info, bool has_info)
+{
+    int mode = decode_mode_for_track(info, has_info);
+    MP3SetDecodeMode(decoder, mode);
+    if (mode)
+        printf("Low-power decode:%s%s\n", (mode & MP3_DECODE_MONO) ? " mono" : "",
+               (mode & MP3_DECODE_HALFRATE) ? " half-rate" : "");
+    return (mode & MP3_DECODE_HALFRATE) ? 1 : 0;
+}
+
+// === Playback Pipeline: SD reader task -> decoder (play_file) -> I2S feeder task ===
+// Reads end on FATFS sector boundaries: f_read then moves whole sectors from the
+// card straight into the ring (one multi-block command) instead of via stdio
+#ifdef CONFIG_FATFS_SECTOR_4096
+#define SD_SECTOR_SIZE 4096
+#else
+#define SD_SECTOR_SIZE 512
+#endif
+// I2S feeder batches whole DMA descriptors (I2S_DMA_FRAME_NUM frames each) per write
+#define I2S_BATCH_DESC_DEFAULT 1
+#define I2S_BATCH_DESC_MAX 3 // Must fit in the PCM ring with a frame to spare
+
+typedef struct
+{
+    size_t mp3_fill;            // Compressed bytes buffered by the SD reader
+    size_t mp3_size;
+    size_t mp3_copy_bytes;      // Bytes copied into the mirrored tail
+    uint32_t reader_underruns;  // Decoder waited on an empty compressed ring
+    size_t pcm_fill;            // PCM bytes buffered by the decoder
+    size_t pcm_size;
+    uint32_t decoder_underruns; // I2S feeder waited on an empty PCM ring
+    uint32_t i2s_underruns;     // DMA ran out of queued data
+    uint32_t i2s_writes;        // i2s_channel_write calls issued by the feeder
+    size_t i2s_batch_bytes;     // Current feeder batch size
+    uint32_t resyncs;           // Times the decoder lost frame sync mid-stream
+    uint32_t resync_bytes;      // Bytes skipped while scanning for a frame
+    uint32_t resync_false;      // Confirmed syncs whose frame still failed to decode
+} PipelineStats;
+
+static SpscRing mp3_ring; // SD reader -> decoder
+static SpscRing pcm_ring; // decoder -> I2S feeder
+
+TaskHandle_t sdReaderTaskHandle = NULL;
+TaskHandle_t i2sFeederTaskHandle = NULL;
+static TaskHandle_t decoderTaskHandle = NULL;
+
+static FIL *readerFile = NULL;
+static uint32_t streamBaseOffset = 0; // File offset = streamBaseOffset + mp3_ring position
+static uint32_t streamEndOffset = 0;  // Reader stops here (start of ID3v1/APEv2 trailers)
+static uint32_t readerBaseOffset = 0; // Reader file offset = readerBaseOffset + mp3_ring head
+static size_t readerGap = 0;          // Ring positions to skip before the next track (keeps sector alignment)
+
+// Next track, opened by the SD reader when the current file runs out so its
+// data follows the current track in the same compressed ring (gapless)
+typedef struct
+{
+    FIL *f;
+    int track;
+    uint32_t file_size;
+    size_t gap_start;         // mp3_ring position where the previous track's data ends
+    size_t boundary;          // mp3_ring position where this track's data starts
+    uint32_t base_offset;     // File offset = base_offset + mp3_ring position
+    bool has_info;
+    Mp3StreamInfo info;
+    bool has_index;
+    SeekIndexHeader index_hdr;
+} PendingTrack;
+
+static PendingTrack pendingTrack;
+static volatile bool pendingTrackReady = false;
+static volatile bool readerRunning = false;
+static volatile bool readerIdle = true;
+static volatile bool feederRunning = false;
+static volatile bool feederIdle = true;
+static volatile uint32_t i2sUnderruns = 0;
+static volatile int i2sBatchDesc = I2S_BATCH_DESC_DEFAULT;
+static uint32_t i2sWrites = 0;
+static uint32_t resyncCount = 0;
+static uint32_t resyncSkippedBytes = 0;
+static uint32_t resyncFalse = 0;
+
+static bool IRAM_ATTR i2s_send_overflow_cb(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    i2sUnderruns++;
+    return false;
+}
+
+// Bytes per feeder write: whole DMA descriptors in the current output format
+static size_t pcm_batch_bytes(void)
+{
+    return (size_t)i2sBatchDesc * I2S_DMA_FRAME_NUM * audioOutChannels * sizeof(int16_t);
+}
+
+// Runtime tunable: fewer, larger writes cost less CPU but need more PCM buffered
+void set_i2s_batch_descriptors(int desc)
+{
+    if (desc < 1)
+        desc = 1;
+    if (desc > I2S_BATCH_DESC_MAX)
+        desc = I2S_BATCH_DESC_MAX;
+    i2sBatchDesc = desc;
+    printf("I2S batch: %d descriptor(s), %u bytes per write\n", desc, (unsigned)pcm_batch_bytes());
+}
 
-    global_host = host;
-    global_slot_config = slot_config;
-    global_card = card;
+void get_pipeline_stats(PipelineStats *stats)
+{
+    stats->mp3_fill = ring_used(&mp3_ring);
+    stats->mp3_size = mp3_ring.size;
+    stats->mp3_copy_bytes = mp3_ring.mirror_bytes;
+    stats->reader_underruns = mp3_ring.underruns;
+    stats->pcm_fill = ring_used(&pcm_ring);
+    stats->pcm_size = pcm_ring.size;
+    stats->decoder_underruns = pcm_ring.underruns;
+    stats->i2s_underruns = i2sUnderruns;
+    stats->i2s_writes = i2sWrites;
+    stats->i2s_batch_bytes = pcm_batch_bytes();
+    stats->resyncs = resyncCount;
+    stats->resync_bytes = resyncSkippedBytes;
+    stats->resync_false = resyncFalse;
 }
 
-// Add this function
-void remount_sd_card(void)
+// === Read-ahead: the SD reader keeps the compressed ring filled to a watermark ===
+// The watermark is READAHEAD_MIN_MS of audio at the track's bitrate, or twice the
+// slowest SD read seen so far (GC / wear-levelling stalls), whichever is longer.
+// The ring grows in powers of two up to READAHEAD_MAX_BYTES to hold it, but only
+// while the heap can spare the memory; when it can't, ring and watermark shrink.
+#define READAHEAD_MIN_MS 2000
+#define READAHEAD_MAX_BYTES (64 * 1024)
+#define READAHEAD_HEAP_RESERVE (32 * 1024) // Left free for the rest of the system
+#define READAHEAD_STALL_US 100000          // Reads slower than this count as stalls
+#define READAHEAD_DEFAULT_BYTES_PER_S (320 * 1000 / 8)
+
+typedef struct
 {
-    printf("Remounting SD card to refresh FAT cache...\n");
-    
-    // Unmount
-    esp_vfs_fat_sdcard_unmount(MOUNT_POINT, global_card);
-    vTaskDelay(pdMS_TO_TICKS(500));
-    
-    // Remount
-    esp_vfs_fat_sdmmc_mount_config_t mount_config = {
-        .format_if_mount_failed = false,
-        .max_files = 5,
-        .allocation_unit_size = 64 * 1024,
-        .use_one_fat = false,
-        .disk_status_check_enable = false
-    };
+    size_t fill;             // Compressed bytes buffered
+    size_t watermark;        // Fill level the reader keeps topped up
+    size_t capacity;         // Current ring size
+    uint32_t fill_ms;        // Buffered audio at the current bitrate
+    uint32_t stalls;         // SD reads slower than READAHEAD_STALL_US
+    uint32_t max_latency_us; // Slowest SD read since boot
+    uint32_t reads;
+} ReadAheadStats;
+
+static volatile size_t readaheadWatermark = MP3_BUF_SIZE_PLAYING;
+static uint32_t readaheadBytesPerSec = READAHEAD_DEFAULT_BYTES_PER_S;
+static uint32_t readaheadStalls = 0;
+static uint32_t readaheadMaxLatencyUs = 0;
+static uint32_t readaheadReads = 0;
+
+// Average bitrate of a track: measured duration when known, else the first frame
+static uint32_t readahead_bytes_per_sec(const Mp3StreamInfo *info, uint32_t duration_ms)
+{
+    if (duration_ms > 0 && info->audio_bytes > 0)
+        return (uint32_t)((uint64_t)info->audio_bytes * 1000 / duration_ms);
+    if (info->bitrate_kbps > 0)
+        return (uint32_t)info->bitrate_kbps * 1000 / 8;
+    return READAHEAD_DEFAULT_BYTES_PER_S;
+}
 
-    sdmmc_card_t *card_new;
-    esp_err_t ret = esp_vfs_fat_sdspi_mount(MOUNT_POINT, &global_host,
-                                            &global_slot_config, &mount_config, &card_new);
-    
-    if (ret == ESP_OK)
+static size_t readahead_target_bytes(uint32_t bytes_per_s)
+{
+    uint32_t ms = MAX(READAHEAD_MIN_MS, 2 * readaheadMaxLatencyUs / 1000);
+    return (size_t)((uint64_t)bytes_per_s * ms / 1000);
+}
+
+static void readahead_set_rate(uint32_t bytes_per_s)
+{
+    readaheadBytesPerSec = bytes_per_s;
+    // At least two sectors, so a sector-aligned read always fits below the mark
+    readaheadWatermark = MIN(MAX(readahead_target_bytes(bytes_per_s), 2 * SD_SECTOR_SIZE), mp3_ring.size);
+}
+
+// Pipeline parked: size the compressed ring for a new playback session. Returns
+// the ring size; input_buffer keeps at least MP3_BUF_SIZE_PLAYING either way.
+static size_t readahead_resize(uint32_t bytes_per_s)
+{
+    size_t target = readahead_target_bytes(bytes_per_s);
+    size_t capacity = MP3_BUF_SIZE_PLAYING;
+    while (capacity < target && capacity < READAHEAD_MAX_BYTES)
+        capacity *= 2;
+
+    // Memory already held by input_buffer counts as available
+    size_t spare = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) + inputBufferSize;
+    while (capacity > MP3_BUF_SIZE_PLAYING && capacity + MP3_BUF_MIRROR_PLAYING + READAHEAD_HEAP_RESERVE > spare)
+        capacity /= 2;
+
+    if (capacity != inputBufferSize)
     {
-        global_card = card_new;
-        printf("SD card remounted successfully\n");
+        free(input_buffer);
+        input_buffer = (uint8_t *)malloc(capacity + MP3_BUF_MIRROR_PLAYING);
+        if (!input_buffer)
+        {
+            capacity = MP3_BUF_SIZE_PLAYING;
+            input_buffer = (uint8_t *)malloc(capacity + MP3_BUF_MIRROR_PLAYING);
+        }
+        inputBufferSize = input_buffer ? capacity : 0;
+        printf("Read-ahead: ring %u KB for %lu B/s (target %u bytes)\n", (unsigned)(capacity / 1024),
+               (unsigned long)bytes_per_s, (unsigned)target);
     }
-    else
+    return inputBufferSize;
+}
+
+// Reader context, after every SD read
+static void readahead_note_read(uint32_t latency_us)
+{
+    readaheadReads++;
+    if (latency_us > READAHEAD_STALL_US)
+        readaheadStalls++;
+    if (latency_us > readaheadMaxLatencyUs)
     {
-        printf("SD remount failed: 0x%x\n", ret);
+        readaheadMaxLatencyUs = latency_us;
+        readahead_set_rate(readaheadBytesPerSec); // A slower card needs more buffered
     }
 }
 
-static inline void apply_volume_fast(int16_t *samples, size_t count)
+void get_readahead_stats(ReadAheadStats *stats)
+{
+    stats->fill = ring_used(&mp3_ring);
+    stats->watermark = readaheadWatermark;
+    stats->capacity = mp3_ring.size;
+    stats->fill_ms = readaheadBytesPerSec ? (uint32_t)((uint64_t)stats->fill * 1000 / readaheadBytesPerSec) : 0;
+    stats->stalls = readaheadStalls;
+    stats->max_latency_us = readaheadMaxLatencyUs;
+    stats->reads = readaheadReads;
+}
+
+// Track that follows `from` in the queue under the current autoplay mode, -1 = stop after it
+int pick_next_track(int from)
 {
-    size_t count4 = count / 4;
-    size_t remainder = count % 4;
+    int first = queueFirst;
+    int end = queue_end();
+    if (end <= first || autoPlayMode == AUTOPLAY_OFF)
+        return -1;
 
-    while (count4--)
+    if (autoPlayMode == AUTOPLAY_RANDOM && end - first > 1)
     {
-        int32_t s0 = ((int32_t)samples[0] * volumeAnimCurrent) / 100;
-        int32_t s1 = ((int32_t)samples[1] * volumeAnimCurrent) / 100;
-        int32_t s2 = ((int32_t)samples[2] * volumeAnimCurrent) / 100;
-        int32_t s3 = ((int32_t)samples[3] * volumeAnimCurrent) / 100;
+        int next = from;
+        while (next == from)
+        {
+            next = first + esp_random() % (end - first);
+        }
+        return next;
+    }
+
+    return (from >= first && from < end - 1) ? from + 1 : first;
+}
 
-        if (s0 > 32767)
-            s0 = 32767;
-        else if (s0 < -32768)
-            s0 = -32768;
-        if (s1 > 32767)
-            s1 = 32767;
-        else if (s1 < -32768)
-            s1 = -32768;
-        if (s2 > 32767)
-            s2 = 32767;
-        else if (s2 < -32768)
-            s2 = -32768;
-        if (s3 > 32767)
-            s3 = 32767;
-        else if (s3 < -32768)
-            s3 = -32768;
+// Reader context: open and probe the next track and continue filling the ring from it
+static bool reader_open_next_track(void)
+{
+    if (stopPlayback || changeTrack || pendingTrackReady)
+        return false;
 
-        samples[0] = (int16_t)s0;
-        samples[1] = (int16_t)s1;
-        samples[2] = (int16_t)s2;
-        samples[3] = (int16_t)s3;
+    int next = pick_next_track(currentTrack);
+    if (next < 0)
+        return false;
 
-        samples += 4;
+    char path[256];
+    playlist_path(next, path, sizeof(path));
+    FIL *f = track_open(path, true);
+    if (!f)
+    {
+        printf("Gapless: cannot open %s\n", path);
+        return false;
     }
+    uint32_t file_size = track_size(f);
 
-    while (remainder--)
+    uint8_t *scratch = malloc(STREAM_PROBE_SIZE);
+    if (!scratch)
     {
-        int32_t s = ((int32_t)*samples * volumeAnimCurrent) / 100;
-        if (s > 32767)
-            s = 32767;
-        if (s < -32768)
-            s = -32768;
-        *samples++ = (int16_t)s;
+        track_close(f);
+        return false;
     }
+
+    PendingTrack *p = &pendingTrack;
+    p->has_info = probe_stream_info(f, file_size, scratch, &p->info);
+    free(scratch);
+    p->has_index = load_seek_index(path, file_size, &p->index_hdr);
+    playlist_cache_verify(next, file_size);
+    readahead_set_rate(readahead_bytes_per_sec(&p->info, p->has_index ? seek_index_duration_ms(&p->index_hdr)
+                                                                       : stream_info_duration_ms(&p->info)));
+
+    track_seek(f, p->info.audio_start);
+    p->f = f;
+    p->track = next;
+    p->file_size = file_size;
+    // Skip a few ring positions so the new file's offsets line up with the ring's sectors
+    size_t gap = (p->info.audio_start - (uint32_t)mp3_ring.head) & (SD_SECTOR_SIZE - 1);
+    p->gap_start = mp3_ring.head;
+    p->boundary = mp3_ring.head + gap;
+    p->base_offset = p->info.audio_start - (uint32_t)p->boundary;
+    readerGap = gap;
+
+    readerFile = f;
+    readerBaseOffset = p->base_offset;
+    streamEndOffset = p->info.audio_end;
+    __atomic_store_n(&pendingTrackReady, true, __ATOMIC_RELEASE);
+
+    printf("Gapless: pre-opened track %d (%s)\n", next + 1, playlist_name(next));
+    return true;
 }
 
-// Add this helper function
-bool validate_file_clusters(const char *filename)
+static void sd_reader_task(void *pvParameters)
 {
-    FILE *test_file = fopen(filename, "rb");
-    if (!test_file)
-    {
-        printf("Cannot open file for validation\n");
-        return false;
-    }
-    
-    // Get file size
-    fseek(test_file, 0, SEEK_END);
-    long file_size = ftell(test_file);
-    fseek(test_file, 0, SEEK_SET);
-    
-    printf("Validating file: %s (%ld bytes)\n", filename, file_size);
-    
-    // Try reading at multiple points throughout the file
-    const int test_points = 20;  // ← INCREASED from 10 to 20 for better coverage
-    uint8_t test_buffer[512];
-    bool all_ok = true;
-    
-    for (int i = 0; i < test_points; i++)
+    while (1)
     {
-        // Test at 0%, 5%, 10%, ..., 95%
-        long test_position = (file_size / test_points) * i;
-        
-        if (fseek(test_file, test_position, SEEK_SET) != 0)
+        // Mark busy before checking the flag so play_file never closes the file under us
+        readerIdle = false;
+        if (!readerRunning || mp3_ring.eof)
         {
-            printf("  FAIL at position %ld (seek error)\n", test_position);
-            all_ok = false;
-            break;
+            readerIdle = true;
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(50));
+            continue;
         }
-        
-        size_t read_bytes = fread(test_buffer, 1, sizeof(test_buffer), test_file);
-        if (read_bytes != sizeof(test_buffer) && i < test_points - 1)
+
+        size_t contiguous;
+        uint8_t *dst = ring_write_ptr(&mp3_ring, &contiguous);
+        size_t used = ring_used(&mp3_ring);
+        if (readerGap > 0)
         {
-            printf("  FAIL at position %ld (read error: %zu bytes)\n", test_position, read_bytes);
-            all_ok = false;
-            break;
+            size_t n = MIN(readerGap, contiguous);
+            ring_commit(&mp3_ring, n);
+            readerGap -= n;
+            if (n == 0)
+            {
+                readerIdle = true;
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20));
+            }
+            continue;
         }
-        
-        printf("  OK at %ld (%d%%)\n", test_position, (i * 100) / test_points);
-        vTaskDelay(pdMS_TO_TICKS(10)); // Small delay between seeks
+
+        // Top up to the watermark only; a ring larger than it stays partly free
+        contiguous = MIN(contiguous, (used < readaheadWatermark) ? readaheadWatermark - used : 0);
+
+        // Ring offsets and file offsets agree modulo the sector size, and the ring
+        // wraps on a sector, so only the first read after an open or seek is partial
+        uint32_t file_pos = readerBaseOffset + (uint32_t)mp3_ring.head;
+        uint32_t read_end = (file_pos + (uint32_t)contiguous) & ~(uint32_t)(SD_SECTOR_SIZE - 1);
+        size_t chunk = (read_end > file_pos) ? read_end - file_pos : 0;
+        uint32_t remaining = (streamEndOffset > file_pos) ? streamEndOffset - file_pos : 0;
+        if (remaining == 0)
+        {
+            if (!reader_open_next_track())
+                mp3_ring.eof = true;
+            continue;
+        }
+        if (chunk > remaining)
+            chunk = remaining;
+        if (chunk == 0)
+        {
+            // At the watermark: sleep until the decoder consumes something
+            readerIdle = true;
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20));
+            continue;
+        }
+
+        int64_t read_start_us = esp_timer_get_time();
+        size_t bytes_read = track_read(readerFile, dst, chunk);
+        readahead_note_read((uint32_t)(esp_timer_get_time() - read_start_us));
+        ring_commit(&mp3_ring, bytes_read);
+        if (bytes_read < chunk)
+        {
+            // Short read before audio_end: treat the file as ending here
+            streamEndOffset = file_pos + (uint32_t)bytes_read;
+        }
+
+        if (decoderTaskHandle)
+            xTaskNotifyGive(decoderTaskHandle);
     }
-    
-    // === ADD: Explicitly test the last 1KB of the file ===
-    if (all_ok && file_size > 1024)
+}
+
+static void i2s_feeder_task(void *pvParameters)
+{
+    bool starving = false;
+    int64_t last_write_us = 0;
+
+    while (1)
     {
-        printf("  Testing end of file...\n");
-        if (fseek(test_file, file_size - 1024, SEEK_SET) != 0)
+        feederIdle = false;
+        // Pause and stop first play a short fade-out, then hold at silence
+        bool fading_out = isPaused || gainFadeOut;
+        if (!feederRunning || (fading_out && gain_stage_silent()))
         {
-            printf("  FAIL at end (seek error)\n");
-            all_ok = false;
+            feederIdle = true;
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20));
+            continue;
         }
-        else
+
+        size_t used = ring_used(&pcm_ring);
+        if (used == 0)
         {
-            size_t read_bytes = fread(test_buffer, 1, 512, test_file);
-            if (read_bytes != 512)
-            {
-                printf("  FAIL at end (read error: %zu bytes)\n", read_bytes);
-                all_ok = false;
-            }
-            else
+            if (fading_out)
+                gain_ramp_reset(&gainRamp, 0); // Nothing left to fade; the DMA clears to silence
+            if (!pcm_ring.eof && !starving)
             {
-                printf("  OK at end (100%%)\n");
+                pcm_ring.underruns++;
+                starving = true;
             }
+            feederIdle = true;
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+            continue;
+        }
+
+        // Wait for a full batch, unless the track is ending or half of the
+        // DMA queue has played out since the last write
+        size_t batch = fading_out ? (size_t)gainRamp.ramp_frames * audioOutChannels * sizeof(int16_t) : pcm_batch_bytes();
+        int64_t waited_us = esp_timer_get_time() - last_write_us;
+        int64_t deadline_us = (int64_t)I2S_DMA_DESC_NUM * I2S_DMA_FRAME_NUM * 1000000 / audioOutRate / 2;
+        if (used < batch && !pcm_ring.eof && !fading_out && waited_us < deadline_us)
+        {
+            feederIdle = true;
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS((deadline_us - waited_us) / 1000 + 1));
+            continue;
+        }
+        starving = false;
+
+        // One write per batch; a second one only when the batch wraps the ring
+        size_t to_write = MIN(used, batch);
+        while (to_write > 0)
+        {
+            size_t contiguous;
+            uint8_t *src = ring_read_ptr(&pcm_ring, &contiguous);
+            size_t chunk = MIN(contiguous, to_write);
+            gain_ramp_process(&gainRamp, (int16_t *)src, chunk / sizeof(int16_t), audioOutChannels, gain_stage_target());
+            size_t chunk_written = 0;
+            i2s_channel_write(tx_handle, src, chunk, &chunk_written, portMAX_DELAY);
+            ring_consume(&pcm_ring, chunk_written);
+            to_write -= chunk_written;
+            i2sWrites++;
         }
+        last_write_us = esp_timer_get_time();
+
+        if (decoderTaskHandle)
+            xTaskNotifyGive(decoderTaskHandle);
     }
-    
-    fclose(test_file);
-    printf("Validation %s\n", all_ok ? "PASSED" : "FAILED");
-    return all_ok;
+}
+
+void start_playback_pipeline(void)
+{
+    xTaskCreate(sd_reader_task, "sd_reader", 4096, NULL, 4, &sdReaderTaskHandle);
+    xTaskCreate(i2s_feeder_task, "i2s_feeder", 3072, NULL, 6, &i2sFeederTaskHandle);
+}
+
+// Wait for a pipeline stage to park itself after its run flag was cleared
+static void wait_stage_idle(volatile bool *idle, TaskHandle_t task)
+{
+    while (!*idle)
+    {
+        xTaskNotifyGive(task);
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+}
+
+// Park both stages, drop buffered data and restart the reader at a new file offset
+static void pipeline_seek(FIL *f, uint32_t file_offset)
+{
+    feederRunning = false;
+    wait_stage_idle(&feederIdle, i2sFeederTaskHandle);
+    readerRunning = false;
+    wait_stage_idle(&readerIdle, sdReaderTaskHandle);
+
+    // Drop a pre-opened next track; its data was queued after the old position
+    if (pendingTrackReady)
+    {
+        track_close(pendingTrack.f);
+        pendingTrackReady = false;
+    }
+    readerFile = f;
+    readerGap = 0;
+    streamEndOffset = currentStreamInfo.audio_end;
+
+    track_seek(f, file_offset);
+    ring_flush(&mp3_ring);
+    ring_align_to(&mp3_ring, file_offset, SD_SECTOR_SIZE);
+    ring_flush(&pcm_ring);
+    streamBaseOffset = file_offset - (uint32_t)mp3_ring.tail;
+    readerBaseOffset = streamBaseOffset;
+
+    readerRunning = true;
+    feederRunning = true;
+    xTaskNotifyGive(sdReaderTaskHandle);
 }
 
 void play_file(const char *filename)
 {
     printf("Playing: %s\n", filename);
+    char track_path[256]; // Path of a gapless follow-up track
 
     //     // === ADD: Validate file first ===
     // if (!validate_file_clusters(filename))
@@ -2380,50 +4504,82 @@ void play_file(const char *filename)
     //     return;
     // }
 
-    if (input_buffer == NULL)
+    if (input_buffer == NULL || pcm_buffer == NULL)
     {
-        printf("Error: input_buffer is NULL!\n");
+        printf("Error: playback buffers are NULL!\n");
         return;
     }
 
     // === LOCK: Tell system we are using the buffer ===
     isPlayerActive = true;
 
-    // ... (Keep your existing I2S setup code) ...
-    i2s_channel_disable(tx_handle);
-    vTaskDelay(pdMS_TO_TICKS(10));
-
-    // ... (Keep clock config code) ...
-    i2s_std_clk_config_t clk_cfg_reset = I2S_STD_CLK_DEFAULT_CONFIG(44100);
-    i2s_channel_reconfig_std_clock(tx_handle, &clk_cfg_reset);
-    // ... (Keep slot config code) ...
-    i2s_std_slot_config_t slot_cfg_reset = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_STEREO);
-    slot_cfg_reset.slot_bit_width = I2S_SLOT_BIT_WIDTH_16BIT;
-    i2s_channel_reconfig_std_slot(tx_handle, &slot_cfg_reset);
-    i2s_channel_enable(tx_handle);
+    // I2S keeps running between tracks; the format is checked against the
+    // first decoded frame and only reconfigured when it differs
 
-    FILE *f = fopen(filename, "rb");
+    FIL *f = track_open(filename, true);
     if (!f)
     {
         printf("Failed to open: %s\n", filename);
+        playlist_cache_invalidate(); // Card changed under the cached playlist: rescan next time
         show_error_screen("Open Failed", "Cannot read file");
         isPlayerActive = false; // Unlock before returning
         return;
     }
 
-    // ... (Keep setvbuf, fseek, variable setups) ...
-    setvbuf(f, NULL, _IOFBF, 4096);
     currentAudioFile = f;
-    fseek(f, 0, SEEK_END);
-    currentFileSize = ftell(f);
-    fseek(f, 0, SEEK_SET);
+    currentFileSize = track_size(f);
     currentFilePosition = 0;
+    currentPositionMs = 0;
+    playlist_cache_verify(currentTrack, currentFileSize);
+
+    int64_t switch_start_us = esp_timer_get_time(); // Track switch latency for the output metrics
+
+    // === SEEK INDEX: load the sidecar, or build one while this track plays ===
+    SeekIndexHeader index_hdr;
+    SeekIndexBuilder index_builder = {0};
+    bool has_index = load_seek_index(filename, currentFileSize, &index_hdr);
+    if (has_index)
+    {
+        currentDurationMs = seek_index_duration_ms(&index_hdr);
+        printf("Seek index loaded: %lu frames, %lu ms\n",
+               (unsigned long)index_hdr.total_frames, (unsigned long)currentDurationMs);
+    }
+    else
+    {
+        seek_index_begin(&index_builder);
+    }
+
+    // === STREAM INFO: Xing/VBRI frame count and TOC as the fallback ===
+    // input_buffer is free until the pipeline starts, so use it as scratch
+    bool has_stream_info = probe_stream_info(f, currentFileSize, input_buffer, &currentStreamInfo);
+    if (!has_index)
+    {
+        currentDurationMs = has_stream_info ? stream_info_duration_ms(&currentStreamInfo) : 0;
+        printf("Stream info: %s, %lu frames, %lu ms\n",
+               currentStreamInfo.has_xing_toc ? "Xing TOC" : (currentStreamInfo.vbri_entries ? "VBRI" : "CBR"),
+               (unsigned long)currentStreamInfo.total_frames, (unsigned long)currentDurationMs);
+    }
+    seekAvailable = has_index || (has_stream_info && currentDurationMs > 0);
+    seekRequestMs = -1;
+
+    int32_t trim_skip;  // Samples still to drop at the start (encoder + decoder delay)
+    int64_t trim_valid; // Samples left before the encoder padding, -1 = play everything
+    stream_info_trim(&currentStreamInfo, &trim_skip, &trim_valid);
+
+    // Pick up a saved resume point for this file
+    if (resumePath[0] != '\0' && strcmp(resumePath, filename) == 0)
+    {
+        if (seekAvailable && resumePositionMs > 0)
+            seekRequestMs = resumePositionMs;
+        resumePath[0] = '\0';
+        resumePositionMs = 0;
+        save_resume_point("", 0);
+    }
 
     // ... (Keep track name logic) ...
     if (currentTrack >= 0 && currentTrack < playlistSize)
     {
-        strncpy(currentTrackName, playlist[currentTrack].displayname, sizeof(currentTrackName) - 1);
-        currentTrackName[sizeof(currentTrackName) - 1] = '\0';
+        playlist_display(currentTrack, currentTrackName, sizeof(currentTrackName));
     }
     else
     {
@@ -2437,22 +4593,50 @@ void play_file(const char *filename)
     totalPausedTime = 0;
     pauseStartTime = 0;
 
-    HMP3Decoder hMP3Decoder = MP3InitDecoder();
+    HMP3Decoder hMP3Decoder = MP3InitDecoderStatic(decoder_arena, MP3GetDecoderArenaSize());
     if (!hMP3Decoder)
     {
         printf("MP3 decoder init failed\n");
-        fclose(f);
+        seek_index_abort(&index_builder);
+        track_close(f);
         currentAudioFile = NULL;
         isPlaying = false;
         isPlayerActive = false; // Unlock before returning
         return;
     }
-
-    int bytes_in_buffer = 0;
-    uint8_t *read_ptr = input_buffer;
-    size_t total_input_bytes_processed = 0;
-    bool sample_rate_configured = false;
-    int current_sample_rate = 44100;
+    int rate_shift = apply_decode_mode(hMP3Decoder, &currentStreamInfo, has_stream_info);
+
+    // === START PIPELINE ===
+    uint32_t bytes_per_s = readahead_bytes_per_sec(&currentStreamInfo, currentDurationMs);
+    ring_init(&mp3_ring, input_buffer, readahead_resize(bytes_per_s), MP3_BUF_MIRROR_PLAYING);
+    readahead_set_rate(bytes_per_s);
+    ring_align_to(&mp3_ring, currentStreamInfo.audio_start, SD_SECTOR_SIZE);
+    ring_init(&pcm_ring, pcm_buffer, PCM_BUF_SIZE_PLAYING, 0);
+    i2sUnderruns = 0;
+    resyncCount = resyncSkippedBytes = resyncFalse = 0;
+    gain_ramp_reset(&gainRamp, 0); // Feeder is parked: start every (non-gapless) track with a fade-in
+    decoderTaskHandle = xTaskGetCurrentTaskHandle();
+    readerFile = f;
+    // Start past the ID3v2 tag and stop before the trailers instead of sync-scanning through them
+    track_seek(f, currentStreamInfo.audio_start);
+    streamBaseOffset = currentStreamInfo.audio_start - (uint32_t)mp3_ring.tail;
+    readerBaseOffset = streamBaseOffset;
+    readerGap = 0;
+    streamEndOffset = currentStreamInfo.audio_end;
+    pendingTrackReady = false;
+    currentFilePosition = currentStreamInfo.audio_start;
+    readerRunning = true;
+    feederRunning = true;
+    xTaskNotifyGive(sdReaderTaskHandle);
+
+    uint64_t decoded_samples = 0; // Per channel, from the start of the track
+    bool reached_eof = false;
+    bool output_configured = false; // Output format checked against this track's first frame
+    Mp3SyncLock sync_lock = {0};     // Format of this track's frames, set by the first confirmed sync
+    bool need_resync = true;         // Scan and confirm instead of expecting a header at the read pointer
+    bool resynced = false;           // The frame being decoded came from a scan
+    bool scanning = false;           // A scan waits for more data: stay in it, the read pointer is no header
+    int64_t last_stats_time = esp_timer_get_time();
 
     // === MAIN DECODE LOOP ===
     while (1)
@@ -2467,93 +4651,380 @@ void play_file(const char *filename)
             continue;
         }
 
-        // ... (Keep all your reading and decoding logic exactly the same) ...
-        int bytes_to_read = MP3_BUF_SIZE_PLAYING - bytes_in_buffer;
-        if (bytes_to_read > 0)
+        int32_t seek_ms = seekRequestMs;
+        if (seek_ms >= 0)
+        {
+            seekRequestMs = -1;
+            uint32_t seek_offset = 0, seek_frame = 0;
+            bool exact = has_index && seek_index_lookup(filename, &index_hdr, seek_ms, &seek_offset, &seek_frame);
+            if (exact || (has_stream_info && stream_info_seek(&currentStreamInfo, seek_ms, &seek_offset)))
+            {
+                seek_index_abort(&index_builder); // Offsets are no longer sequential
+                pipeline_seek(f, seek_offset);
+
+                // Drop the bit reservoir of the old position
+                MP3ResetDecoder(hMP3Decoder);
+                need_resync = true;
+
+                if (exact)
+                {
+                    decoded_samples = (uint64_t)seek_frame * index_hdr.samples_per_frame;
+                    currentPositionMs = (uint32_t)(decoded_samples * 1000 / index_hdr.sample_rate);
+                }
+                else
+                {
+                    // TOC/CBR seek is approximate: take the requested time as the new clock
+                    decoded_samples = (uint64_t)seek_ms * currentStreamInfo.sample_rate / 1000;
+                    currentPositionMs = seek_ms;
+                }
+
+                int32_t lead_in;
+                int64_t total_valid;
+                stream_info_trim(&currentStreamInfo, &lead_in, &total_valid);
+                trim_skip = 0;
+                trim_valid = (total_valid < 0) ? -1 : MAX(0, total_valid - ((int64_t)decoded_samples - lead_in));
+                currentFilePosition = seek_offset;
+                printf("Seek to %ld ms -> %s @ %lu\n", (long)seek_ms,
+                       exact ? "index" : "TOC", (unsigned long)seek_offset);
+            }
+        }
+
+        // === GAPLESS: the reader queued the next track right behind this one ===
+        if (__atomic_load_n(&pendingTrackReady, __ATOMIC_ACQUIRE) &&
+            (ptrdiff_t)(mp3_ring.tail - pendingTrack.boundary) >= 0)
         {
-            if (bytes_in_buffer > 0 && read_ptr != input_buffer)
+            // The decoder and I2S stay up; only the per-track state moves on
+            seek_index_finish(&index_builder, filename, currentFileSize);
+            playlist_cache_set_duration(currentTrack, currentDurationMs);
+            track_close(f);
+
+            f = pendingTrack.f;
+            playlist_path(pendingTrack.track, track_path, sizeof(track_path));
+            filename = track_path;
+            currentTrack = pendingTrack.track;
+            currentAudioFile = f;
+            currentFileSize = pendingTrack.file_size;
+            currentStreamInfo = pendingTrack.info;
+            has_stream_info = pendingTrack.has_info;
+            has_index = pendingTrack.has_index;
+            index_hdr = pendingTrack.index_hdr;
+            streamBaseOffset = pendingTrack.base_offset;
+
+            if (has_index)
             {
-                memmove(input_buffer, read_ptr, bytes_in_buffer);
+                currentDurationMs = seek_index_duration_ms(&index_hdr);
             }
-            read_ptr = input_buffer;
-            int bytes_read = fread(input_buffer + bytes_in_buffer, 1, bytes_to_read, f);
-            if (bytes_read == 0 && bytes_in_buffer == 0)
-                break;
-            bytes_in_buffer += bytes_read;
+            else
+            {
+                currentDurationMs = has_stream_info ? stream_info_duration_ms(&currentStreamInfo) : 0;
+                seek_index_begin(&index_builder);
+            }
+            seekAvailable = has_index || (has_stream_info && currentDurationMs > 0);
+            stream_info_trim(&currentStreamInfo, &trim_skip, &trim_valid);
+            // Decode the new track as if it played on its own: its frames never
+            // reach into the old bit reservoir, and the LAME trim drops exactly
+            // the start-up of a cleared overlap and filterbank. Carried-over
+            // state would leak the old track's tail into the first granules.
+            MP3ResetDecoder(hMP3Decoder);
+            rate_shift = apply_decode_mode(hMP3Decoder, &currentStreamInfo, has_stream_info);
+
+            decoded_samples = 0;
+            currentPositionMs = 0;
+            currentFilePosition = currentStreamInfo.audio_start;
+            output_configured = false;
+            sync_lock.valid = false;
+            need_resync = true;
+            switch_start_us = esp_timer_get_time();
+
+            playlist_display(currentTrack, currentTrackName, sizeof(currentTrackName));
+            playbackStartTime = xTaskGetTickCount() * portTICK_PERIOD_MS;
+            totalPausedTime = 0;
+
+            __atomic_store_n(&pendingTrackReady, false, __ATOMIC_RELEASE);
+            xTaskNotifyGive(sdReaderTaskHandle);
+            printf("Gapless: now playing track %d\n", currentTrack + 1);
         }
 
-        int offset = MP3FindSyncWord(read_ptr, bytes_in_buffer);
-        if (offset < 0)
+        // Decode straight out of the compressed ring; the mirrored tail keeps
+        // at least one full frame contiguous across the wrap point
+        size_t contiguous;
+        uint8_t *read_ptr = ring_read_ptr(&mp3_ring, &contiguous);
+
+        // Never let a frame straddle the boundary to the next track
+        bool at_track_boundary = false;
+        if (__atomic_load_n(&pendingTrackReady, __ATOMIC_ACQUIRE))
+        {
+            size_t to_boundary = pendingTrack.gap_start - mp3_ring.tail;
+            if (contiguous >= to_boundary)
+            {
+                contiguous = to_boundary;
+                at_track_boundary = true;
+            }
+        }
+
+        int bytes_in_buffer = (int)contiguous;
+        if (bytes_in_buffer == 0 && at_track_boundary)
+        {
+            // Drop the alignment gap in front of the next track once the reader has passed it
+            size_t gap = pendingTrack.boundary - pendingTrack.gap_start;
+            if (ring_used(&mp3_ring) >= gap)
+                ring_consume(&mp3_ring, gap);
+            else
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(5));
+            continue;
+        }
+        if (bytes_in_buffer == 0)
         {
-            bytes_in_buffer = 0;
+            if (mp3_ring.eof)
+            {
+                reached_eof = true;
+                break;
+            }
+            mp3_ring.underruns++;
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20));
             continue;
         }
+
+        // In sync the previous frame ends right on the next header; otherwise scan
+        int offset = 0;
+        resynced = need_resync || scanning || !frame_in_sync(read_ptr, bytes_in_buffer, &sync_lock);
+        if (resynced)
+        {
+            scanning = true;
+            bool final = mp3_ring.eof || at_track_boundary;
+            ResyncResult rs = mp3_resync(read_ptr, bytes_in_buffer, &sync_lock, final, &offset);
+            if (rs != RESYNC_FOUND)
+            {
+                ring_consume(&mp3_ring, offset);
+                resyncSkippedBytes += offset;
+                xTaskNotifyGive(sdReaderTaskHandle);
+                if (rs == RESYNC_NEED_MORE || offset == 0)
+                {
+                    mp3_ring.underruns++;
+                    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20));
+                }
+                continue;
+            }
+            resyncSkippedBytes += offset;
+            if (!need_resync)
+            {
+                resyncCount++; // Lost sync mid-stream (not a start, seek or track switch)
+                seek_index_abort(&index_builder); // Frame numbers past the gap are unknown
+            }
+            need_resync = false;
+            scanning = false;
+        }
         read_ptr += offset;
         bytes_in_buffer -= offset;
 
+        uint32_t frame_offset = streamBaseOffset + (uint32_t)mp3_ring.tail + offset;
+
+        // The Xing/Info/VBRI frame decodes to silence: never play or index it, so
+        // index frame numbers match the decoded sample count and the LAME trim
+        if (currentStreamInfo.info_frame_bytes > 0 && frame_offset == currentStreamInfo.audio_start &&
+            bytes_in_buffer >= (int)currentStreamInfo.info_frame_bytes)
+        {
+            ring_consume(&mp3_ring, offset + currentStreamInfo.info_frame_bytes);
+            continue;
+        }
+
         uint8_t *ptr_before_decode = read_ptr;
         int err = MP3Decode(hMP3Decoder, &read_ptr, &bytes_in_buffer, output_buffer, 0);
 
+        Mp3FrameHeader frame_hdr;
+        bool have_hdr = false;
+        if (err == ERR_MP3_NONE || err == ERR_MP3_MAINDATA_UNDERFLOW)
+        {
+            need_resync = false;
+            have_hdr = parse_frame_header(ptr_before_decode, &frame_hdr);
+            if (have_hdr)
+                seek_index_add_frame(&index_builder, frame_offset, frame_hdr.sample_rate, frame_hdr.samples_per_frame);
+        }
+
         if (err == ERR_MP3_NONE)
         {
-            // ... (Keep sample rate check, volume, i2s write) ...
             int input_bytes_consumed = read_ptr - ptr_before_decode;
+            ring_consume(&mp3_ring, offset + input_bytes_consumed);
+            xTaskNotifyGive(sdReaderTaskHandle);
             MP3FrameInfo frameInfo;
             MP3GetLastFrameInfo(hMP3Decoder, &frameInfo);
 
-            if (!sample_rate_configured)
+            if (!output_configured)
             {
-                current_sample_rate = frameInfo.samprate;
-                i2s_channel_disable(tx_handle);
-                i2s_std_clk_config_t clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(current_sample_rate);
-                i2s_channel_reconfig_std_clock(tx_handle, &clk_cfg);
-                i2s_channel_enable(tx_handle);
-                sample_rate_configured = true;
+                // A gapless chain changed format: play out the previous track first
+                // (at track start the ring is already empty)
+                if (!audio_output_matches(frameInfo.samprate, frameInfo.nChans))
+                {
+                    while (ring_used(&pcm_ring) > 0 && !stopPlayback && isPlaying)
+                    {
+                        vTaskDelay(pdMS_TO_TICKS(5));
+                    }
+                }
+                audio_output_configure(frameInfo.samprate, frameInfo.nChans);
+                audio_output_track_started(switch_start_us);
+                output_configured = true;
+
+                AudioOutputMetrics metrics;
+                get_audio_output_metrics(&metrics);
+                printf("Track start: first frame after %lu us (audio at %lu, %lu reconfigs, %lu skipped)\n",
+                       (unsigned long)metrics.last_switch_us, (unsigned long)currentStreamInfo.audio_start,
+                       (unsigned long)metrics.reconfigs, (unsigned long)metrics.reconfigs_skipped);
             }
 
-            apply_volume_fast(output_buffer, frameInfo.outputSamps);
+            // Gapless trim: drop the encoder/decoder delay and the end padding
+            // (counted in source samples; half-rate output carries one in two)
+            int frame_samples = (frameInfo.outputSamps / frameInfo.nChans) << rate_shift;
+            int skip;
+            int emit = stream_trim_frame(&trim_skip, &trim_valid, frame_samples, &skip);
 
-            size_t bytes_to_write = frameInfo.outputSamps * sizeof(short);
+            // Hand the frame to the I2S feeder, waiting while the PCM ring is full
+            size_t bytes_to_write = (size_t)(emit >> rate_shift) * frameInfo.nChans * sizeof(short);
             size_t bytes_written = 0;
-            uint8_t *write_ptr = (uint8_t *)output_buffer;
+            uint8_t *write_ptr = (uint8_t *)(output_buffer + (skip >> rate_shift) * frameInfo.nChans);
 
             while (bytes_written < bytes_to_write)
             {
-                if (stopPlayback || !isPlaying || isPaused)
+                if (stopPlayback || !isPlaying)
                     break;
-                size_t chunk_written;
-                size_t chunk_size = bytes_to_write - bytes_written;
-                if (chunk_size > 2048)
-                    chunk_size = 2048;
-                i2s_channel_write(tx_handle, write_ptr + bytes_written, chunk_size, &chunk_written, portMAX_DELAY);
+                size_t chunk_written = ring_write(&pcm_ring, write_ptr + bytes_written, bytes_to_write - bytes_written);
                 bytes_written += chunk_written;
+                // Only wake the feeder once it has a full batch to send
+                if (bytes_written < bytes_to_write || ring_used(&pcm_ring) >= pcm_batch_bytes())
+                    xTaskNotifyGive(i2sFeederTaskHandle);
+                if (bytes_written < bytes_to_write)
+                    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20));
             }
             if (bytes_written == bytes_to_write)
             {
-                total_input_bytes_processed += input_bytes_consumed;
-                currentFilePosition = total_input_bytes_processed;
+                decoded_samples += frame_samples;
+                currentPositionMs = (uint32_t)(decoded_samples * 1000 / (frameInfo.samprate << rate_shift));
+                currentFilePosition = frame_offset + input_bytes_consumed;
+            }
+        }
+        else if (err == ERR_MP3_INDATA_UNDERFLOW)
+        {
+            // Partial frame: wait for more data, or drop the tail at end of file
+            ring_consume(&mp3_ring, offset);
+            if (at_track_boundary)
+            {
+                ring_consume(&mp3_ring, bytes_in_buffer); // Truncated last frame of this track
+                continue;
+            }
+            if (mp3_ring.eof)
+            {
+                reached_eof = true;
+                break;
+            }
+            mp3_ring.underruns++;
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20));
+            continue;
+        }
+        else if (err == ERR_MP3_MAINDATA_UNDERFLOW)
+        {
+            // A valid frame whose bit reservoir is not filled yet (first frame after
+            // a seek or resume): no PCM, but it still occupies its share of the
+            // timeline, so position and the gapless trim move past it. Sync holds.
+            int consumed = read_ptr - ptr_before_decode;
+            ring_consume(&mp3_ring, offset + consumed);
+            xTaskNotifyGive(sdReaderTaskHandle);
+            if (have_hdr)
+            {
+                int frame_samples = frame_hdr.samples_per_frame;
+                int skip;
+                stream_trim_frame(&trim_skip, &trim_valid, frame_samples, &skip);
+                decoded_samples += frame_samples;
+                currentPositionMs = (uint32_t)(decoded_samples * 1000 / frame_hdr.sample_rate);
+                currentFilePosition = frame_offset + consumed;
             }
         }
-        else if (err == ERR_MP3_INDATA_UNDERFLOW)
+        else
         {
-            continue;
+            // Keep whatever the decoder consumed (e.g. a frame that only fed the
+            // bit reservoir), otherwise skip past the bad sync byte
+            int consumed = read_ptr - ptr_before_decode;
+            ring_consume(&mp3_ring, offset + (consumed > 0 ? consumed : 1));
+            if (resynced)
+                resyncFalse++; // Confirmed header, but the frame itself was bad
+            need_resync = true;
+            seek_index_abort(&index_builder); // The bad frame is missing from the decoded count
         }
-        else
+
+        int64_t now = esp_timer_get_time();
+        if (now - last_stats_time >= 5000000)
         {
-            if (bytes_in_buffer > 0)
-            {
-                read_ptr++;
-                bytes_in_buffer--;
-            }
+            PipelineStats stats;
+            get_pipeline_stats(&stats);
+            printf("Pipeline: mp3 %u/%u (%lu underruns, %u bytes copied), pcm %u/%u (%lu underruns), "
+                   "i2s %lu underruns, %lu writes of %u bytes, %lu resyncs (%lu bytes, %lu false)\n",
+                   (unsigned)stats.mp3_fill, (unsigned)stats.mp3_size, (unsigned long)stats.reader_underruns,
+                   (unsigned)stats.mp3_copy_bytes,
+                   (unsigned)stats.pcm_fill, (unsigned)stats.pcm_size, (unsigned long)stats.decoder_underruns,
+                   (unsigned long)stats.i2s_underruns, (unsigned long)stats.i2s_writes, (unsigned)stats.i2s_batch_bytes,
+                   (unsigned long)stats.resyncs, (unsigned long)stats.resync_bytes, (unsigned long)stats.resync_false);
+            ReadAheadStats ra;
+            get_readahead_stats(&ra);
+            printf("Read-ahead: %u/%u bytes (%lu ms, ring %u), %lu stalls in %lu reads, max %lu us\n",
+                   (unsigned)ra.fill, (unsigned)ra.watermark, (unsigned long)ra.fill_ms, (unsigned)ra.capacity,
+                   (unsigned long)ra.stalls, (unsigned long)ra.reads, (unsigned long)ra.max_latency_us);
+            last_stats_time = now;
+        }
+    }
+
+    // === DRAIN: Let the feeder play out what is already decoded ===
+    pcm_ring.eof = true;
+    xTaskNotifyGive(i2sFeederTaskHandle);
+    while (ring_used(&pcm_ring) > 0 && !stopPlayback && isPlaying)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    // Stop/skip: fade out over the next ramp instead of cutting mid-waveform
+    if (stopPlayback || !isPlaying)
+    {
+        gainFadeOut = true;
+        xTaskNotifyGive(i2sFeederTaskHandle);
+        for (int i = 0; i < 20 && !gain_stage_silent(); i++)
+        {
+            vTaskDelay(pdMS_TO_TICKS(5));
         }
     }
 
+    // === STOP PIPELINE ===
+    feederRunning = false;
+    wait_stage_idle(&feederIdle, i2sFeederTaskHandle);
+    gainFadeOut = false;
+    readerRunning = false;
+    wait_stage_idle(&readerIdle, sdReaderTaskHandle);
+    if (pendingTrackReady)
+    {
+        track_close(pendingTrack.f);
+        pendingTrackReady = false;
+    }
+    readerFile = NULL;
+    decoderTaskHandle = NULL;
+
     // === CLEANUP ===
-    MP3FreeDecoder(hMP3Decoder);
-    fclose(f);
+    track_close(f);
     currentAudioFile = NULL;
+    playlist_cache_set_duration(currentTrack, currentDurationMs);
+
+    if (reached_eof && !stopPlayback)
+    {
+        // Only a complete, sequential pass produces a valid index
+        seek_index_finish(&index_builder, filename, currentFileSize);
+    }
+    else
+    {
+        seek_index_abort(&index_builder);
+        if (stopPlayback && !changeTrack && currentPositionMs > 0)
+            save_resume_point(filename, currentPositionMs);
+    }
+
     currentFileSize = 0;
     currentFilePosition = 0;
+    currentPositionMs = 0;
+    currentDurationMs = 0;
+    seekAvailable = false;
 
     // === UNLOCK: Tell system we are done with the buffer ===
     isPlayerActive = false;
@@ -2650,6 +5121,75 @@ void show_volume_screen(void)
     u8g2_SendBuffer(&u8g2);
 }
 
+void request_seek_relative(int32_t delta_ms)
+{
+    if (!isPlaying || !seekAvailable || currentDurationMs == 0)
+        return;
+
+    int32_t base = (seekRequestMs >= 0) ? seekRequestMs : (int32_t)currentPositionMs;
+    int32_t target = base + delta_ms;
+    if (target < 0)
+        target = 0;
+    if (target > (int32_t)currentDurationMs - 1000)
+        target = (int32_t)currentDurationMs - 1000;
+    if (target < 0)
+        target = 0;
+    seekRequestMs = target;
+}
+
+void show_seek_screen(void)
+{
+    u8g2_ClearBuffer(&u8g2);
+
+    u8g2_SetDrawColor(&u8g2, 1);
+    u8g2_DrawBox(&u8g2, 0, 0, 128, 12);
+    u8g2_SetDrawColor(&u8g2, 0);
+    u8g2_SetFont(&u8g2, u8g2_font_helvB08_tr);
+    const char *headerText = "SEEK";
+    int headerWidth = u8g2_GetStrWidth(&u8g2, headerText);
+    u8g2_DrawStr(&u8g2, (128 - headerWidth) / 2, 10, headerText);
+
+    u8g2_SetDrawColor(&u8g2, 1);
+
+    if (!isPlaying || !seekAvailable || currentDurationMs == 0)
+    {
+        u8g2_SetFont(&u8g2, u8g2_font_6x10_tr);
+        const char *msg = isPlaying ? "No seek index yet" : "Not playing";
+        int msgWidth = u8g2_GetStrWidth(&u8g2, msg);
+        u8g2_DrawStr(&u8g2, (128 - msgWidth) / 2, 38, msg);
+        u8g2_SendBuffer(&u8g2);
+        return;
+    }
+
+    uint32_t shownMs = (seekRequestMs >= 0) ? (uint32_t)seekRequestMs : currentPositionMs;
+    char timeStr[24];
+    snprintf(timeStr, sizeof(timeStr), "%lu:%02lu / %lu:%02lu",
+             (unsigned long)(shownMs / 60000), (unsigned long)(shownMs / 1000 % 60),
+             (unsigned long)(currentDurationMs / 60000), (unsigned long)(currentDurationMs / 1000 % 60));
+    u8g2_SetFont(&u8g2, u8g2_font_helvB10_tr);
+    int timeWidth = u8g2_GetStrWidth(&u8g2, timeStr);
+    u8g2_DrawStr(&u8g2, (128 - timeWidth) / 2, 32, timeStr);
+
+    int barX = 4;
+    int barY = 40;
+    int barWidth = 120;
+    int barHeight = 6;
+    u8g2_DrawRFrame(&u8g2, barX, barY, barWidth, barHeight, 2);
+    int fill = (int)((uint64_t)shownMs * (barWidth - 2) / currentDurationMs);
+    if (fill > barWidth - 2)
+        fill = barWidth - 2;
+    if (fill > 0)
+    {
+        u8g2_DrawBox(&u8g2, barX + 1, barY + 1, fill, barHeight - 2);
+    }
+
+    u8g2_SetFont(&u8g2, u8g2_font_6x10_tr);
+    u8g2_DrawStr(&u8g2, 4, 60, "UP +10s");
+    u8g2_DrawStr(&u8g2, 80, 60, "DN -10s");
+
+    u8g2_SendBuffer(&u8g2);
+}
+
 // === HTTP Handlers ===
 
 static esp_err_t root_handler(httpd_req_t *req)
@@ -2679,7 +5219,8 @@ static esp_err_t list_handler(httpd_req_t *req)
     bool first = true;
     while ((entry = readdir(dir)) != NULL)
     {
-        if (entry->d_type == DT_REG)
+        const char *ext = strrchr(entry->d_name, '.');
+        if (entry->d_type == DT_REG && !(ext && strcasecmp(ext, ".idx") == 0))
         {
             char path[300];
             snprintf(path, sizeof(path), "%s/%s", MOUNT_POINT, entry->d_name);
@@ -2721,6 +5262,12 @@ static esp_err_t delete_handler(httpd_req_t *req)
 
         if (unlink(filepath) == 0)
         {
+            clmt_pool_invalidate();
+            playlist_cache_invalidate();
+            playlist_journal_record(JOURNAL_REMOVE, param, 0);
+            char idx_path[264];
+            seek_index_path(filepath, idx_path, sizeof(idx_path));
+            unlink(idx_path);
             httpd_resp_sendstr(req, "Deleted");
         }
         else
@@ -2776,6 +5323,142 @@ static void sanitize_filename(char *dest, const char *src, size_t max_len)
     strcpy(dest + j, ext);
 }
 
+// === Upload Writer: SD writes overlap the next receive ===
+// upload_handler() fills one UPLOAD_HALF_SIZE half of upload_buffer_ptr with
+// httpd_req_recv() and hands it here, then fills the other half while this
+// task writes. The halves are whole FAT sectors, so FATFS writes them to the
+// card directly instead of through its sector window.
+typedef struct
+{
+    FILE *file;
+    const uint8_t *data; // Half being written
+    size_t len;
+    volatile bool busy;   // Set by the handler, cleared when the write is done
+    volatile bool failed; // Sticky: later halves are dropped
+    volatile bool quit;
+    TaskHandle_t owner;   // Handler task, notified after each write
+} UploadWriter;
+
+static UploadWriter uploadWriter;
+static TaskHandle_t uploadWriterTaskHandle = NULL;
+
+static void upload_writer_task(void *arg)
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (uploadWriter.quit)
+            break;
+        if (!uploadWriter.busy)
+            continue;
+
+        if (!uploadWriter.failed &&
+            flush_buffer_to_sd(uploadWriter.file, uploadWriter.data, uploadWriter.len) != ESP_OK)
+        {
+            uploadWriter.failed = true;
+        }
+        uploadWriter.busy = false;
+        xTaskNotifyGive(uploadWriter.owner);
+    }
+
+    uploadWriterTaskHandle = NULL;
+    xTaskNotifyGive(uploadWriter.owner);
+    vTaskDelete(NULL);
+}
+
+static bool upload_writer_start(FILE *file)
+{
+    memset(&uploadWriter, 0, sizeof(uploadWriter));
+    uploadWriter.file = file;
+    uploadWriter.owner = xTaskGetCurrentTaskHandle();
+    // Above httpd: it only runs to queue SPI transactions, then sleeps on them
+    return xTaskCreate(upload_writer_task, "sd_writer", 4096, NULL, 6, &uploadWriterTaskHandle) == pdPASS;
+}
+
+static void upload_writer_wait(void)
+{
+    while (uploadWriter.busy)
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20));
+}
+
+// Queue a half once the previous one is on the card; false after a write error
+static bool upload_writer_submit(const uint8_t *data, size_t len)
+{
+    upload_writer_wait();
+    if (uploadWriter.failed)
+        return false;
+    uploadWriter.data = data;
+    uploadWriter.len = len;
+    uploadWriter.busy = true;
+    xTaskNotifyGive(uploadWriterTaskHandle);
+    return true;
+}
+
+// Drain and end the writer task; false if any write failed
+static bool upload_writer_stop(void)
+{
+    upload_writer_wait();
+    uploadWriter.quit = true;
+    xTaskNotifyGive(uploadWriterTaskHandle);
+    while (uploadWriterTaskHandle != NULL)
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20));
+    return !uploadWriter.failed;
+}
+
+static bool upload_sector_read(void *ctx, uint32_t sector, uint8_t *buf)
+{
+    return ff_disk_read(*(BYTE *)ctx, buf, sector, 1) == RES_OK;
+}
+
+// Read a closed upload back from the card, not from FATFS's window: its
+// directory entry, its FAT chain and its last sector must hold what was sent.
+// Raw reads bypass the FATFS lock, which is safe while uploads run: playback
+// is stopped in upload mode. exFAT and FAT12 entries are not checked.
+static bool upload_verify(const char *path, size_t size, const uint8_t *tail, size_t tail_len)
+{
+    char fpath[280];
+    FIL fil;
+    if (!fatfs_path(path, fpath, sizeof(fpath)) || f_open(&fil, fpath, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+    {
+        printf("Upload verify: cannot open %s\n", path);
+        return false;
+    }
+    FATFS *fs = fil.obj.fs;
+    FatVolume vol = {
+        .fat_start = fs->fatbase,
+        .data_start = fs->database,
+        .n_fatent = fs->n_fatent,
+#if FF_MAX_SS != FF_MIN_SS
+        .sector_size = fs->ssize,
+#else
+        .sector_size = FF_MAX_SS,
+#endif
+        .cluster_sectors = fs->csize,
+        .fat_bits = fs->fs_type == FS_FAT32 ? 32 : 16,
+    };
+    bool checked = fs->fs_type == FS_FAT16 || fs->fs_type == FS_FAT32;
+    uint32_t dir_sect = fil.dir_sect;
+    uint32_t dir_offset = fil.dir_ptr - fs->win;
+    uint32_t first_cluster = fil.obj.sclust;
+    bool size_ok = fil.obj.objsize == size;
+    BYTE pdrv = fs->pdrv;
+    f_close(&fil);
+    if (!checked)
+        return size_ok;
+
+    uint8_t *sector = malloc(vol.sector_size);
+    if (!sector)
+        return false;
+    FatVerifyResult r = fat_verify_file(&vol, upload_sector_read, &pdrv, dir_sect, dir_offset, first_cluster, size,
+                                        tail, tail_len, sector);
+    free(sector);
+    if (r != FAT_VERIFY_OK)
+    {
+        printf("Upload verify failed: %s: %s on the card\n", path, fat_verify_result_name(r));
+    }
+    return r == FAT_VERIFY_OK;
+}
+
 static esp_err_t upload_handler(httpd_req_t *req)
 {
     char buf[256];
@@ -2802,6 +5485,8 @@ static esp_err_t upload_handler(httpd_req_t *req)
     snprintf(filepath, sizeof(filepath), "%s/%s", MOUNT_POINT, filename);
 
     unlink(filepath);
+    clmt_pool_invalidate();
+    playlist_cache_invalidate();
     upload_file = fopen(filepath, "wb");
     if (!upload_file)
     {
@@ -2812,23 +5497,41 @@ static esp_err_t upload_handler(httpd_req_t *req)
     // Optimize file buffer for SD card writing
     setvbuf(upload_file, NULL, _IONBF, 0);
 
+    // Build the seek index from the incoming stream, no extra SD reads needed
+    const char *upload_ext = strrchr(filename, '.');
+    SeekIndexBuilder index_builder = {0};
+    if (upload_ext && strcasecmp(upload_ext, ".mp3") == 0)
+    {
+        seek_index_begin(&index_builder);
+    }
+
+    // Receive straight into one half of upload_buffer_ptr while the writer
+    // task puts the other half on the card
+    if (!upload_writer_start(upload_file))
+    {
+        fclose(upload_file);
+        upload_file = NULL;
+        unlink(filepath);
+        playlist_journal_record(JOURNAL_REMOVE, filename, 0);
+        seek_index_abort(&index_builder);
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    uint8_t *half = upload_buffer_ptr;
+    size_t half_fill = 0;
+
     size_t remaining = req->content_len;
-    buffer_index = 0;
     total_received = 0;
     upload_start_time = esp_timer_get_time();
-    int64_t last_log_time = upload_start_time;
+    size_t min_free_heap = esp_get_free_heap_size();
     int64_t last_yield_time = upload_start_time;
 
     esp_err_t ret = ESP_OK;
-    bool upload_failed = false;
 
-    while (remaining > 0 && !upload_failed)
+    while (remaining > 0)
     {
-        // === CHANGED: Use Defined Size for WiFi ===
-        size_t recv_size = MIN(remaining, RECV_BUF_SIZE_WIFI);
-
-        // === CHANGED: Use Pointer receive_buffer_ptr ===
-        int received = httpd_req_recv(req, (char *)receive_buffer_ptr, recv_size);
+        size_t recv_size = MIN(remaining, UPLOAD_HALF_SIZE - half_fill);
+        int received = httpd_req_recv(req, (char *)half + half_fill, recv_size);
 
         if (received <= 0)
         {
@@ -2837,54 +5540,29 @@ static esp_err_t upload_handler(httpd_req_t *req)
                 continue;
             }
             ret = ESP_FAIL;
-            upload_failed = true;
             break;
         }
 
-        size_t bytes_to_copy = received;
-        size_t copied = 0;
+        seek_index_feed(&index_builder, half + half_fill, received);
+        half_fill += received;
+        total_received += received;
+        remaining -= received;
 
-        while (copied < bytes_to_copy && !upload_failed)
+        // A full half goes to the writer; the other one is free once its own write is done
+        if (half_fill == UPLOAD_HALF_SIZE)
         {
-            // === CHANGED: Use Defined Size for WiFi ===
-            size_t space_left = UPLOAD_BUF_SIZE_WIFI - buffer_index;
-            size_t to_copy = MIN(space_left, bytes_to_copy - copied);
-
-            // === CHANGED: Use Pointers ===
-            memcpy(upload_buffer_ptr + buffer_index,
-                   receive_buffer_ptr + copied, to_copy);
-
-            buffer_index += to_copy;
-            copied += to_copy;
-
-            // === CHANGED: Use Defined Size ===
-            if (buffer_index >= UPLOAD_BUF_SIZE_WIFI)
+            if (!upload_writer_submit(half, half_fill))
             {
-                // === CHANGED: Use Pointer ===
-                if (flush_buffer_to_sd(upload_file, upload_buffer_ptr, buffer_index) != ESP_OK)
-                {
-                    ret = ESP_FAIL;
-                    upload_failed = true;
-                    break;
-                }
-                buffer_index = 0;
+                ret = ESP_FAIL;
+                break;
             }
+            half = (half == upload_buffer_ptr) ? upload_buffer_ptr + UPLOAD_HALF_SIZE : upload_buffer_ptr;
+            half_fill = 0;
         }
 
-        if (upload_failed)
-        {
-            break;
-        }
-
-        total_received += received;
-        remaining -= received;
+        min_free_heap = MIN(min_free_heap, esp_get_free_heap_size());
 
         int64_t now = esp_timer_get_time();
-        if (now - last_log_time >= 500000)
-        {
-            last_log_time = now;
-        }
-
         if (now - last_yield_time >= 100000)
         {
             taskYIELD();
@@ -2892,61 +5570,88 @@ static esp_err_t upload_handler(httpd_req_t *req)
         }
     }
 
-    // === CHANGED: Flush remaining using Pointer ===
-    if (ret == ESP_OK && buffer_index > 0)
+    // Tail of the file, then wait for every write to land
+    if (ret == ESP_OK && half_fill > 0 && !upload_writer_submit(half, half_fill))
+    {
+        ret = ESP_FAIL;
+    }
+    if (!upload_writer_stop())
     {
-        ret = flush_buffer_to_sd(upload_file, upload_buffer_ptr, buffer_index);
+        ret = ESP_FAIL;
     }
 
-    // === IMPROVED CLEANUP WITH PROPER SYNC ===
-    // === IMPROVED CLEANUP WITH PROPER SYNC ===
+    // === Durable commit without a remount ===
+    // fsync() is f_sync(): it writes the file's buffered last sector, then the
+    // FAT window, then the directory entry (size, first cluster, timestamp),
+    // and FSInfo last. Up to the entry's write a power cut leaves the old
+    // track, none or an empty one (plus leaked clusters), never a size without
+    // its data; after it a remount finds the whole file. The FATFS cache stays
+    // warm for the next file of a multi-file upload. host_test/test_fat_commit
+    // cuts power after every sector write of this sequence.
     if (upload_file)
     {
-        // 1. Flush C library buffers
-        fflush(upload_file);
-
-        // 2. Get file descriptor and sync file data
-        int fd = fileno(upload_file);
-        if (fd >= 0)
+        if (fflush(upload_file) != 0 || fsync(fileno(upload_file)) != 0)
         {
-            // Multiple sync attempts to ensure write
-            for (int i = 0; i < 3; i++)
-            {
-                fsync(fd);
-                vTaskDelay(pdMS_TO_TICKS(50));
-            }
+            printf("Upload sync failed: %s\n", strerror(errno));
+            ret = ESP_FAIL;
+        }
+        if (fclose(upload_file) != 0)
+        {
+            ret = ESP_FAIL;
         }
-
-        // 3. Close file BEFORE unmounting
-        fclose(upload_file);
         upload_file = NULL;
 
-        // 4. CRITICAL: Unmount and remount to force filesystem consistency
-        printf("Forcing filesystem sync...\n");
-
-        // Unmount the SD card
-        esp_vfs_fat_sdcard_unmount(MOUNT_POINT, global_card);
-        vTaskDelay(pdMS_TO_TICKS(500));
-
-        // Remount the SD card
-        esp_vfs_fat_sdmmc_mount_config_t mount_config = {
-            .format_if_mount_failed = false,
-            .max_files = 5,
-            .allocation_unit_size = 64 * 1024,
-        };
-
-        sdmmc_card_t *card_new;
-        esp_err_t mount_ret = esp_vfs_fat_sdspi_mount(MOUNT_POINT, &global_host,
-                                                      &global_slot_config, &mount_config, &card_new);
+        // The last bytes received are still in the buffer: the half being
+        // filled, or the other one when the upload ended on a half boundary
+        const uint8_t *tail = half;
+        size_t tail_len = half_fill;
+        if (tail_len == 0 && total_received > 0)
+        {
+            tail = (half == upload_buffer_ptr) ? upload_buffer_ptr + UPLOAD_HALF_SIZE : upload_buffer_ptr;
+            tail_len = UPLOAD_HALF_SIZE;
+        }
+        if (ret == ESP_OK && !upload_verify(filepath, total_received, tail, tail_len))
+        {
+            ret = ESP_FAIL;
+        }
 
-        if (mount_ret != ESP_OK)
+        if (ret == ESP_OK)
         {
-            printf("Failed to remount SD card!\n");
+            int64_t elapsed_us = MAX(esp_timer_get_time() - upload_start_time, 1);
+            printf("File write completed, synced and read back: %s (%zu bytes, %lld ms, %llu KB/s, min free heap %u)\n",
+                   filepath, total_received, elapsed_us / 1000,
+                   (unsigned long long)total_received * 1000000 / 1024 / elapsed_us, (unsigned)min_free_heap);
         }
+    }
 
-        vTaskDelay(pdMS_TO_TICKS(200));
+    uint32_t duration_ms = 0;
+    if (ret == ESP_OK)
+    {
+        if (seek_index_finish(&index_builder, filepath, total_received) && index_builder.sample_rate > 0)
+        {
+            duration_ms = (uint32_t)((uint64_t)index_builder.total_frames * index_builder.samples_per_frame * 1000 /
+                                     index_builder.sample_rate);
+        }
+    }
+    else
+    {
+        seek_index_abort(&index_builder);
+    }
 
-        printf("File write completed and synced: %s (%zu bytes)\n", filepath, total_received);
+    if (ret == ESP_OK)
+    {
+        playlist_journal_record(JOURNAL_ADD, filename, duration_ms);
+    }
+    else
+    {
+        // Never leave a truncated track behind; any older file of this name was
+        // already replaced, so the playlist loses it too
+        printf("Upload failed: %s removed (%zu bytes received)\n", filepath, total_received);
+        unlink(filepath);
+        char idx_path[264];
+        seek_index_path(filepath, idx_path, sizeof(idx_path));
+        unlink(idx_path);
+        playlist_journal_record(JOURNAL_REMOVE, filename, 0);
     }
 
     if (ret == ESP_OK)
@@ -3153,6 +5858,255 @@ void show_heap_info_detailed(const char *stage, uint32_t free_heap, uint32_t min
     vTaskDelay(pdMS_TO_TICKS(2000));
 }
 
+#ifdef CONFIG_MP3_PLAYER_DECODE_BENCHMARK
+// === Decode Benchmark (CONFIG_MP3_PLAYER_DECODE_BENCHMARK) ===
+#define BENCH_DIR MOUNT_POINT "/bench"
+
+// Decode and resync benchmarks live in mp3_bench.c, shared with host_test/mp3bench
+static int64_t bench_now_ns(void)
+{
+    return esp_timer_get_time() * 1000;
+}
+
+// Heap check: the decoder lives in decoder_arena, so starting tracks and seeking
+// must not touch the heap. Each play re-inits the decoder as a track start does,
+// resets it halfway as a seek does, and decodes the head of a file already in
+// RAM, so no file I/O falls inside the measured windows.
+#define BENCH_HEAP_PLAYS 100
+#define BENCH_HEAP_FILES 8 // Files the plays cycle through
+
+static void benchmark_decoder_heap(char paths[][300], int count)
+{
+    if (count == 0)
+        return;
+
+    multi_heap_info_t before, after, play_before, play_after;
+    size_t min_free_before = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    heap_caps_get_info(&before, MALLOC_CAP_8BIT);
+    uint32_t frames = 0;
+    uint32_t changed_plays = 0;
+    int64_t worst_free_delta = 0;
+
+    for (int play = 0; play < BENCH_HEAP_PLAYS; play++)
+    {
+        FIL *f = track_open(paths[play % count], false);
+        if (!f)
+            continue;
+        int len = (int)track_read(f, input_buffer, MP3_BUF_SIZE_PLAYING);
+        track_close(f);
+
+        heap_caps_get_info(&play_before, MALLOC_CAP_8BIT);
+        HMP3Decoder dec = MP3InitDecoderStatic(decoder_arena, MP3GetDecoderArenaSize());
+        uint8_t *ptr = input_buffer;
+        int bytes_left = len;
+        bool seeked = false;
+        while (dec && bytes_left > 0)
+        {
+            int offset = MP3FindSyncWord(ptr, bytes_left);
+            if (offset < 0)
+                break;
+            ptr += offset;
+            bytes_left -= offset;
+            if (!seeked && ptr - input_buffer >= len / 2)
+            {
+                MP3ResetDecoder(dec);
+                seeked = true;
+            }
+            uint8_t *frame_start = ptr;
+            int err = MP3Decode(dec, &ptr, &bytes_left, output_buffer, 0);
+            if (err == ERR_MP3_NONE)
+                frames++;
+            else if (err == ERR_MP3_INDATA_UNDERFLOW)
+                break;
+            else if (err != ERR_MP3_MAINDATA_UNDERFLOW)
+            {
+                ptr = frame_start + 1;
+                bytes_left = len - (ptr - input_buffer);
+            }
+        }
+        heap_caps_get_info(&play_after, MALLOC_CAP_8BIT);
+
+        int64_t delta = (int64_t)play_after.total_free_bytes - (int64_t)play_before.total_free_bytes;
+        if (delta != 0 || play_after.allocated_blocks != play_before.allocated_blocks)
+            changed_plays++;
+        if (llabs(delta) > llabs(worst_free_delta))
+            worst_free_delta = delta;
+    }
+
+    heap_caps_get_info(&after, MALLOC_CAP_8BIT);
+    size_t min_free_after = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    printf("{\"test\":\"decoder_heap\",\"plays\":%d,\"frames\":%lu,\"free_delta\":%ld,"
+           "\"alloc_blocks_delta\":%ld,\"min_free_delta\":%ld,\"plays_with_heap_change\":%lu,"
+           "\"worst_play_free_delta\":%ld}\n",
+           BENCH_HEAP_PLAYS, (unsigned long)frames,
+           (long)((int64_t)after.total_free_bytes - (int64_t)before.total_free_bytes),
+           (long)after.allocated_blocks - (long)before.allocated_blocks,
+           (long)min_free_after - (long)min_free_before, (unsigned long)changed_plays, (long)worst_free_delta);
+}
+
+// Read benchmark: the old stdio path (4 KB buffer, decoder-sized freads) against
+// sector-aligned f_read on the track FIL as the SD reader task now does
+#define BENCH_READ_BYTES (1024 * 1024)
+#define BENCH_STDIO_CHUNK 4000
+
+static void benchmark_read_file(const char *path, const char *name)
+{
+    int64_t us[2] = {0, 0};
+    size_t total[2] = {0, 0};
+
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return;
+    setvbuf(f, NULL, _IOFBF, 4096);
+    int64_t t0 = esp_timer_get_time();
+    while (total[0] < BENCH_READ_BYTES)
+    {
+        size_t n = fread(input_buffer, 1, BENCH_STDIO_CHUNK, f);
+        if (n == 0)
+            break;
+        total[0] += n;
+    }
+    us[0] = esp_timer_get_time() - t0;
+    fclose(f);
+
+    FIL *tf = track_open(path, false);
+    if (!tf)
+        return;
+    t0 = esp_timer_get_time();
+    while (total[1] < BENCH_READ_BYTES)
+    {
+        size_t n = track_read(tf, input_buffer, MP3_BUF_SIZE_PLAYING - SD_SECTOR_SIZE);
+        if (n == 0)
+            break;
+        total[1] += n;
+    }
+    us[1] = esp_timer_get_time() - t0;
+    track_close(tf);
+
+    printf("{\"file\":\"%s\",\"test\":\"read\",\"bytes\":%u,\"stdio_kb_s\":%lu,\"stdio_us_per_mb\":%lu,"
+           "\"direct_kb_s\":%lu,\"direct_us_per_mb\":%lu}\n",
+           name, (unsigned)total[1],
+           us[0] ? (unsigned long)((uint64_t)total[0] * 1000000 / 1024 / us[0]) : 0,
+           total[0] ? (unsigned long)((uint64_t)us[0] * 1048576 / total[0]) : 0,
+           us[1] ? (unsigned long)((uint64_t)total[1] * 1000000 / 1024 / us[1]) : 0,
+           total[1] ? (unsigned long)((uint64_t)us[1] * 1048576 / total[1]) : 0);
+}
+
+// Seek benchmark: the validation pattern (20 spread seeks plus the tail, 512 bytes
+// each) with the FAT chain walk against a cluster link map. Copy a file onto a
+// nearly full, fragmented card to see the difference; contiguous files walk fast.
+#define BENCH_SEEK_POINTS 21
+
+static void benchmark_seek_file(const char *path, const char *name)
+{
+    int64_t us[2] = {0, 0};
+    int fragments = -1;
+
+    for (int fast = 0; fast < 2; fast++)
+    {
+        FIL *f = track_open(path, fast);
+        if (!f)
+            return;
+        uint32_t size = track_size(f);
+#if FF_USE_FASTSEEK
+        if (fast && f->cltbl)
+            fragments = (int)(f->cltbl[0] - 1) / 2;
+#endif
+
+        int64_t t0 = esp_timer_get_time();
+        for (int i = 0; i < BENCH_SEEK_POINTS; i++)
+        {
+            // Out-of-order positions so every seek is a fresh lookup
+            uint32_t pos = (i == BENCH_SEEK_POINTS - 1) ? size - MIN(size, 1024)
+                                                        : (size / 20) * ((i * 7) % 20);
+            track_seek(f, pos);
+            track_read(f, input_buffer, 512);
+        }
+        us[fast] = esp_timer_get_time() - t0;
+        track_close(f);
+    }
+
+    printf("{\"file\":\"%s\",\"test\":\"seek\",\"fragments\":%d,\"chain_us_per_seek\":%lu,"
+           "\"clmt_us_per_seek\":%lu}\n",
+           name, fragments, (unsigned long)(us[0] / BENCH_SEEK_POINTS),
+           (unsigned long)(us[1] / BENCH_SEEK_POINTS));
+}
+
+// Boot-to-ready for the playlist: full folder walk against the cache load.
+// Fill the card with 50 / 500 / 5000 files, or 10k files in 500 folders, to compare.
+static void benchmark_playlist_scan(void)
+{
+    free_playlist();
+    int64_t t0 = esp_timer_get_time();
+    scan_mp3_dir();
+    int64_t scan_us = esp_timer_get_time() - t0;
+    int tracks = playlistSize;
+    int folders = playlistFolderCount;
+    size_t ram = playlist_bytes();
+
+    t0 = esp_timer_get_time();
+    playlist_cache_save();
+    int64_t save_us = esp_timer_get_time() - t0;
+
+    free_playlist();
+    t0 = esp_timer_get_time();
+    bool hit = playlist_cache_load();
+    int64_t load_us = esp_timer_get_time() - t0;
+
+    printf("{\"test\":\"playlist\",\"tracks\":%d,\"folders\":%d,\"scan_ms\":%lu,\"scan_peak_heap\":%u,"
+           "\"ram_bytes\":%u,\"cache_save_ms\":%lu,\"cache_load_ms\":%lu,\"cache_hit\":%s}\n",
+           tracks, folders, (unsigned long)(scan_us / 1000), (unsigned)scanPeakHeapUse, (unsigned)ram,
+           (unsigned long)(save_us / 1000), (unsigned long)(load_us / 1000), hit ? "true" : "false");
+    free_playlist();
+}
+
+void run_decode_benchmark(void)
+{
+    printf("{\"benchmark\":\"helix_decode\",\"dir\":\"%s\",\"frames_per_file\":%d}\n",
+           BENCH_DIR, CONFIG_MP3_PLAYER_BENCHMARK_FRAMES);
+
+    DIR *dir = opendir(BENCH_DIR);
+    if (!dir)
+    {
+        printf("{\"error\":\"no %s directory\"}\n", BENCH_DIR);
+        return;
+    }
+
+    Mp3BenchContext ctx = {
+        .arena = decoder_arena,
+        .buf = input_buffer,
+        .map = pcm_buffer,
+        .buf_size = MIN(MP3_BUF_SIZE_PLAYING, PCM_BUF_SIZE_PLAYING),
+        .pcm = output_buffer,
+        .frames = CONFIG_MP3_PLAYER_BENCHMARK_FRAMES,
+        .cpu_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .cycles_per_tick = 1.0, // helix profiles in CPU cycles here
+        .now_ns = bench_now_ns,
+        .random = esp_random,
+    };
+    struct dirent *entry;
+    char path[300];
+    static char heap_paths[BENCH_HEAP_FILES][300];
+    int heap_count = 0;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        const char *ext = strrchr(entry->d_name, '.');
+        if (!ext || strcasecmp(ext, ".mp3") != 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", BENCH_DIR, entry->d_name);
+        if (heap_count < BENCH_HEAP_FILES)
+            strcpy(heap_paths[heap_count++], path);
+        mp3_bench_file(&ctx, path, entry->d_name);
+        benchmark_read_file(path, entry->d_name);
+        benchmark_seek_file(path, entry->d_name);
+    }
+    closedir(dir);
+    benchmark_decoder_heap(heap_paths, heap_count);
+    benchmark_playlist_scan();
+    printf("{\"benchmark\":\"done\"}\n");
+}
+#endif
+
 void app_main(void)
 {
     printf("=== ESP32-C3 MP3 Player with OLED & WiFi ===\n");
@@ -3167,10 +6121,9 @@ void app_main(void)
 
     // === ALLOCATE INITIAL MP3 BUFFER ===
     // We allocate this immediately on boot for music playback
-    input_buffer = (uint8_t *)malloc(MP3_BUF_SIZE_PLAYING);
-    if (input_buffer == NULL)
+    if (!alloc_playback_buffers())
     {
-        printf("CRITICAL: Failed to alloc initial MP3 buffer\n");
+        printf("CRITICAL: Failed to alloc initial MP3 buffers\n");
         // We can continue, but music won't play until memory is freed or reboot
     }
 
@@ -3196,8 +6149,9 @@ void app_main(void)
     }
     ESP_ERROR_CHECK(ret);
 
-    // Load WiFi credentials
+    // Load WiFi credentials and the last resume point
     load_wifi_credentials();
+    load_resume_point();
     if (strlen(stored_ssid) == 0)
     {
         strncpy(stored_ssid, WIFI_SSID, MAX_SSID_LEN - 1);
@@ -3213,6 +6167,16 @@ void app_main(void)
     show_loading_screen("Init SD Card");
     init_sd();
 
+#ifdef CONFIG_MP3_PLAYER_DECODE_BENCHMARK
+    show_loading_screen("Benchmark");
+    run_decode_benchmark();
+    show_loading_screen("Benchmark done");
+    while (1)
+        vTaskDelay(pdMS_TO_TICKS(1000));
+#endif
+
+    start_playback_pipeline();
+
     // === NOTE: WiFi is NOT initialized here anymore. ===
     // It is initialized on-demand in handle_buttons case 5.
 
@@ -3227,6 +6191,12 @@ void app_main(void)
     {
         totalTracks = playlistSize;
         currentTrack = 0;
+        int resume_track = (resumePath[0] != '\0') ? playlist_find_path(resumePath) : -1;
+        if (resume_track >= 0)
+        {
+            currentTrack = resume_track;
+            printf("Resume: track %d @ %lu ms\n", resume_track + 1, (unsigned long)resumePositionMs);
+        }
         show_ready_screen(playlistSize);
 
         while (1)
@@ -3247,7 +6217,9 @@ void app_main(void)
                 if (currentTrack >= 0 && currentTrack < playlistSize)
                 {
                     stopPlayback = false;
-                    play_file(playlist[currentTrack].filepath);
+                    char path[256];
+                    playlist_path(currentTrack, path, sizeof(path));
+                    play_file(path);
 
                     if (changeTrack)
                     {
@@ -3258,21 +6230,11 @@ void app_main(void)
                     }
                     else if (!stopPlayback)
                     {
-                        if (autoPlayMode == AUTOPLAY_ON)
+                        // Normally only reached when gapless chaining could not open the next file
+                        int next = pick_next_track(currentTrack);
+                        if (next >= 0)
                         {
-                            if (currentTrack < playlistSize - 1)
-                                currentTrack++;
-                            else
-                                currentTrack = 0;
-                        }
-                        else if (autoPlayMode == AUTOPLAY_RANDOM)
-                        {
-                            int tempTrack = currentTrack;
-                            currentTrack = esp_random() % playlistSize;
-                            while (tempTrack == currentTrack)
-                            {
-                                currentTrack = esp_random() % playlistSize;
-                            }
+                            currentTrack = next;
                         }
                         else
                         {
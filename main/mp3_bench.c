@@ -0,0 +1,216 @@
+#include "mp3_bench.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "mp3_frames.h"
+#include "mp3dec.h"
+
+static const char *const bench_stage_names[MP3_PROFILE_NSTAGES] = {
+    "sideinfo", "maindata", "scalefact", "huffman", "dequant_stereo", "imdct", "subband",
+};
+
+static const int bench_modes[MP3_BENCH_MODES] = {0, MP3_DECODE_MONO, MP3_DECODE_MONO | MP3_DECODE_HALFRATE};
+static const char *const bench_mode_names[MP3_BENCH_MODES] = {"full", "mono", "mono_half"};
+
+uint32_t mp3_bench_decode_file(const Mp3BenchContext *ctx, const char *path, const char *name, int mode_idx,
+                               uint32_t baseline_us_per_s)
+{
+    FILE *f = fopen(path, "rb");
+    HMP3Decoder dec = MP3InitDecoderStatic(ctx->arena, MP3GetDecoderArenaSize());
+    if (!f || !dec)
+    {
+        printf("{\"file\":\"%s\",\"error\":\"open\"}\n", name);
+        if (f)
+            fclose(f);
+        return 0;
+    }
+    MP3SetDecodeMode(dec, bench_modes[mode_idx]);
+
+    // Plain linear buffer with memmove refill: measures the decoder, not the pipeline
+    uint8_t *buf = ctx->buf;
+    uint8_t *ptr = buf;
+    int bytes_left = 0;
+    bool eof = false;
+    uint32_t frames = 0;
+    uint64_t samples = 0;
+    uint64_t bitrate_sum = 0;
+    int64_t decode_ns = 0;
+    MP3FrameInfo info = {0};
+
+    MP3ResetProfile();
+    while (frames < (uint32_t)ctx->frames)
+    {
+        if (bytes_left < MAINBUF_SIZE && !eof)
+        {
+            memmove(buf, ptr, bytes_left);
+            ptr = buf;
+            size_t n = fread(buf + bytes_left, 1, ctx->buf_size - bytes_left, f);
+            eof = (n == 0);
+            bytes_left += n;
+        }
+
+        int offset = MP3FindSyncWord(ptr, bytes_left);
+        if (offset < 0)
+        {
+            if (eof)
+                break;
+            bytes_left = 0;
+            continue;
+        }
+        ptr += offset;
+        bytes_left -= offset;
+
+        uint8_t *frame_start = ptr;
+        int frame_left = bytes_left;
+        int64_t t0 = ctx->now_ns();
+        int err = MP3Decode(dec, &ptr, &bytes_left, ctx->pcm, 0);
+        decode_ns += ctx->now_ns() - t0;
+
+        if (err == ERR_MP3_NONE)
+        {
+            MP3GetLastFrameInfo(dec, &info);
+            frames++;
+            samples += info.outputSamps / info.nChans;
+            bitrate_sum += info.bitrate;
+        }
+        else if (err == ERR_MP3_INDATA_UNDERFLOW)
+        {
+            if (eof)
+                break;
+            ptr = frame_start; // Refill and retry the same frame
+            bytes_left = frame_left;
+        }
+        else if (err != ERR_MP3_MAINDATA_UNDERFLOW)
+        {
+            ptr = frame_start + 1;
+            bytes_left = frame_left - 1;
+        }
+    }
+
+    fclose(f);
+
+    MP3ProfileStats prof;
+    MP3GetProfile(&prof);
+    uint32_t div = frames ? frames : 1;
+    int64_t decode_us = decode_ns / 1000;
+    uint32_t audio_ms = info.samprate ? (uint32_t)(samples * 1000 / info.samprate) : 0;
+    // us of CPU per ms of audio == ms of CPU per second of audio, kept in us for precision
+    uint32_t us_per_s = audio_ms ? (uint32_t)(decode_us * 1000 / audio_ms) : 0;
+
+    printf("{\"file\":\"%s\",\"mode\":\"%s\",\"samprate\":%d,\"channels\":%d,\"avg_kbps\":%lu,\"frames\":%lu,"
+           "\"cpu_mhz\":%d,\"us_per_frame\":%lu,\"realtime_x\":%.2f,\"cpu_ms_per_s\":%.1f,\"saved_ms_per_s\":%.1f,"
+           "\"cycles_per_frame\":{",
+           name, bench_mode_names[mode_idx], info.samprate, info.nChans, (unsigned long)(bitrate_sum / div / 1000),
+           (unsigned long)frames, ctx->cpu_mhz, (unsigned long)(decode_us / div),
+           decode_us > 0 ? (double)audio_ms * 1000.0 / decode_us : 0.0, us_per_s / 1000.0,
+           (baseline_us_per_s && us_per_s) ? ((int32_t)baseline_us_per_s - (int32_t)us_per_s) / 1000.0 : 0.0);
+    for (int i = 0; i < MP3_PROFILE_NSTAGES; i++)
+    {
+        printf("%s\"%s\":%lu", i ? "," : "", bench_stage_names[i],
+               (unsigned long)(prof.ticks[i] * ctx->cycles_per_tick / div));
+    }
+    printf("}}\n");
+    return us_per_s;
+}
+
+#define BENCH_RESYNC_TRIALS 200
+#define BENCH_BURST_MIN 64
+#define BENCH_BURST_MAX 2048
+
+void mp3_bench_resync_file(const Mp3BenchContext *ctx, const char *path, const char *name)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return;
+    // Middle of the file: clear of ID3v2 art and trailers
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, size > ctx->buf_size ? (size - ctx->buf_size) / 2 : 0, SEEK_SET);
+    uint8_t *buf = ctx->buf;
+    int len = (int)fread(buf, 1, ctx->buf_size, f);
+    fclose(f);
+
+    // Ground truth: byte map of real frame starts in the clean chunk
+    uint8_t *is_frame = ctx->map;
+    memset(is_frame, 0, ctx->buf_size);
+    Mp3SyncLock lock = {0};
+    int pos;
+    if (len < BENCH_BURST_MAX * 4 || mp3_resync(buf, len, &lock, false, &pos) != RESYNC_FOUND)
+    {
+        printf("{\"file\":\"%s\",\"error\":\"no sync\"}\n", name);
+        return;
+    }
+    Mp3FrameHeader h;
+    while (pos + 4 <= len && parse_frame_header(buf + pos, &h))
+    {
+        is_frame[pos] = 1;
+        pos += h.frame_bytes;
+    }
+
+    HMP3Decoder dec = MP3InitDecoderStatic(ctx->arena, MP3GetDecoderArenaSize());
+    static uint8_t saved[BENCH_BURST_MAX];
+    int64_t new_ns = 0, old_ns = 0;
+    uint32_t new_false = 0, old_false = 0, old_decodes = 0;
+
+    for (int t = 0; t < BENCH_RESYNC_TRIALS; t++)
+    {
+        int burst = BENCH_BURST_MIN + ctx->random() % (BENCH_BURST_MAX - BENCH_BURST_MIN);
+        int at = ctx->random() % (len / 2);
+        memcpy(saved, buf + at, burst);
+        for (int i = 0; i < burst; i++)
+            buf[at + i] = (uint8_t)ctx->random();
+
+        int off;
+        int64_t t0 = ctx->now_ns();
+        ResyncResult rs = mp3_resync(buf + at, len - at, &lock, true, &off);
+        new_ns += ctx->now_ns() - t0;
+        if (rs != RESYNC_FOUND || !is_frame[at + off])
+            new_false++;
+
+        // Old path: first sync word the decoder accepts, one byte forward per failure
+        int p = at;
+        t0 = ctx->now_ns();
+        while (p < len - 4)
+        {
+            int o = MP3FindSyncWord(buf + p, len - p);
+            if (o < 0)
+            {
+                p = len;
+                break;
+            }
+            p += o;
+            uint8_t *q = buf + p;
+            int left = len - p;
+            MP3ResetDecoder(dec);
+            old_decodes++;
+            int err = MP3Decode(dec, &q, &left, ctx->pcm, 0);
+            if (err == ERR_MP3_NONE || err == ERR_MP3_MAINDATA_UNDERFLOW)
+                break;
+            p++;
+        }
+        old_ns += ctx->now_ns() - t0;
+        if (p >= len || !is_frame[p])
+            old_false++;
+
+        memcpy(buf + at, saved, burst);
+    }
+
+    printf("{\"file\":\"%s\",\"test\":\"resync\",\"trials\":%d,\"resync_us\":%lu,\"resync_false_pct\":%.1f,"
+           "\"bytewise_us\":%lu,\"bytewise_decodes\":%lu,\"bytewise_false_pct\":%.1f}\n",
+           name, BENCH_RESYNC_TRIALS, (unsigned long)(new_ns / 1000 / BENCH_RESYNC_TRIALS),
+           100.0 * new_false / BENCH_RESYNC_TRIALS, (unsigned long)(old_ns / 1000 / BENCH_RESYNC_TRIALS),
+           (unsigned long)(old_decodes / BENCH_RESYNC_TRIALS), 100.0 * old_false / BENCH_RESYNC_TRIALS);
+}
+
+void mp3_bench_file(const Mp3BenchContext *ctx, const char *path, const char *name)
+{
+    uint32_t baseline = 0;
+    for (int m = 0; m < MP3_BENCH_MODES; m++)
+    {
+        uint32_t us_per_s = mp3_bench_decode_file(ctx, path, name, m, baseline);
+        if (m == 0)
+            baseline = us_per_s;
+    }
+    mp3_bench_resync_file(ctx, path, name);
+}
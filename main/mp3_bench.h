@@ -0,0 +1,36 @@
+// Decode and resync benchmarks shared by the firmware benchmark mode
+// (CONFIG_MP3_PLAYER_DECODE_BENCHMARK) and the host build in host_test/mp3bench,
+// so both print the same JSON lines. No ESP-IDF dependencies: the caller
+// supplies buffers, a clock and a random source.
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define MP3_BENCH_MODES 3 // Each file is decoded once per mode: full, mono, mono + half rate
+
+typedef struct
+{
+    void *arena;          // MP3GetDecoderArenaSize() bytes, suitably aligned
+    uint8_t *buf;         // Compressed input
+    uint8_t *map;         // Scratch for the resync ground truth, buf_size bytes
+    int buf_size;
+    short *pcm;           // One decoded frame (MAX_NCHAN * MAX_NGRAN * MAX_NSAMP)
+    int frames;           // Frames to decode per file and mode
+    int cpu_mhz;
+    double cycles_per_tick; // Profile ticks to CPU cycles (1 where helix counts cycles)
+    int64_t (*now_ns)(void);
+    uint32_t (*random)(void);
+} Mp3BenchContext;
+
+// Decode up to ctx->frames frames of a file in one mode and print its JSON
+// line. Returns decode CPU time per second of audio produced (us), 0 on failure.
+uint32_t mp3_bench_decode_file(const Mp3BenchContext *ctx, const char *path, const char *name, int mode_idx,
+                               uint32_t baseline_us_per_s);
+
+// Corrupt random bursts of a clean chunk of the file and print how mp3_resync
+// recovers compared with the old MP3FindSyncWord + MP3Decode stepping
+void mp3_bench_resync_file(const Mp3BenchContext *ctx, const char *path, const char *name);
+
+// Every mode, then the resync benchmark
+void mp3_bench_file(const Mp3BenchContext *ctx, const char *path, const char *name);
@@ -0,0 +1,647 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "mp3_frames.h"
+
+// === MP3 Frame Header Helpers ===
+static const uint16_t mp3_bitrates_kbps[2][15] = {
+    {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320}, // MPEG1 Layer III
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},     // MPEG2/2.5 Layer III
+};
+
+static const uint16_t mp3_sample_rates[3][3] = {
+    {44100, 48000, 32000}, // MPEG1
+    {22050, 24000, 16000}, // MPEG2
+    {11025, 12000, 8000},  // MPEG2.5
+};
+
+bool parse_frame_header(const uint8_t *p, Mp3FrameHeader *h)
+{
+    if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0)
+        return false;
+
+    int version_bits = (p[1] >> 3) & 0x03;
+    int layer_bits = (p[1] >> 1) & 0x03;
+    int bitrate_idx = (p[2] >> 4) & 0x0F;
+    int samprate_idx = (p[2] >> 2) & 0x03;
+    int padding = (p[2] >> 1) & 0x01;
+
+    if (version_bits == 1 || layer_bits != 1 || bitrate_idx == 0 || bitrate_idx == 15 || samprate_idx == 3)
+        return false;
+
+    h->version = (version_bits == 3) ? 0 : (version_bits == 2 ? 1 : 2);
+    h->bitrate_kbps = mp3_bitrates_kbps[h->version ? 1 : 0][bitrate_idx];
+    h->sample_rate = mp3_sample_rates[h->version][samprate_idx];
+    h->channels = ((p[3] >> 6) & 0x03) == 3 ? 1 : 2;
+    h->samples_per_frame = h->version ? 576 : 1152;
+    h->frame_bytes = (h->version ? 72 : 144) * h->bitrate_kbps * 1000 / h->sample_rate + padding;
+    return true;
+}
+
+bool is_info_frame(const uint8_t *frame, size_t len, const Mp3FrameHeader *h)
+{
+    size_t xing = FRAME_XING_OFFSET(h);
+    return (xing + 4 <= len && (memcmp(frame + xing, "Xing", 4) == 0 || memcmp(frame + xing, "Info", 4) == 0)) ||
+           (FRAME_VBRI_OFFSET + 4 <= len && memcmp(frame + FRAME_VBRI_OFFSET, "VBRI", 4) == 0);
+}
+
+uint32_t id3v2_tag_size(const uint8_t *p)
+{
+    if (p[0] != 'I' || p[1] != 'D' || p[2] != '3')
+        return 0;
+    if ((p[6] | p[7] | p[8] | p[9]) & 0x80)
+        return 0; // Not a syncsafe size
+    uint32_t size = ((uint32_t)p[6] << 21) | ((uint32_t)p[7] << 14) | ((uint32_t)p[8] << 7) | p[9];
+    bool has_footer = (p[5] & 0x10) != 0;
+    return 10 + size + (has_footer ? 10 : 0);
+}
+
+// === Frame Resync ===
+// After corrupt data or a decode error, stepping one byte at a time through
+// MP3FindSyncWord + MP3Decode can cost thousands of failed decodes. Instead scan
+// a word at a time for 0xFF, check each candidate against the stream's format,
+// and only accept it when the next header sits exactly one frame later.
+
+// Any byte of w equal to 0xFF (zero-byte test on ~w)
+#define WORD_HAS_FF(w) ((~(w) - 0x01010101u) & (w) & 0x80808080u)
+
+static bool sync_header_matches(const uint8_t *p, const Mp3SyncLock *lock, Mp3FrameHeader *h)
+{
+    if (!parse_frame_header(p, h))
+        return false;
+    return !lock->valid ||
+           ((p[1] & 0xFE) == lock->id && (p[2] & 0x0C) == lock->rate && (((p[3] >> 6) == 3) == lock->mono));
+}
+
+static void sync_lock_set(Mp3SyncLock *lock, const uint8_t *p)
+{
+    lock->id = p[1] & 0xFE;
+    lock->rate = p[2] & 0x0C;
+    lock->mono = (p[3] >> 6) == 3;
+    lock->free_format = (p[2] & 0xF0) == 0;
+    lock->valid = true;
+}
+
+// Layer III header with bitrate index 0 (parse_frame_header rejects these)
+static bool free_format_header(const uint8_t *p)
+{
+    return p[0] == 0xFF && (p[1] & 0xE0) == 0xE0 && ((p[1] >> 3) & 0x03) != 1 && ((p[1] >> 1) & 0x03) == 1 &&
+           (p[2] & 0xF0) == 0 && ((p[2] >> 2) & 0x03) != 3;
+}
+
+// Only a stream that started free-format accepts free-format frames, unconfirmed
+static bool free_format_matches(const uint8_t *p, const Mp3SyncLock *lock)
+{
+    if (!free_format_header(p))
+        return false;
+    return !lock->valid ||
+           (lock->free_format && (p[1] & 0xFE) == lock->id && (p[2] & 0x0C) == lock->rate);
+}
+
+bool frame_in_sync(const uint8_t *p, int len, const Mp3SyncLock *lock)
+{
+    Mp3FrameHeader h;
+    return lock->valid && len >= 4 &&
+           (lock->free_format ? free_format_matches(p, lock) : sync_header_matches(p, lock, &h));
+}
+
+ResyncResult mp3_resync(const uint8_t *buf, int len, Mp3SyncLock *lock, bool final, int *offset)
+{
+    int i = 0;
+    while (i + 4 <= len)
+    {
+        // Skip whole aligned words without a 0xFF byte
+        while (((uintptr_t)(buf + i) & 3) == 0 && i + 4 <= len)
+        {
+            uint32_t w;
+            memcpy(&w, __builtin_assume_aligned(buf + i, 4), 4);
+            if (WORD_HAS_FF(w))
+                break;
+            i += 4;
+        }
+        if (i + 4 > len)
+            break;
+
+        if (buf[i] != 0xFF || (buf[i + 1] & 0xE0) != 0xE0)
+        {
+            i++;
+            continue;
+        }
+
+        Mp3FrameHeader h;
+        if (!sync_header_matches(buf + i, lock, &h))
+        {
+            if (free_format_matches(buf + i, lock))
+            {
+                if (!lock->valid)
+                    sync_lock_set(lock, buf + i);
+                *offset = i;
+                return RESYNC_FOUND;
+            }
+            i++;
+            continue;
+        }
+
+        int next = i + h.frame_bytes;
+        if (next + 4 > len)
+        {
+            *offset = i;
+            return final ? RESYNC_FOUND : RESYNC_NEED_MORE;
+        }
+
+        // The successor must carry the same format as the candidate
+        Mp3SyncLock candidate = *lock;
+        if (!candidate.valid)
+            sync_lock_set(&candidate, buf + i);
+        Mp3FrameHeader next_hdr;
+        if (sync_header_matches(buf + next, &candidate, &next_hdr))
+        {
+            *lock = candidate;
+            *offset = i;
+            return RESYNC_FOUND;
+        }
+        i++;
+    }
+
+    // Keep a possibly split header at the end unless nothing more is coming
+    *offset = final ? len : MAX(0, len - 3);
+    return RESYNC_NONE;
+}
+
+// === Stream Info ===
+static inline uint32_t read_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint16_t read_be16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t read_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint32_t stream_info_audio_end(const uint8_t *tail, uint32_t file_size)
+{
+    uint32_t end = file_size;
+    const uint8_t *footer = tail + 128; // APEv2 footer when there is no ID3v1
+    if (memcmp(tail + 32, "TAG", 3) == 0)
+    {
+        end -= 128;
+        footer = tail;
+    }
+
+    if (memcmp(footer, "APETAGEX", 8) == 0)
+    {
+        uint32_t size = read_le32(footer + 12);
+        uint32_t flags = read_le32(footer + 20);
+        uint32_t tag_bytes = size + ((flags & 0x80000000u) ? 32 : 0); // Size excludes the optional header
+        if (tag_bytes < end)
+            end -= tag_bytes;
+    }
+    return end;
+}
+
+void parse_xing_header(Mp3StreamInfo *info, const uint8_t *p, const uint8_t *end)
+{
+    uint32_t flags = read_be32(p + 4);
+    const uint8_t *q = p + 8;
+
+    if ((flags & 0x01) && q + 4 <= end)
+    {
+        info->total_frames = read_be32(q);
+        q += 4;
+    }
+    if ((flags & 0x02) && q + 4 <= end)
+    {
+        uint32_t bytes = read_be32(q);
+        if (bytes > 0 && bytes <= info->audio_bytes)
+            info->audio_bytes = bytes;
+        q += 4;
+    }
+    if ((flags & 0x04) && q + 100 <= end)
+    {
+        memcpy(info->xing_toc, q, 100);
+        info->has_xing_toc = true;
+        q += 100;
+    }
+    if (flags & 0x08)
+        q += 4;
+
+    // LAME extension: encoder delay/padding are 2 x 12 bits at +21
+    if (q + 24 <= end && (memcmp(q, "LAME", 4) == 0 || memcmp(q, "Lavf", 4) == 0 || memcmp(q, "Lavc", 4) == 0))
+    {
+        info->encoder_delay = (uint16_t)((q[21] << 4) | (q[22] >> 4));
+        info->encoder_padding = (uint16_t)(((q[22] & 0x0F) << 8) | q[23]);
+        info->has_lame = true;
+    }
+}
+
+void parse_vbri_header(Mp3StreamInfo *info, const uint8_t *p, const uint8_t *end)
+{
+    if (p + 26 > end)
+        return;
+
+    uint32_t bytes = read_be32(p + 10);
+    info->total_frames = read_be32(p + 14);
+    uint16_t entries = read_be16(p + 18);
+    uint16_t scale = read_be16(p + 20);
+    uint16_t entry_size = read_be16(p + 22);
+    uint16_t frames_per_entry = read_be16(p + 24);
+
+    if (bytes > 0 && bytes <= info->audio_bytes)
+        info->audio_bytes = bytes;
+
+    if (entry_size == 0 || entry_size > 4 || frames_per_entry == 0)
+        return;
+
+    // Keep at most VBRI_MAX_ENTRIES points by merging neighbouring entries
+    uint16_t merge = (entries + VBRI_MAX_ENTRIES - 1) / VBRI_MAX_ENTRIES;
+    if (merge == 0)
+        merge = 1;
+
+    const uint8_t *q = p + 26;
+    uint32_t total = 0;
+    uint16_t kept = 0;
+    info->vbri_offsets[0] = 0;
+    for (uint16_t i = 0; i < entries && q + entry_size <= end; i++)
+    {
+        uint32_t v = 0;
+        for (int b = 0; b < entry_size; b++)
+            v = (v << 8) | *q++;
+        total += v * scale;
+        if ((i + 1) % merge == 0 && kept < VBRI_MAX_ENTRIES)
+            info->vbri_offsets[++kept] = total;
+    }
+    info->vbri_entries = kept;
+    info->vbri_frames_per_entry = frames_per_entry * merge;
+}
+
+bool stream_info_parse(Mp3StreamInfo *info, const uint8_t *buf, size_t n)
+{
+    // First valid frame header in the probe window
+    Mp3FrameHeader h;
+    size_t pos = 0;
+    while (pos + 4 <= n && !parse_frame_header(buf + pos, &h))
+        pos++;
+    if (pos + 4 > n)
+        return false;
+
+    info->audio_start += pos;
+    info->audio_bytes = info->audio_end > info->audio_start ? info->audio_end - info->audio_start : 0;
+    info->sample_rate = h.sample_rate;
+    info->samples_per_frame = h.samples_per_frame;
+    info->bitrate_kbps = h.bitrate_kbps;
+
+    const uint8_t *frame = buf + pos;
+    const uint8_t *end = buf + n;
+    const uint8_t *xing = frame + FRAME_XING_OFFSET(&h);
+    const uint8_t *vbri = frame + FRAME_VBRI_OFFSET;
+
+    if (xing + 8 <= end && (memcmp(xing, "Xing", 4) == 0 || memcmp(xing, "Info", 4) == 0))
+    {
+        parse_xing_header(info, xing, end);
+        info->info_frame_bytes = h.frame_bytes;
+    }
+    else if (vbri + 4 <= end && memcmp(vbri, "VBRI", 4) == 0)
+    {
+        parse_vbri_header(info, vbri, end);
+        info->info_frame_bytes = h.frame_bytes;
+    }
+
+    return true;
+}
+
+uint32_t stream_info_duration_ms(const Mp3StreamInfo *info)
+{
+    if (info->sample_rate == 0)
+        return 0;
+    if (info->total_frames > 0)
+        return (uint32_t)((uint64_t)info->total_frames * info->samples_per_frame * 1000 / info->sample_rate);
+    if (info->bitrate_kbps > 0)
+        return (uint32_t)((uint64_t)info->audio_bytes * 8 / info->bitrate_kbps); // CBR estimate
+    return 0;
+}
+
+bool stream_info_seek(const Mp3StreamInfo *info, uint32_t target_ms, uint32_t *file_offset)
+{
+    uint32_t duration_ms = stream_info_duration_ms(info);
+    if (duration_ms == 0 || info->audio_bytes == 0)
+        return false;
+    if (target_ms >= duration_ms)
+        target_ms = duration_ms - 1;
+
+    uint64_t rel;
+    if (info->has_xing_toc)
+    {
+        // Interpolate between the two TOC points around the target percentage
+        uint32_t pct_x1000 = (uint32_t)((uint64_t)target_ms * 100000 / duration_ms);
+        uint32_t idx = pct_x1000 / 1000;
+        uint32_t frac = pct_x1000 % 1000;
+        uint32_t a = info->xing_toc[idx];
+        uint32_t b = (idx < 99) ? info->xing_toc[idx + 1] : 256;
+        uint32_t toc_x1000 = a * 1000 + (b - a) * frac;
+        rel = (uint64_t)toc_x1000 * info->audio_bytes / 256000;
+    }
+    else if (info->vbri_entries > 0)
+    {
+        uint32_t frame = (uint32_t)((uint64_t)target_ms * info->sample_rate / (1000 * info->samples_per_frame));
+        uint32_t entry = frame / info->vbri_frames_per_entry;
+        if (entry > info->vbri_entries)
+            entry = info->vbri_entries;
+        rel = info->vbri_offsets[entry];
+    }
+    else
+    {
+        rel = (uint64_t)target_ms * info->bitrate_kbps / 8;
+    }
+
+    if (rel >= info->audio_bytes)
+        rel = info->audio_bytes - 1;
+    *file_offset = info->audio_start + (uint32_t)rel;
+    return true;
+}
+
+void stream_info_trim(const Mp3StreamInfo *info, int32_t *skip_samples, int64_t *valid_samples)
+{
+    *skip_samples = 0;
+    *valid_samples = -1;
+    if (!info->has_lame)
+        return;
+
+    *skip_samples = info->encoder_delay + MP3_DECODER_DELAY;
+    if (info->total_frames > 0)
+    {
+        int64_t total = (int64_t)info->total_frames * info->samples_per_frame;
+        *valid_samples = total - info->encoder_delay - info->encoder_padding;
+        if (*valid_samples < 0)
+            *valid_samples = -1;
+    }
+}
+
+int stream_trim_frame(int32_t *skip_samples, int64_t *valid_samples, int frame_samples, int *skip)
+{
+    *skip = MIN(*skip_samples, frame_samples);
+    *skip_samples -= *skip;
+    int emit = frame_samples - *skip;
+    if (*valid_samples >= 0)
+    {
+        if (emit > *valid_samples)
+            emit = (int)*valid_samples;
+        *valid_samples -= emit;
+    }
+    return emit;
+}
+
+// === Seek Index Builder ===
+// seek_index_feed() has to end up with the frames play_file() would decode and
+// index, because an upload-built sidecar is later trusted for seeking and for
+// the track duration. So it finds the first frame the way playback does
+// (mp3_resync, confirmed by its successor), then walks frame lengths; a stream
+// that loses sync and finds it again gets no index, exactly like playback.
+typedef enum
+{
+    FEED_START,  // Before the first frame: ID3v2 tags, then a confirmed sync
+    FEED_SYNCED, // Walking frame headers
+    FEED_LOST,   // Sync lost: a later frame would be a playback resync
+    FEED_ENDED   // ID3v1/APEv2 trailer reached: nothing after it is audio
+} SeekIndexFeedState;
+
+bool seek_index_begin(SeekIndexBuilder *b)
+{
+    memset(b, 0, sizeof(*b));
+    b->offsets = (uint32_t *)malloc(SEEK_INDEX_MAX_ENTRIES * sizeof(uint32_t));
+    b->frames_per_entry = SEEK_INDEX_FRAMES_PER_ENTRY;
+    b->valid = (b->offsets != NULL);
+    return b->valid;
+}
+
+void seek_index_abort(SeekIndexBuilder *b)
+{
+    free(b->offsets);
+    free(b->scan);
+    b->offsets = NULL;
+    b->scan = NULL;
+    b->scan_len = 0;
+    b->valid = false;
+}
+
+void seek_index_add_frame(SeekIndexBuilder *b, uint32_t file_offset, int sample_rate, int samples_per_frame)
+{
+    if (!b->valid)
+        return;
+
+    if (b->total_frames == 0)
+    {
+        b->sample_rate = sample_rate;
+        b->samples_per_frame = samples_per_frame;
+    }
+    else if (sample_rate != (int)b->sample_rate || samples_per_frame != b->samples_per_frame)
+    {
+        return; // Ignore stray frames that do not match the stream
+    }
+
+    if (b->total_frames % b->frames_per_entry == 0)
+    {
+        if (b->count == SEEK_INDEX_MAX_ENTRIES)
+        {
+            // Table full: keep every other entry and double the spacing
+            for (uint32_t i = 0; i < b->count / 2; i++)
+                b->offsets[i] = b->offsets[i * 2];
+            b->count /= 2;
+            b->frames_per_entry *= 2;
+        }
+        if (b->total_frames % b->frames_per_entry == 0)
+            b->offsets[b->count++] = file_offset;
+    }
+    b->total_frames++;
+}
+
+// Hand the collected window back to the scanner after a header failed to show up
+static void seek_index_lose_sync(SeekIndexBuilder *b)
+{
+    memcpy(b->scan, b->hdr, b->hdr_len);
+    b->scan_len = b->hdr_len;
+    b->hdr_len = 0;
+    b->state = FEED_LOST;
+}
+
+// Test the window collected at next_header for the next frame or a trailer
+static void seek_index_check_window(SeekIndexBuilder *b)
+{
+    uint32_t start = b->next_header;
+    Mp3FrameHeader h;
+    if (b->hdr_len < 4)
+        return;
+
+    if (sync_header_matches(b->hdr, &b->lock, &h))
+    {
+        if (!b->first_frame_seen)
+        {
+            // Collect enough of the first frame to tell a VBR header from audio
+            if (b->hdr_len < MIN(FRAME_INFO_PROBE_BYTES, h.frame_bytes))
+                return;
+            b->first_frame_seen = true;
+            if (is_info_frame(b->hdr, b->hdr_len, &h))
+            {
+                b->next_header = start + h.frame_bytes;
+                b->hdr_len = 0;
+                return; // Decodes to silence and is never played: not part of the index
+            }
+        }
+        seek_index_add_frame(b, start, h.sample_rate, h.samples_per_frame);
+        b->frame_end = start + h.frame_bytes;
+        b->next_header = b->frame_end;
+        b->hdr_len = 0;
+        return;
+    }
+
+    // Playback stops reading where these trailers start (find_audio_end)
+    if (memcmp(b->hdr, "TAG", 3) == 0)
+    {
+        b->state = FEED_ENDED;
+        return;
+    }
+    if (memcmp(b->hdr, "APETAGEX", MIN(b->hdr_len, 8)) == 0)
+    {
+        if (b->hdr_len == 8)
+            b->state = FEED_ENDED;
+        return;
+    }
+    seek_index_lose_sync(b);
+}
+
+// Walk in-sync data starting at stream offset pos. Returns the bytes used, fewer
+// than len once sync is lost: the rest belongs to the scanner.
+static size_t seek_index_walk(SeekIndexBuilder *b, const uint8_t *data, size_t len, uint32_t pos)
+{
+    size_t i = 0;
+    while (i < len && b->state == FEED_SYNCED)
+    {
+        if (b->hdr_len == 0 && pos + i < b->next_header)
+        {
+            // Jump over frame payload straight to the next header
+            i += MIN(len - i, (size_t)(b->next_header - (pos + i)));
+            continue;
+        }
+        b->hdr[b->hdr_len++] = data[i++];
+        seek_index_check_window(b);
+    }
+    return i;
+}
+
+// Look for the first frame (or, after lost sync, any frame) in the scan window
+static void seek_index_scan(SeekIndexBuilder *b, bool final)
+{
+    while (b->valid && b->scan_len > 0 && (b->state == FEED_START || b->state == FEED_LOST))
+    {
+        uint32_t base = b->stream_pos - b->scan_len;
+        if (b->state == FEED_START && base == b->next_header)
+        {
+            // ID3v2 tags (sometimes several) sit right before the first frame
+            if (b->scan_len < 10 && !final)
+                return;
+            uint32_t tag_size = (b->scan_len >= 10) ? id3v2_tag_size(b->scan) : 0;
+            if (tag_size > 0)
+            {
+                size_t drop = MIN(tag_size, b->scan_len);
+                b->next_header = base + tag_size; // feed() skips the rest of the tag
+                memmove(b->scan, b->scan + drop, b->scan_len - drop);
+                b->scan_len -= drop;
+                continue;
+            }
+        }
+
+        int offset;
+        ResyncResult rs = mp3_resync(b->scan, b->scan_len, &b->lock, final, &offset);
+        if (rs != RESYNC_FOUND)
+        {
+            memmove(b->scan, b->scan + offset, b->scan_len - offset);
+            b->scan_len -= offset;
+            return;
+        }
+        if (b->state == FEED_LOST || b->lock.free_format)
+        {
+            // Playback resyncs here, or cannot size free-format frames: no index
+            seek_index_abort(b);
+            return;
+        }
+
+        // Replay the window from the frame through the header walk
+        const uint8_t *p = b->scan + offset;
+        size_t rest = b->scan_len - offset;
+        b->state = FEED_SYNCED;
+        b->next_header = base + offset;
+        b->scan_len = 0;
+        size_t used = seek_index_walk(b, p, rest, base + offset);
+        if (b->state != FEED_LOST)
+            return;
+        memmove(b->scan + b->scan_len, p + used, rest - used);
+        b->scan_len += rest - used;
+    }
+}
+
+void seek_index_feed(SeekIndexBuilder *b, const uint8_t *data, size_t len)
+{
+    if (b->valid && !b->scan)
+    {
+        b->scan = (uint8_t *)malloc(SEEK_INDEX_SCAN_BYTES);
+        if (!b->scan)
+            seek_index_abort(b);
+    }
+
+    while (b->valid && len > 0)
+    {
+        size_t n;
+        if (b->state == FEED_SYNCED)
+        {
+            n = seek_index_walk(b, data, len, b->stream_pos);
+        }
+        else if (b->state == FEED_ENDED)
+        {
+            n = len;
+        }
+        else if (b->state == FEED_START && b->stream_pos < b->next_header)
+        {
+            n = MIN(len, (size_t)(b->next_header - b->stream_pos)); // Rest of an ID3v2 tag
+        }
+        else
+        {
+            n = MIN(len, (size_t)(SEEK_INDEX_SCAN_BYTES - b->scan_len));
+            memcpy(b->scan + b->scan_len, data, n);
+            b->scan_len += n;
+        }
+        data += n;
+        len -= n;
+        b->stream_pos += n;
+
+        if (b->scan_len == SEEK_INDEX_SCAN_BYTES)
+            seek_index_scan(b, false);
+    }
+}
+
+void seek_index_end(SeekIndexBuilder *b)
+{
+    if (!b->valid || b->stream_pos == 0)
+        return;
+
+    if (b->state == FEED_START || b->state == FEED_LOST)
+        seek_index_scan(b, true);
+    if (!b->valid)
+        return;
+
+    // The decoder never gets all of a truncated last frame and drops it
+    if (b->total_frames > 0 && b->frame_end > b->stream_pos)
+    {
+        b->total_frames--;
+        if (b->total_frames % b->frames_per_entry == 0)
+            b->count--;
+    }
+    free(b->scan);
+    b->scan = NULL;
+    b->scan_len = 0;
+}
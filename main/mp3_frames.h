@@ -0,0 +1,158 @@
+// MP3 frame parsing shared by playback, upload and the host tests: Layer III
+// frame headers, resync after corrupt data, Xing/VBRI/LAME stream info and the
+// in-memory seek index builder. No ESP-IDF dependencies; see host_test/.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// === MP3 Frame Header Helpers ===
+typedef struct
+{
+    int version;           // 0 = MPEG1, 1 = MPEG2, 2 = MPEG2.5
+    int bitrate_kbps;
+    int sample_rate;
+    int channels;
+    int samples_per_frame;
+    int frame_bytes;
+} Mp3FrameHeader;
+
+// Parse a Layer III frame header (4 bytes). Free-format frames are rejected.
+bool parse_frame_header(const uint8_t *p, Mp3FrameHeader *h);
+
+// Where a Xing/Info tag sits (after the side info) and where a VBRI tag sits
+#define FRAME_XING_OFFSET(h) (4 + ((h)->version == 0 ? ((h)->channels == 1 ? 17 : 32) : ((h)->channels == 1 ? 9 : 17)))
+#define FRAME_VBRI_OFFSET 36
+#define FRAME_INFO_PROBE_BYTES (FRAME_VBRI_OFFSET + 4) // Enough of a frame to spot either tag
+
+// The first frame of a VBR/LAME file is a Xing/Info or VBRI header, silent and never played
+bool is_info_frame(const uint8_t *frame, size_t len, const Mp3FrameHeader *h);
+
+// Size of a leading ID3v2 tag (header + body + optional footer), 0 if none
+uint32_t id3v2_tag_size(const uint8_t *p);
+
+// === Frame Resync ===
+typedef struct
+{
+    bool valid;
+    uint8_t id;   // Header byte 1 without the CRC bit: version + layer
+    uint8_t rate; // Header byte 2 sample rate bits
+    bool mono;
+    bool free_format; // No bitrate index: frames cannot be length-confirmed
+} Mp3SyncLock;
+
+typedef enum
+{
+    RESYNC_FOUND,     // Confirmed frame start at *offset
+    RESYNC_NEED_MORE, // Candidate at *offset needs more data to confirm
+    RESYNC_NONE       // No frame start; *offset bytes can be dropped
+} ResyncResult;
+
+// Fast path check while in sync: is there a frame of this stream right at p?
+bool frame_in_sync(const uint8_t *p, int len, const Mp3SyncLock *lock);
+
+// Find the next confirmed frame start in buf. final: no more data follows buf
+// (end of file or track boundary), so a candidate whose successor is cut off is
+// accepted unconfirmed.
+ResyncResult mp3_resync(const uint8_t *buf, int len, Mp3SyncLock *lock, bool final, int *offset);
+
+// === Stream Info (Xing/Info, VBRI and LAME headers of the first frame) ===
+#define VBRI_MAX_ENTRIES 128
+#define STREAM_PROBE_SIZE 2048       // Enough for one max-size frame with its VBR header
+#define STREAM_TAIL_BYTES (128 + 32) // ID3v1 trailer and the APEv2 footer before it
+
+typedef struct
+{
+    uint32_t audio_start;      // File offset of the first frame (after ID3v2 tags)
+    uint32_t audio_end;        // File offset past the last frame (before APEv2/ID3v1)
+    uint32_t audio_bytes;      // Bytes from audio_start to audio_end
+    uint32_t total_frames;     // 0 = unknown (plain CBR)
+    int sample_rate;
+    int samples_per_frame;
+    int bitrate_kbps;          // First frame, used for the CBR estimate
+
+    bool has_xing_toc;
+    uint8_t xing_toc[100];     // Percent of duration -> offset / 256 of audio_bytes
+
+    uint16_t vbri_entries;
+    uint16_t vbri_frames_per_entry;
+    uint32_t vbri_offsets[VBRI_MAX_ENTRIES + 1]; // Cumulative, relative to audio_start
+
+    uint32_t info_frame_bytes; // Xing/Info/VBRI frame at audio_start carries no audio (0 = none)
+
+    bool has_lame;
+    uint16_t encoder_delay;    // Samples added at the start by the encoder
+    uint16_t encoder_padding;  // Samples added at the end
+} Mp3StreamInfo;
+
+// Offset past the last audio byte: drop an ID3v1 trailer and an APEv2 tag
+// before it. tail holds the last STREAM_TAIL_BYTES of a file at least that long.
+uint32_t stream_info_audio_end(const uint8_t *tail, uint32_t file_size);
+
+// Fill in the stream from n bytes read at info->audio_start (audio_end and
+// audio_bytes already set): moves audio_start to the first frame header and
+// parses its Xing/Info, VBRI and LAME headers. False if there is no header.
+bool stream_info_parse(Mp3StreamInfo *info, const uint8_t *buf, size_t n);
+
+// p points at "Xing"/"Info" or "VBRI"; end bounds the probe window
+void parse_xing_header(Mp3StreamInfo *info, const uint8_t *p, const uint8_t *end);
+void parse_vbri_header(Mp3StreamInfo *info, const uint8_t *p, const uint8_t *end);
+
+uint32_t stream_info_duration_ms(const Mp3StreamInfo *info);
+
+// Approximate seek without an index: Xing TOC, VBRI table or constant bitrate
+bool stream_info_seek(const Mp3StreamInfo *info, uint32_t target_ms, uint32_t *file_offset);
+
+// Gapless trimming from the LAME tag: encoder delay plus the 529-sample decoder
+// delay at the start, encoder padding at the end. valid_samples = -1 when unknown.
+#define MP3_DECODER_DELAY 529
+
+void stream_info_trim(const Mp3StreamInfo *info, int32_t *skip_samples, int64_t *valid_samples);
+
+// Apply the trim to one decoded frame: *skip samples to drop at its start,
+// returns how many after them to play. Advances skip_samples/valid_samples.
+int stream_trim_frame(int32_t *skip_samples, int64_t *valid_samples, int frame_samples, int *skip);
+
+// === Seek Index Builder ===
+#define SEEK_INDEX_MAX_ENTRIES 2048  // 8 KB table, decimated when full
+#define SEEK_INDEX_FRAMES_PER_ENTRY 38 // ~1 s at 44.1 kHz
+#define SEEK_INDEX_SCAN_BYTES 4096   // seek_index_feed() sync window: a candidate frame and its successor
+
+typedef struct
+{
+    uint32_t *offsets;
+    uint32_t count;
+    uint16_t frames_per_entry;
+    uint32_t total_frames;
+    uint32_t sample_rate;
+    uint16_t samples_per_frame;
+    bool valid;
+
+    // Streaming parser state for seek_index_feed()
+    uint8_t state;         // SeekIndexFeedState
+    uint32_t stream_pos;   // Bytes fed so far
+    uint32_t next_header;  // In sync: stream offset of the next header; before: end of the last ID3v2 tag
+    uint32_t frame_end;    // End of the last frame counted
+    uint8_t hdr[FRAME_INFO_PROBE_BYTES]; // Header bytes collected across feed() calls
+    uint8_t hdr_len;
+    uint8_t *scan;         // Unsynced bytes ending at stream_pos, SEEK_INDEX_SCAN_BYTES
+    uint16_t scan_len;
+    Mp3SyncLock lock;
+    bool first_frame_seen; // The first frame was checked for a Xing/Info/VBRI header
+} SeekIndexBuilder;
+
+bool seek_index_begin(SeekIndexBuilder *b);
+void seek_index_abort(SeekIndexBuilder *b);
+
+// Record one frame; offsets must arrive in file order starting at the first frame
+void seek_index_add_frame(SeekIndexBuilder *b, uint32_t file_offset, int sample_rate, int samples_per_frame);
+
+// Walk frame headers in a byte stream delivered in arbitrary chunks (e.g. an
+// upload), counting the frames playback would decode: no index if sync is lost
+// and found again, nothing past an ID3v1/APEv2 trailer, no truncated last frame.
+void seek_index_feed(SeekIndexBuilder *b, const uint8_t *data, size_t len);
+
+// End of a fed stream: settle the last frame. A no-op for a builder filled by
+// seek_index_add_frame() alone.
+void seek_index_end(SeekIndexBuilder *b);